@@ -0,0 +1,47 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace inference_bench {
+
+/**
+ * @brief Scales an iteration count by the FEATURE_BROKER_BENCH_SCALE environment variable, for example to keep runs
+ * short on CI.
+ */
+inline std::size_t Scaled(std::size_t iterations) {
+    if (auto scale = std::getenv("FEATURE_BROKER_BENCH_SCALE")) {
+        iterations = static_cast<std::size_t>(static_cast<double>(iterations) * std::atof(scale));
+        if (iterations == 0) iterations = 1;
+    }
+    return iterations;
+}
+
+/**
+ * @brief Times iterations of func after a short warm up, and prints the mean time per iteration.
+ *
+ * The iteration count can be scaled with the FEATURE_BROKER_BENCH_SCALE environment variable, for example to keep
+ * runs short on CI.
+ *
+ * @return The mean nanoseconds per iteration.
+ */
+template <typename TFunc>
+double Run(std::string const& name, std::size_t iterations, TFunc&& func) {
+    iterations = Scaled(iterations);
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i) func();
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) func();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+    std::printf("%-48s %12.1f ns/op  (%zu iterations)\n", name.c_str(), ns, iterations);
+    return ns;
+}
+
+}  // namespace inference_bench
@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// The cost of binding and resolving inputs of one root broker from many threads at once, as servers that bind inputs
+// and fork per request on a shared root do.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <inference/feature_broker.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "pass_through_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+constexpr std::size_t Names = 16384;
+constexpr std::size_t Models = 256;
+
+// Runs func(thread, i) for i from 0 to perThread on each of the threads, started together, and prints the mean time
+// per call over all threads. With no contention this falls in proportion to the threads, up to the cores there are.
+template <typename TFunc>
+void RunThreads(std::string const& name, std::size_t threadCount, std::size_t perThread, TFunc&& func) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (std::size_t i = 0; i < perThread; ++i) func(t, i);
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) thread.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    auto calls = threadCount * perThread;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(calls);
+    std::printf("%-48s %12.1f ns/op  (%zu calls)\n", (name + ", " + std::to_string(threadCount) + " threads").c_str(),
+                ns, calls);
+}
+}  // namespace
+
+int main() {
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < Names; ++i) names.push_back("I" + std::to_string(i));
+    std::vector<std::shared_ptr<const Model>> models;
+    for (std::size_t i = 0; i < Models; ++i)
+        models.push_back(std::make_shared<inference_test::PassThroughModel<float>>(names[i], "X"));
+
+    auto forks = inference_bench::Scaled(100000);
+    for (std::size_t threads : {1, 2, 4, 8}) {
+        auto fb = std::make_shared<FeatureBroker>();
+        auto perThread = Names / threads;
+        RunThreads("BindInput", threads, perThread,
+                   [&](std::size_t t, std::size_t i) { fb->BindInput<float>(names[t * perThread + i]).value(); });
+
+        // Each fork checks its model's input against the root, and its output resolves that input there.
+        auto forkAndBind = [&](std::size_t t, std::size_t i) {
+            auto fork = fb->Fork(models[(t * 31 + i) % Models]).value();
+            fork->BindOutput<float>("X").value();
+        };
+        RunThreads("Fork and BindOutput", threads, std::max<std::size_t>(1, forks / threads), forkAndBind);
+        fb->Freeze();
+        RunThreads("Fork and BindOutput, frozen", threads, std::max<std::size_t>(1, forks / threads), forkAndBind);
+    }
+    return 0;
+}
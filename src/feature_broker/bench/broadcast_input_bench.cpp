@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// The cost of feeding an input of a parent broker that the output pipes of many forks observe, for an ordinary input
+// against a broadcast input.
+
+#include <algorithm>
+#include <inference/feature_broker.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "add_five_model.hpp"
+#include "bench.hpp"
+
+using namespace ::inference;
+
+namespace {
+template <typename TBind>
+void RunFeed(std::string const& name, std::size_t observers, TBind&& bind) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto input = bind(*fb);
+
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    for (std::size_t i = 0; i < observers; ++i) outputs.push_back(fb->Fork().value()->BindOutput<float>("X").value());
+
+    // Feeding either kind of input costs in proportion to its observers, so fewer iterations are needed with more.
+    auto iterations = std::max<std::size_t>(1000, 2000000 / observers);
+    float step = 0;
+    inference_bench::Run(name + " feed, " + std::to_string(observers) + " observers", iterations, [&]() {
+        input->Feed(step);
+        step += 1;
+    });
+}
+}  // namespace
+
+int main() {
+    for (std::size_t observers : {1, 100, 10000}) {
+        RunFeed("BindInput", observers, [](FeatureBroker& fb) { return fb.BindInput<float>("A").value(); });
+        RunFeed("BindBroadcastInput", observers,
+                [](FeatureBroker& fb) { return fb.BindBroadcastInput<float>("A").value(); });
+    }
+    return 0;
+}
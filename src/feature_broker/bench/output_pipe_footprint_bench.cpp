@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Memory held by, and heap allocations made for, each fork of a broker with one output pipe bound in it. This is the
+// shape of a process serving many concurrent decisions, each with its own fork off a shared parent.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <inference/feature_broker.hpp>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "add_model.hpp"
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+std::atomic<std::size_t> liveAllocations{0};
+std::atomic<std::size_t> liveBytes{0};
+
+// Each allocation is preceded by the block it was made in and its size, so that the bytes still live can be tracked.
+// The block has room to align what follows those, for types that ask for more than the usual alignment.
+void* CountedAllocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) {
+    constexpr std::size_t Header = 2 * sizeof(std::uintptr_t);
+    auto block = static_cast<char*>(std::malloc(size + Header + alignment));
+    if (!block) throw std::bad_alloc();
+    auto address = (reinterpret_cast<std::uintptr_t>(block) + Header + alignment - 1) / alignment * alignment;
+    auto header = reinterpret_cast<std::uintptr_t*>(address) - 2;
+    header[0] = reinterpret_cast<std::uintptr_t>(block);
+    header[1] = size;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    liveAllocations.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_add(size, std::memory_order_relaxed);
+    return reinterpret_cast<void*>(address);
+}
+
+void CountedFree(void* pointer) {
+    if (!pointer) return;
+    auto header = static_cast<std::uintptr_t*>(pointer) - 2;
+    liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+    liveBytes.fetch_sub(header[1], std::memory_order_relaxed);
+    std::free(reinterpret_cast<void*>(header[0]));
+}
+
+struct Counts {
+    std::size_t Allocations;
+    std::size_t LiveAllocations;
+    std::size_t LiveBytes;
+    static Counts Now() { return {allocations.load(), liveAllocations.load(), liveBytes.load()}; }
+};
+
+// Reports the allocations made in all, and the allocations and bytes still held after.
+void Report(char const* name, Counts const& before, Counts const& after, std::size_t count) {
+    auto perOp = [count](std::size_t before, std::size_t after) {
+        return static_cast<double>(after) / count - static_cast<double>(before) / count;
+    };
+    std::printf("%-32s %8.1f allocs/op %8.1f held allocs/op %10.1f held bytes/op\n", name,
+                perOp(before.Allocations, after.Allocations), perOp(before.LiveAllocations, after.LiveAllocations),
+                perOp(before.LiveBytes, after.LiveBytes));
+}
+}  // namespace
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+void operator delete(void* pointer) noexcept { CountedFree(pointer); }
+void operator delete[](void* pointer) noexcept { CountedFree(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { CountedFree(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { CountedFree(pointer); }
+// Types aligned past the usual, such as those padded to a cache line, come through these instead.
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* pointer, std::align_val_t) noexcept { CountedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { CountedFree(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { CountedFree(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { CountedFree(pointer); }
+
+using namespace ::inference;
+
+int main() {
+    constexpr std::size_t Forks = 10000;
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto parent = std::make_shared<FeatureBroker>(model);
+    auto shared = parent->BindInput<float>("A").value();
+
+    std::vector<std::shared_ptr<FeatureBroker>> forks;
+    std::vector<std::shared_ptr<DirectInputPipe<float>>> inputs;
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    forks.reserve(Forks);
+    inputs.reserve(Forks);
+    outputs.reserve(Forks);
+
+    auto start = Counts::Now();
+    for (std::size_t i = 0; i < Forks; ++i) forks.push_back(parent->Fork().value());
+    auto forked = Counts::Now();
+    for (auto& fork : forks) inputs.push_back(fork->BindInput<float>("B").value());
+    auto inputsBound = Counts::Now();
+    for (auto& fork : forks) outputs.push_back(fork->BindOutput<float>("X").value());
+    auto outputsBound = Counts::Now();
+
+    Report("fork", start, forked, Forks);
+    Report("bind input", forked, inputsBound, Forks);
+    Report("bind output", inputsBound, outputsBound, Forks);
+    Report("total per fork", start, outputsBound, Forks);
+    return 0;
+}
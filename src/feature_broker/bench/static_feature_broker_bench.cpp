@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Compares a feed and update round trip through SynchronousFeatureBroker against StaticFeatureBroker, for the same
+// model.
+
+#include <inference/static_feature_broker.hpp>
+#include <inference/synchronous_feature_broker.hpp>
+#include <cstdio>
+#include <memory>
+
+#include "add_model.hpp"
+#include "bench.hpp"
+
+using namespace ::inference;
+
+namespace {
+struct A : StaticField<float> {
+    static constexpr const char* Name = "A";
+};
+struct B : StaticField<float> {
+    static constexpr const char* Name = "B";
+};
+struct X : StaticField<float> {
+    static constexpr const char* Name = "X";
+};
+struct AddSchema {
+    using Inputs = StaticFields<A, B>;
+    using Outputs = StaticFields<X>;
+};
+
+constexpr std::size_t Iterations = 2000000;
+volatile float sink;
+}  // namespace
+
+int main() {
+    auto model = std::make_shared<inference_test::AddModel>();
+
+    SynchronousFeatureBroker fb(model);
+    auto inputA = fb.BindInput<float>("A").value();
+    auto inputB = fb.BindInput<float>("B").value();
+    auto output = fb.BindOutput<float>("X").value();
+
+    float step = 0;
+    double dynamicNs = inference_bench::Run("SynchronousFeatureBroker feed+update", Iterations, [&]() {
+        inputA->Feed(step);
+        inputB->Feed(1);
+        float value;
+        if (output->UpdateIfChanged(value).value()) sink = value;
+        step += 1;
+    });
+
+    auto broker = StaticFeatureBroker<AddSchema>::Create(model).value();
+    step = 0;
+    double staticNs = inference_bench::Run("StaticFeatureBroker feed+update", Iterations, [&]() {
+        broker->Feed<A>(step);
+        broker->Feed<B>(1);
+        if (broker->UpdateIfChanged().value()) sink = broker->Value<X>();
+        step += 1;
+    });
+
+    std::printf("speedup: %.2fx\n", dynamicNs / staticNs);
+    return 0;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Per-call overhead of SynchronousFeatureBroker on a trivial model, against FeatureBroker for reference.
+
+#include <inference/feature_broker.hpp>
+#include <inference/synchronous_feature_broker.hpp>
+#include <memory>
+
+#include "add_five_model.hpp"
+#include "bench.hpp"
+
+using namespace ::inference;
+
+namespace {
+constexpr std::size_t Iterations = 5000000;
+volatile float sink;
+
+template <typename TBroker>
+void RunBroker(std::string const& name) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<TBroker>(model);
+    auto input = fb->template BindInput<float>("A").value();
+    auto output = fb->template BindOutput<float>("X").value();
+
+    float step = 0;
+    inference_bench::Run(name + " feed+update", Iterations, [&]() {
+        input->Feed(step);
+        float value;
+        if (output->UpdateIfChanged(value).value()) sink = value;
+        step += 1;
+    });
+
+    // The cost of polling an output whose inputs have not changed.
+    inference_bench::Run(name + " unchanged poll", Iterations, [&]() {
+        float value;
+        if (output->UpdateIfChanged(value).value()) sink = value;
+    });
+}
+}  // namespace
+
+int main() {
+    RunBroker<SynchronousFeatureBroker>("SynchronousFeatureBroker");
+    RunBroker<FeatureBroker>("FeatureBroker");
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <inference/feature_provider.hpp>
+#include <inference/input_pipe.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+namespace inference {
+namespace detail {
+
+// The inputs bound on a broker by name, whether to pipes or to the outputs of providers. The table of a root broker is
+// split into shards by the hash of the name, each with its own lock, so that threads binding and looking up different
+// names seldom contend, where a single lock would have every bind wait on every other. Forks are many, small, and
+// mostly bound from one thread, so theirs is a single shard kept inline, which the sharded table would dwarf.
+class BindingTable final {
+   public:
+    static constexpr std::size_t ShardCount = 16;
+
+    explicit BindingTable(bool sharded) : _shards(sharded ? new PaddedShard[ShardCount] : nullptr) {}
+
+    std::shared_ptr<InputPipe> FindInput(std::string const &name) const {
+        auto const &shard = ShardFor(name);
+        auto lock = LockShared(shard);
+        auto found = shard.Inputs.find(name);
+        if (found != shard.Inputs.end()) return found->second;
+        return {};
+    }
+
+    std::shared_ptr<FeatureProvider> FindProvider(std::string const &name) const {
+        auto const &shard = ShardFor(name);
+        auto lock = LockShared(shard);
+        auto found = shard.Providers.find(name);
+        if (found != shard.Providers.end()) return found->second;
+        return {};
+    }
+
+    // Adds the pipe, unless something is already bound to the name.
+    bool AddInput(std::string const &name, std::shared_ptr<InputPipe> pipe) {
+        auto &shard = ShardFor(name);
+        std::unique_lock<std::shared_mutex> lock(shard.Mutex);
+        if (shard.Providers.count(name)) return false;
+        return shard.Inputs.emplace(name, std::move(pipe)).second;
+    }
+
+    // Adds the provider under each of its outputs, unless something is already bound to any of them, in which case
+    // nothing is added.
+    bool AddProvider(std::shared_ptr<FeatureProvider> const &provider) {
+        // The shards the outputs fall in are locked in the order of their index, so that two of these cannot deadlock.
+        std::array<bool, ShardCount> involved{};
+        for (auto const &pair : provider->Outputs()) involved[ShardIndex(pair.first)] = true;
+        std::array<std::unique_lock<std::shared_mutex>, ShardCount> locks;
+        for (std::size_t i = 0; i < ShardCount; ++i) {
+            if (involved[i]) locks[i] = std::unique_lock<std::shared_mutex>(ShardAt(i).Mutex);
+        }
+        for (auto const &pair : provider->Outputs()) {
+            auto const &shard = ShardFor(pair.first);
+            if (shard.Inputs.count(pair.first) || shard.Providers.count(pair.first)) return false;
+        }
+        for (auto const &pair : provider->Outputs()) ShardFor(pair.first).Providers.emplace(pair.first, provider);
+        return true;
+    }
+
+    // Calls visitInput with the name and pipe of each input bound to a pipe, and visitProvider with the name and
+    // provider of each bound to a provider. Shards are visited one at a time, so this is not a snapshot of the whole
+    // table should inputs be bound meanwhile.
+    template <typename FInput, typename FProvider>
+    void ForEach(FInput &&visitInput, FProvider &&visitProvider) const {
+        for (std::size_t i = 0; i < (_shards ? ShardCount : 1); ++i) {
+            auto const &shard = ShardAt(i);
+            auto lock = LockShared(shard);
+            for (auto const &pair : shard.Inputs) visitInput(pair.first, pair.second);
+            for (auto const &pair : shard.Providers) visitProvider(pair.first, pair.second);
+        }
+    }
+
+    // Makes the table read only, so that reading it takes no locks. Nothing may be added once this is called, nor while
+    // it is being called.
+    void Freeze() noexcept { _frozen.store(true, std::memory_order_release); }
+
+   private:
+    struct Shard {
+        mutable std::shared_mutex Mutex;
+        std::map<std::string, std::shared_ptr<InputPipe>> Inputs;
+        std::map<std::string, std::shared_ptr<FeatureProvider>> Providers;
+    };
+    // Each on its own cache line, so that threads working in different shards do not contend on the locks' memory.
+    struct alignas(64) PaddedShard {
+        Shard Value;
+    };
+
+    std::size_t ShardIndex(std::string const &name) const {
+        return _shards ? std::hash<std::string>()(name) % ShardCount : 0;
+    }
+    Shard &ShardAt(std::size_t index) { return _shards ? _shards[index].Value : _single; }
+    Shard const &ShardAt(std::size_t index) const { return _shards ? _shards[index].Value : _single; }
+    Shard &ShardFor(std::string const &name) { return ShardAt(ShardIndex(name)); }
+    Shard const &ShardFor(std::string const &name) const { return ShardAt(ShardIndex(name)); }
+
+    std::shared_lock<std::shared_mutex> LockShared(Shard const &shard) const {
+        if (_frozen.load(std::memory_order_acquire)) return {};
+        return std::shared_lock<std::shared_mutex>(shard.Mutex);
+    }
+
+    // Null for a fork, which uses the single shard instead.
+    const std::unique_ptr<PaddedShard[]> _shards;
+    Shard _single;
+    std::atomic<bool> _frozen{false};
+};
+
+}  // namespace detail
+}  // namespace inference
@@ -0,0 +1,87 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace inference {
+namespace detail {
+
+// Dmitry Vyukov's bounded multi-producer multi-consumer queue. Each cell carries a sequence number that tells
+// producers and consumers whose turn it is to use it, so that neither ever takes a lock, and a producer or consumer
+// contends only on the one index it advances.
+template <typename T>
+class BoundedQueue final {
+   public:
+    // The capacity is rounded up to a power of two, of at least two.
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        _mask = size - 1;
+        _cells.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; ++i) _cells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    std::size_t Capacity() const noexcept { return _mask + 1; }
+
+    // Leaves the item as it was if the queue is full.
+    bool TryPush(T&& item) {
+        Cell* cell;
+        auto position = _enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &_cells[position & _mask];
+            auto sequence = cell->Sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                return false;  // Full.
+            } else {
+                position = _enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        cell->Item = std::move(item);
+        cell->Sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& item) {
+        Cell* cell;
+        auto position = _dequeue.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &_cells[position & _mask];
+            auto sequence = cell->Sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+            if (difference == 0) {
+                if (_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                return false;  // Empty.
+            } else {
+                position = _dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->Item);
+        cell->Sequence.store(position + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+   private:
+    struct Cell {
+        std::atomic<std::size_t> Sequence;
+        T Item;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    std::size_t _mask;
+    // Kept on separate cache lines, since producers only touch the one and consumers the other.
+    alignas(64) std::atomic<std::size_t> _enqueue{0};
+    alignas(64) std::atomic<std::size_t> _dequeue{0};
+};
+
+}  // namespace detail
+}  // namespace inference
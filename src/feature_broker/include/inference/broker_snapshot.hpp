@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <inference/feature_broker.hpp>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <string>
+#include "feature_broker_export.h"
+
+namespace inference {
+namespace detail {
+class MappedFile;
+}
+
+/**
+ * @brief A snapshot of the values held by a broker, saved to a file so that a process can restart with the state its
+ * long-lived inputs had, rather than waiting for all of that state to be fed to it again.
+ *
+ * The snapshot holds the last value fed to each input bound on the broker itself, and the current values of the
+ * outputs of the providers bound on it; what the broker inherits from its ancestors is left out, so this is mostly of
+ * use with root brokers. The snapshot file is memory mapped when restored, and the data of numeric tensors is laid out
+ * in it aligned, so that restored tensors refer to the mapping itself rather than to copies. The mapping stays open for
+ * as long as any such tensor refers to it. Writes to a restored tensor are private to the process, and never reach
+ * the file.
+ */
+class BrokerSnapshot final {
+   public:
+    /**
+     * @brief Saves the values of the broker to a snapshot at the path. The snapshot is written beside it and renamed
+     * over it once complete, so that a snapshot already at the path is only ever replaced by a whole one.
+     *
+     * Inputs that have never been fed are left out, as are stream inputs, which hold a queue of events rather than a
+     * value, and provider outputs that the provider did not publish when asked. Providers are asked for their outputs
+     * through updaters created for the purpose, in the same way that binding an output asks them, and those updaters
+     * are run on the calling thread.
+     *
+     * @return The number of values saved, or an error from a provider or from writing the file.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::size_t> Save(FeatureBroker const &broker, std::string const &path);
+
+    /**
+     * @return The snapshot, or the system error that prevented opening it, or illegal_byte_sequence if the file is not
+     * a snapshot of a version this understands.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<BrokerSnapshot>> Open(std::string const &path);
+
+    FEATURE_BROKER_EXPORT ~BrokerSnapshot();
+
+    /**
+     * @brief Feeds the values of the snapshot into the broker, so that outputs bound afterward start from them. This is
+     * meant to be called on startup, before live updates resume.
+     *
+     * A value is fed to the input bound on the broker under its name if there is one, so inputs can be bound first and
+     * fed through the same pipes once restored. If no input is bound under the name one is bound, as by
+     * FeatureBroker::BindInput, and fed. This includes the values that were provider outputs when saved, unless a
+     * provider is bound under the name again, in which case the live provider is left to supply the value.
+     *
+     * @return The number of values fed, or an error. It is an error for an input already bound under a name to have a
+     * different type than the value saved, or to be a stream input (type_mismatch), and binding inputs may fail as it
+     * would otherwise. Values
+     * fed before the error was met stay fed.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<std::size_t> Restore(FeatureBroker &broker) const;
+
+   private:
+    // The typed handling of the values of each of the supported types, defined in the implementation.
+    template <typename T>
+    class Entry;
+
+    explicit BrokerSnapshot(std::shared_ptr<detail::MappedFile> file);
+
+    // Have a private deleted cctor to avoid copying.
+    BrokerSnapshot(const BrokerSnapshot &other) = delete;
+
+    const std::shared_ptr<detail::MappedFile> _file;
+};
+
+}  // namespace inference
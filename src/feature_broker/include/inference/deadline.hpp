@@ -0,0 +1,41 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include "feature_broker_export.h"
+
+namespace inference {
+
+/**
+ * @brief The time by which an update must complete, after which the caller would rather have the last value than
+ * wait for a fresh one.
+ */
+using Deadline = std::chrono::steady_clock::time_point;
+
+// The deadline of updates that have none.
+constexpr Deadline NoDeadline = Deadline::max();
+
+/**
+ * @brief The deadline of the update running on this thread, as set by the output pipe updating it. Providers and
+ * models that can give up early, or stop waiting for something, read it while they run. It is NoDeadline outside of any
+ * update with a deadline.
+ */
+FEATURE_BROKER_EXPORT Deadline CurrentDeadline() noexcept;
+
+namespace detail {
+// Sets the deadline of the thread for as long as it lives, and then restores the one there was before.
+class DeadlineScope final {
+   public:
+    FEATURE_BROKER_EXPORT explicit DeadlineScope(Deadline deadline) noexcept;
+    FEATURE_BROKER_EXPORT ~DeadlineScope();
+
+   private:
+    DeadlineScope(const DeadlineScope &other) = delete;
+
+    const Deadline _previous;
+};
+}  // namespace detail
+
+}  // namespace inference
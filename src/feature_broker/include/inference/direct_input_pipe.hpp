@@ -3,9 +3,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <inference/input_pipe.hpp>
+#include <inference/value_equality.hpp>
 #include <inference/value_updater.hpp>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <system_error>
@@ -18,6 +21,9 @@ class IHandle;
 template <typename T>
 class Handle;
 class OutputWaiter;
+class FeedRecorder;
+class BrokerSnapshot;
+class SharedMemoryPublisher;
 
 template <typename T>
 class DirectInputPipe : public InputPipe {
@@ -28,6 +34,19 @@ class DirectInputPipe : public InputPipe {
 
     virtual void Feed(T) = 0;
 
+    /**
+     * @brief Has feeding a value equal to the last one fed leave the input unchanged, so that producers that publish
+     * the same value over and over do not have the models downstream run again each time. Values are compared with
+     * their equality operator, and tensors by their dimensions and a hash of their content. Values of types that cannot
+     * be compared are always taken to have changed. This is off unless turned on.
+     */
+    virtual void SuppressUnchanged(bool suppress = true) noexcept {
+        _suppressUnchanged.store(suppress, std::memory_order_relaxed);
+    }
+
+    // The number of values fed that were ignored for being the same as the last.
+    virtual std::uint64_t Suppressed() const noexcept { return _suppressed.load(std::memory_order_relaxed); }
+
    private:
     DirectInputPipe() = default;
 
@@ -35,12 +54,37 @@ class DirectInputPipe : public InputPipe {
     friend class SynchronousFeatureBroker;  // For the DirectInputPipe<T>::SyncSingleConsumer derived class.
     friend class FeatureBrokerBase;         // For CreateHandleAndUpdater.
     friend class TypeDescriptor;            // For the DirectInputPipe<T>::SyncSingleConsumer instantiation.
+    template <class TSchema>
+    friend class StaticFeatureBroker;    // For its output sinks, which write straight into its handles.
+    friend class FeedRecorder;           // For the DirectInputPipe<T>::Recorded derived class.
+    friend class BrokerSnapshot;         // For LastFed.
+    friend class SharedMemoryPublisher;  // For the DirectInputPipe<T>::Published derived class.
+
+    // The value last fed to this pipe, for those pipes that keep it. Returns false if there is none.
+    virtual bool LastFed(T &) { return false; }
 
     // These are nested private subclasses of DirectInputPipe<T>, declared here and defined below.
     class Async;
+    class Broadcast;
     class SyncSingleConsumer;
+    // These are defined in feed_recorder.hpp and shared_memory.hpp respectively, since only those create them.
+    class Recorded;
+    class Published;
+
+    bool SuppressingUnchanged() const noexcept { return _suppressUnchanged.load(std::memory_order_relaxed); }
+
+    // Whether the value should be ignored for being the same as the last one, which is null if there is none. Callers
+    // hold whatever lock guards the last value.
+    bool SkipUnchanged(T const *last, T const &value) {
+        if (!SuppressingUnchanged() || !_changeFilter.Repeats(last, value)) return false;
+        _suppressed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
     bool _setOnce = false;
+    std::atomic<bool> _suppressUnchanged{false};
+    std::atomic<std::uint64_t> _suppressed{0};
+    detail::ChangeFilter<T> _changeFilter;
 };
 
 template <typename T>
@@ -52,10 +96,11 @@ class DirectInputPipe<T>::Async final : public DirectInputPipe<T> {
     void Feed(T value) override;
 
    private:
+    bool LastFed(T &value) override;
+
     class Updater : public ValueUpdater {
        public:
-        Updater(std::shared_ptr<DirectInputPipe<T>::Async> parent, std::shared_ptr<Handle<T>> handle,
-                std::shared_ptr<OutputWaiter> waiter);
+        Updater(std::shared_ptr<DirectInputPipe<T>::Async> parent, std::shared_ptr<OutputWaiter> waiter);
 
         virtual ~Updater();
 
@@ -65,8 +110,11 @@ class DirectInputPipe<T>::Async final : public DirectInputPipe<T> {
         std::error_code UpdateOutput() override;
 
        private:
+        friend class Async;
+
         std::shared_ptr<DirectInputPipe<T>::Async> _parent;
-        std::shared_ptr<Handle<T>> _handle;
+        // The handle this updates lives in the same allocation, and is handed out through an aliasing pointer.
+        Handle<T> _handle;
         bool _changed;
         std::shared_ptr<OutputWaiter> _waiter;
     };
@@ -76,7 +124,61 @@ class DirectInputPipe<T>::Async final : public DirectInputPipe<T> {
 
     T _value;
     std::mutex _changeMutex;
-    std::list<std::weak_ptr<Updater>> _outputs;
+    // As with broadcast inputs, the updaters of output pipes since gone are swept out as they are come across, and
+    // whenever the list would otherwise have to grow.
+    std::vector<std::weak_ptr<Updater>> _outputs;
+};
+
+// An input meant to be observed by very many output pipes, typically across many forks, where feeding it must not copy
+// the value once per pipe. Each value fed is published as a shared immutable value along with a version number, and
+// the pipes observing it compare the version against the last they saw, copying the value only when they update. Those
+// output pipes that can be waited upon are kept in a list of watchers, and a value fed still pings each of them, so
+// feeding costs in proportion to the watching output pipes just as with an ordinary input; what is saved is the copy
+// of the value into each of them.
+template <typename T>
+class DirectInputPipe<T>::Broadcast final : public DirectInputPipe<T> {
+   public:
+    Broadcast() = default;
+    virtual ~Broadcast() = default;
+
+    void Feed(T value) override;
+
+   private:
+    bool LastFed(T &value) override;
+
+    class Updater : public ValueUpdater {
+       public:
+        Updater(std::shared_ptr<const DirectInputPipe<T>::Broadcast> parent, std::shared_ptr<OutputWaiter> waiter);
+
+        bool Changed() override;
+        std::error_code UpdateOutput() override;
+
+       private:
+        friend class Broadcast;
+
+        // The first ping readies the output, and those after wake it. Which comes first is decided here, since a
+        // value may be fed just as the updater is created, and both then ping.
+        void Ping() { _waiter->Ping(_pinged.exchange(true)); }
+
+        const std::shared_ptr<const DirectInputPipe<T>::Broadcast> _parent;
+        Handle<T> _handle;
+        std::uint64_t _seen{0};
+        const std::shared_ptr<OutputWaiter> _waiter;
+        std::atomic<bool> _pinged{false};
+    };
+
+    std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
+        std::shared_ptr<OutputWaiter> waiter) override;
+
+    // The version is what observers poll, without taking the lock. The lock is held to exchange the value and its
+    // version as a pair, and by observers only to take a reference to the value, never while copying it out.
+    std::atomic<std::uint64_t> _version{0};
+    mutable std::mutex _valueMutex;
+    std::shared_ptr<T> _value;
+    // The updaters of output pipes with waiters. Those of output pipes since gone are swept out as they are come
+    // across, and whenever the list would otherwise have to grow.
+    std::mutex _watchersMutex;
+    std::vector<std::weak_ptr<Updater>> _watchers;
 };
 
 template <typename T>
@@ -87,23 +189,27 @@ class DirectInputPipe<T>::SyncSingleConsumer final : public DirectInputPipe<T> {
     void Feed(T value) override;
 
    private:
+    bool LastFed(T &value) override;
+
     std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
         std::shared_ptr<InputPipe::OutputWaiter> waiter) override;
 
     class Updater : public ValueUpdater {
        public:
-        explicit Updater(std::shared_ptr<Handle<T>> handle);
+        explicit Updater(Handle<T> const &handle);
         virtual ~Updater();
 
         bool Changed() override;
         std::error_code UpdateOutput() override;
 
        private:
-        std::shared_ptr<Handle<T>> _handle;
+        Handle<T> const &_handle;
     };
 
-    std::shared_ptr<Handle<T>> _handle;
-    std::shared_ptr<Updater> _updater;
+    // Both are part of the pipe itself, so that the pipe, its handle and its updater take one allocation between them.
+    // They are handed out through aliasing pointers that keep the pipe alive.
+    Handle<T> _handle;
+    Updater _updater;
 };
 
 }  // namespace inference
@@ -114,19 +220,26 @@ class DirectInputPipe<T>::SyncSingleConsumer final : public DirectInputPipe<T> {
 
 namespace inference {
 template <typename T>
-DirectInputPipe<T>::SyncSingleConsumer::SyncSingleConsumer()
-    : _handle(std::make_shared<Handle<T>>()), _updater(std::make_shared<Updater>(_handle)) {}
+DirectInputPipe<T>::SyncSingleConsumer::SyncSingleConsumer() : _updater(_handle) {}
 
 template <typename T>
 DirectInputPipe<T>::SyncSingleConsumer::~SyncSingleConsumer() = default;
 
 template <typename T>
 void DirectInputPipe<T>::SyncSingleConsumer::Feed(T value) {
-    _handle->MutableValue() = value;
-    _handle->Changed(true);
+    if (SkipUnchanged(_setOnce ? &_handle._value : nullptr, value)) return;
+    _handle.MutableValue() = value;
+    _handle.Changed(true);
     _setOnce = true;
 }
 
+template <typename T>
+bool DirectInputPipe<T>::SyncSingleConsumer::LastFed(T &value) {
+    if (!_setOnce) return false;
+    value = _handle._value;
+    return true;
+}
+
 template <typename T>
 std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>
 DirectInputPipe<T>::SyncSingleConsumer::CreateHandleAndUpdater(std::shared_ptr<InputPipe::OutputWaiter> waiter) {
@@ -136,19 +249,22 @@ DirectInputPipe<T>::SyncSingleConsumer::CreateHandleAndUpdater(std::shared_ptr<I
         // once and ignore it from then on.
         waiter->Ping(false);
     }
-    _handle->Changed(_setOnce);
-    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(_handle, _updater);
+    _handle.Changed(_setOnce);
+    auto self = shared_from_this();
+    std::shared_ptr<IHandle> handle(self, &_handle);
+    std::shared_ptr<ValueUpdater> updater(self, &_updater);
+    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(std::move(handle), std::move(updater));
 }
 
 template <typename T>
-DirectInputPipe<T>::SyncSingleConsumer::Updater::Updater(std::shared_ptr<Handle<T>> handle) : _handle(handle) {}
+DirectInputPipe<T>::SyncSingleConsumer::Updater::Updater(Handle<T> const &handle) : _handle(handle) {}
 
 template <typename T>
 DirectInputPipe<T>::SyncSingleConsumer::Updater::~Updater() = default;
 
 template <typename T>
 bool DirectInputPipe<T>::SyncSingleConsumer::Updater::Changed() {
-    return _handle->Changed();
+    return _handle.Changed();
 }
 
 template <typename T>
@@ -165,25 +281,34 @@ DirectInputPipe<T>::Async::~Async() = default;
 template <typename T>
 void DirectInputPipe<T>::Async::Feed(T value) {
     std::unique_lock<std::mutex> lock(_changeMutex);
+    if (SkipUnchanged(_setOnce ? &_value : nullptr, value)) return;
     _value = value;
     bool subsequentSet = _setOnce;
     _setOnce = true;
 
-    for (auto iter = _outputs.begin(); iter != _outputs.end();) {
-        if (auto out = iter->lock()) {
+    for (std::size_t i = 0; i < _outputs.size();) {
+        if (auto out = _outputs[i].lock()) {
             out->MarkChanged(subsequentSet);
-            iter++;
+            ++i;
         } else {
-            iter = _outputs.erase(iter);
+            _outputs[i] = std::move(_outputs.back());
+            _outputs.pop_back();
         }
     }
 }
 
+template <typename T>
+bool DirectInputPipe<T>::Async::LastFed(T &value) {
+    std::lock_guard<std::mutex> lock(_changeMutex);
+    if (!_setOnce) return false;
+    value = _value;
+    return true;
+}
+
 template <typename T>
 DirectInputPipe<T>::Async::Updater::Updater(std::shared_ptr<DirectInputPipe<T>::Async> parent,
-                                            std::shared_ptr<Handle<T>> handle,
                                             std::shared_ptr<InputPipe::OutputWaiter> waiter)
-    : _parent(std::move(parent)), _handle(handle), _changed(_parent->_setOnce), _waiter(std::move(waiter)) {
+    : _parent(std::move(parent)), _changed(_parent->_setOnce), _waiter(std::move(waiter)) {
     if (_changed) _waiter->Ping(false);
 }
 
@@ -206,8 +331,8 @@ std::error_code DirectInputPipe<T>::Async::Updater::UpdateOutput() {
     if (!_changed) return err_feature_ok();
 
     std::lock_guard<std::mutex> lock(_parent->_changeMutex);
-    _handle->MutableValue() = _parent->_value;
-    _handle->Changed(true);
+    _handle.MutableValue() = _parent->_value;
+    _handle.Changed(true);
     _changed = false;
     return err_feature_ok();
 }
@@ -215,12 +340,107 @@ std::error_code DirectInputPipe<T>::Async::Updater::UpdateOutput() {
 template <typename T>
 std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> DirectInputPipe<T>::Async::CreateHandleAndUpdater(
     std::shared_ptr<InputPipe::OutputWaiter> waiter) {
-    auto handle = std::make_shared<Handle<T>>();
     auto thisPtr = std::static_pointer_cast<DirectInputPipe<T>::Async>(shared_from_this());
-    auto updater = std::make_shared<Updater>(thisPtr, handle, std::move(waiter));
+    auto updater = detail::AllocateShared<Updater>(_resource, thisPtr, std::move(waiter));
+    std::shared_ptr<IHandle> handle(updater, &updater->_handle);
     std::lock_guard<std::mutex> lock(_changeMutex);
+    if (_outputs.size() == _outputs.capacity()) {
+        _outputs.erase(std::remove_if(_outputs.begin(), _outputs.end(),
+                                      [](std::weak_ptr<Updater> const &output) { return output.expired(); }),
+                       _outputs.end());
+    }
     _outputs.push_back(updater);
-    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(handle, updater);
+    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(std::move(handle), std::move(updater));
+}
+
+template <typename T>
+void DirectInputPipe<T>::Broadcast::Feed(T value) {
+    std::shared_ptr<T> published;
+    {
+        std::lock_guard<std::mutex> lock(_valueMutex);
+        // Checked under the same lock the value is published under, so that what the filter last saw is always the
+        // value last published, however many threads feed.
+        if (SkipUnchanged(_value.get(), value)) return;
+        // Every other reference to the value is taken under this lock, so if there is none now, no output pipe is
+        // copying it out and it can be replaced where it stands, sparing an allocation per feed.
+        if (_value && _value.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            *_value = std::move(value);
+        } else {
+            published = detail::AllocateShared<T>(_resource, std::move(value));
+            _value.swap(published);
+        }
+        _version.fetch_add(1, std::memory_order_release);
+    }
+    std::lock_guard<std::mutex> lock(_watchersMutex);
+    for (std::size_t i = 0; i < _watchers.size();) {
+        if (auto watcher = _watchers[i].lock()) {
+            watcher->Ping();
+            ++i;
+        } else {
+            _watchers[i] = std::move(_watchers.back());
+            _watchers.pop_back();
+        }
+    }
+    // A previous value still held elsewhere is released on leaving here, once the locks are no longer held.
+}
+
+template <typename T>
+bool DirectInputPipe<T>::Broadcast::LastFed(T &value) {
+    std::shared_ptr<const T> published;
+    {
+        std::lock_guard<std::mutex> lock(_valueMutex);
+        published = _value;
+    }
+    if (!published) return false;
+    value = *published;
+    return true;
+}
+
+template <typename T>
+DirectInputPipe<T>::Broadcast::Updater::Updater(std::shared_ptr<const DirectInputPipe<T>::Broadcast> parent,
+                                                std::shared_ptr<InputPipe::OutputWaiter> waiter)
+    : _parent(std::move(parent)), _waiter(std::move(waiter)) {}
+
+template <typename T>
+bool DirectInputPipe<T>::Broadcast::Updater::Changed() {
+    return _parent->_version.load(std::memory_order_acquire) != _seen;
+}
+
+template <typename T>
+std::error_code DirectInputPipe<T>::Broadcast::Updater::UpdateOutput() {
+    std::shared_ptr<const T> value;
+    {
+        std::lock_guard<std::mutex> lock(_parent->_valueMutex);
+        if (_parent->_version.load(std::memory_order_relaxed) == _seen) return err_feature_ok();
+        value = _parent->_value;
+        _seen = _parent->_version.load(std::memory_order_relaxed);
+    }
+    _handle.MutableValue() = *value;
+    _handle.Changed(true);
+    return err_feature_ok();
+}
+
+template <typename T>
+std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>
+DirectInputPipe<T>::Broadcast::CreateHandleAndUpdater(std::shared_ptr<InputPipe::OutputWaiter> waiter) {
+    auto thisPtr = std::static_pointer_cast<const DirectInputPipe<T>::Broadcast>(shared_from_this());
+    auto updater = detail::AllocateShared<Updater>(_resource, std::move(thisPtr), std::move(waiter));
+    if (updater->_waiter) {
+        {
+            std::lock_guard<std::mutex> lock(_watchersMutex);
+            if (_watchers.size() == _watchers.capacity()) {
+                _watchers.erase(std::remove_if(_watchers.begin(), _watchers.end(),
+                                               [](std::weak_ptr<Updater> const &watcher) { return watcher.expired(); }),
+                                _watchers.end());
+            }
+            _watchers.push_back(updater);
+        }
+        // Should the pipe already have a value, the output is ready now, as it otherwise is on the first value fed.
+        if (_version.load(std::memory_order_acquire) != 0) updater->Ping();
+    }
+    std::shared_ptr<IHandle> handle(updater, &updater->_handle);
+    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(std::move(handle), std::move(updater));
 }
 
 template <typename T>
@@ -9,7 +9,11 @@
 #include <inference/input_pipe.hpp>
 #include <inference/model.hpp>
 #include <inference/output_pipe_with_input.hpp>
+#include <inference/stream_input_pipe.hpp>
+#include <inference/tensor.hpp>
 #include <memory>
+#include <memory_resource>
+#include <shared_mutex>
 #include <string>
 #include <system_error>
 #include "feature_broker_export.h"
@@ -18,7 +22,14 @@
 namespace inference {
 class FeatureBroker : public std::enable_shared_from_this<FeatureBroker>, FeatureBrokerBase {
    public:
-    FEATURE_BROKER_EXPORT explicit FeatureBroker(std::shared_ptr<const Model> model = nullptr);
+    /**
+     * @param resource What the pipes bound on this broker, and the output pipes bound through it, are allocated from.
+     * It must outlive the broker, its forks, and every pipe bound through them, and be thread safe if those are used
+     * from more than one thread.
+     */
+    FEATURE_BROKER_EXPORT explicit FeatureBroker(
+        std::shared_ptr<const Model> model = nullptr,
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource());
     FEATURE_BROKER_EXPORT virtual ~FeatureBroker();
 
     template <typename T>
@@ -26,12 +37,84 @@ class FeatureBroker : public std::enable_shared_from_this<FeatureBroker>, Featur
         return BindCore<DirectInputPipe<T>, typename DirectInputPipe<T>::Async, T>(name);
     }
 
+    /**
+     * @brief Binds an input meant to be observed by output pipes in very many forks of this broker, such as some piece
+     * of global context. A value fed is shared by all the output pipes that observe it rather than copied to each, and
+     * each pipe only copies it out when it updates. Consumers waiting on those output pipes are woken as with
+     * BindInput, so feeding still costs in proportion to the output pipes observing it.
+     */
+    template <typename T>
+    rt::expected<std::shared_ptr<DirectInputPipe<T>>> BindBroadcastInput(std::string const &name) {
+        return BindCore<DirectInputPipe<T>, typename DirectInputPipe<T>::Broadcast, T>(name);
+    }
+
+    /**
+     * @brief Binds an input that queues every event fed to it, which models see as a Tensor<T> of the events fed since
+     * they last ran.
+     *
+     * @param capacity The most events queued between two updates. This is rounded up to a power of two.
+     * @param policy What feeding does when the queue is full.
+     */
+    template <typename T>
+    rt::expected<std::shared_ptr<StreamInputPipe<T>>> BindStreamInput(std::string const &name,
+                                                                       std::size_t capacity = 1024,
+                                                                       StreamPolicy policy = StreamPolicy::DropOldest) {
+        auto typeExpected = TypeDescriptor::CreateExpected<Tensor<T>>();
+        if (!typeExpected) return tl::make_unexpected(typeExpected.error());
+        // The constructor is private, so make_shared cannot be used.
+        auto input = std::shared_ptr<StreamInputPipe<T>>(new StreamInputPipe<T>(capacity, policy, _resource));
+        auto expected = FeatureBrokerBase::BindCore(name, input);
+        if (!expected) return tl::make_unexpected(expected.error());
+        return input;
+    }
+
+    /**
+     * @param resource What the fork, and what it binds, are allocated from, or null for the resource of this broker.
+     * Pipes bound on ancestors allocate from their own resources whatever the fork's, so a resource meant only for
+     * the lifetime of a request, such as a std::pmr::monotonic_buffer_resource, is fine for a fork that binds outputs
+     * and is released with them, as long as it is only used from one thread.
+     */
     FEATURE_BROKER_EXPORT rt::expected<std::shared_ptr<FeatureBroker>> Fork(
-        std::shared_ptr<const Model> model = nullptr) const;
+        std::shared_ptr<const Model> model = nullptr, std::pmr::memory_resource *resource = nullptr) const;
     FEATURE_BROKER_EXPORT rt::expected<void> SetParent(std::shared_ptr<const FeatureBroker> newParent);
 
+    /**
+     * @brief Replaces the model of this broker while it is in use.
+     *
+     * Output pipes already bound to the old model, through this broker or any fork of it that has no model of its own,
+     * move over to the new model on their next update. Until the new model's updater signals it is ready through its
+     * out-of-band notifier, those pipes continue to be served by the old model, and any inference in flight completes
+     * on it. Once the new model is adopted the next update reruns it over the current inputs, even if those have not
+     * changed. No lock is taken on the update path to support this.
+     *
+     * The new model must be a drop-in replacement for the old: it must have every output of the old model with the
+     * same type (name_not_found or type_mismatch otherwise), any of its inputs that are bound or were inputs of the old
+     * model must have the same type (type_mismatch), and the requirements of each of the old model's outputs must be a
+     * subset of what they were (not_bound), since pipes already bound have handles for only those.
+     *
+     * @param model The new model.
+     * @return Nothing, or an error. It is an error to pass a null model (invalid_model), or to call this on a broker
+     * that does not have a model of its own (no_model_associated).
+     */
+    FEATURE_BROKER_EXPORT rt::expected<void> SwapModel(std::shared_ptr<const Model> model);
+
+    /**
+     * @brief Makes the inputs bound on this broker, its parent and its model permanent, for brokers that are set up
+     * once and then only forked and bound to. Lookups on this broker, including those of forks resolving their inputs
+     * through it, then take no lock at all, and so do not contend across threads. Lookups pass on to the parent as
+     * before, so to be lock free all the way through, freeze the ancestors too. Output pipes bound against a frozen
+     * broker's model likewise read the model and its binding plans without locking.
+     *
+     * Binding inputs on the broker, SetParent and SwapModel fail with frozen from then on. Forking and binding outputs
+     * are unaffected. There is no unfreezing.
+     */
+    FEATURE_BROKER_EXPORT void Freeze();
+    bool Frozen() const noexcept { return _frozen.load(std::memory_order_acquire); }
+
     using FeatureBrokerBase::BindInputs;
 
+    std::pmr::memory_resource *MemoryResource() const noexcept { return _resource; }
+
     using InputsType = FeatureBrokerBase::InputsType;
 
     template <typename T>
@@ -46,10 +129,13 @@ class FeatureBroker : public std::enable_shared_from_this<FeatureBroker>, Featur
     }
 
    private:
+    friend class BrokerSnapshot;  // For reading and restoring the inputs bound on it.
+
     FEATURE_BROKER_EXPORT FeatureBroker(std::shared_ptr<const FeatureBroker> parent,
-                                        std::shared_ptr<const Model> model);
+                                        std::shared_ptr<const Model> model, std::pmr::memory_resource *resource);
 
     FEATURE_BROKER_EXPORT std::shared_ptr<const Model> GetModelOrNull(bool lock = true) const final override;
+    FEATURE_BROKER_EXPORT std::shared_ptr<ModelSlot> GetModelSlot(bool lock = true) const final override;
     FEATURE_BROKER_EXPORT std::shared_ptr<InputPipe> GetBindingOrNull(std::string const &name,
                                                                       bool lock = true) const final override;
     FEATURE_BROKER_EXPORT std::shared_ptr<FeatureProvider> GetProviderOrNull(std::string const &name,
@@ -59,5 +145,8 @@ class FeatureBroker : public std::enable_shared_from_this<FeatureBroker>, Featur
     FeatureBroker(const FeatureBroker &other) = delete;
 
     std::shared_ptr<const FeatureBroker> _parent;
+    // Held exclusively by SetParent on this broker, and shared by SetParent on any broker this is to be an ancestor of,
+    // so that the ancestry is not changed underneath it. Lookups take the input lock to read the parent instead.
+    mutable std::shared_mutex _parentMutex;
 };
 }  // namespace inference
@@ -4,6 +4,11 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <inference/binding_table.hpp>
+#include <inference/deadline.hpp>
 #include <inference/direct_input_pipe.hpp>
 #include <inference/feature_error.hpp>
 #include <inference/feature_provider.hpp>
@@ -12,11 +17,15 @@
 #include <inference/model.hpp>
 #include <inference/output_pipe.hpp>
 #include <inference/output_pipe_with_input.hpp>
+#include <inference/priority_scheduler.hpp>
 #include <inference/type_descriptor.hpp>
 #include <inference/value_updater.hpp>
 #include <initializer_list>
+#include <future>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <new>
 #include <rt/rt_expected.hpp>
 #include <shared_mutex>
 #include <string>
@@ -40,7 +49,25 @@ class FeatureBrokerBase {
 
     friend class FeatureBroker;
     friend class SynchronousFeatureBroker;
-    FEATURE_BROKER_EXPORT explicit FeatureBrokerBase(std::shared_ptr<const Model> model);
+    friend class BrokerSnapshot;
+    FEATURE_BROKER_EXPORT FeatureBrokerBase(std::shared_ptr<const Model> model, std::pmr::memory_resource *resource);
+
+    // A synchronous broker only ever has synchronous single consumer pipes and providers bound to it, and its outputs
+    // are never waited upon. Its output pipes can therefore skip the output waiter, and read the input handles of its
+    // pipes directly rather than through their (trivial) value updaters.
+    FEATURE_BROKER_EXPORT FeatureBrokerBase(std::shared_ptr<const Model> model, bool synchronous);
+
+    // Binding plans are compiled descriptions of what a set of model outputs requires, and how those requirements were
+    // last resolved. The cache of these plans is shared between a broker and the brokers forked from it, so that
+    // binding the same outputs over and over across forks does not redo the same work each time.
+    class BindingPlan;
+    class BindingPlanCache;
+    FeatureBrokerBase(std::shared_ptr<const Model> model, std::shared_ptr<BindingPlanCache> planCache,
+                      std::pmr::memory_resource *resource);
+    class ModelSlot;
+    rt::expected<std::shared_ptr<BindingPlan>> GetBindingPlan(ModelSlot &slot,
+                                                              std::shared_ptr<const Model> const &model,
+                                                              std::vector<std::string> const &outputNames);
 
     template <typename TPipe, typename TPipeImplementation, typename TData>
     rt::expected<std::shared_ptr<TPipe>> BindCore(std::string const &name);
@@ -50,6 +77,16 @@ class FeatureBrokerBase {
     FEATURE_BROKER_EXPORT rt::expected<void> BindInputs(std::shared_ptr<FeatureProvider> provider);
 
     virtual std::shared_ptr<const Model> GetModelOrNull(bool lock = true) const;
+
+    // The model slot holds the model of a broker that output pipes bound through it actually run, and a generation
+    // counter bumped whenever that model is swapped. Pipes poll the generation to notice a swap, so that the model can
+    // be replaced underneath them without any lock on the update path. Only brokers with a model of their own have one,
+    // since forks without one are many, and use the slot of the ancestor whose model they use.
+    virtual std::shared_ptr<ModelSlot> GetModelSlot(bool lock = true) const;
+    // Makes this broker's model the new current model of its slot. The input lock should be held exclusively.
+    FEATURE_BROKER_EXPORT void PublishModel();
+    // Marks this broker's model slot frozen, if it has one. The input lock should be held exclusively.
+    FEATURE_BROKER_EXPORT void FreezeModel();
     FEATURE_BROKER_EXPORT const rt::expected<TypeDescriptor> GetBindingType(std::string const &name,
                                                                             bool lock = true) const;
     virtual std::shared_ptr<InputPipe> GetBindingOrNull(std::string const &name, bool lock = true) const;
@@ -64,26 +101,123 @@ class FeatureBrokerBase {
         FEATURE_BROKER_EXPORT bool ChangedImpl() const;
 
        protected:
-        std::vector<std::shared_ptr<IHandle>> _handlesForOutputs;
+        // Atomic so that a pipe can be reprioritized from other threads than the one updating it.
+        std::atomic<PriorityClass> _priority{PriorityClass::Normal};
+
+        // A single block from the broker's resource, reserved once the counts are known. The updaters and handles of
+        // the pipe are laid out in it in order, so that binding an output allocates once for both rather than once
+        // each.
+        class Block {
+           public:
+            Block() = default;
+            Block(const Block &) = delete;
+            Block &operator=(const Block &) = delete;
+            FEATURE_BROKER_EXPORT ~Block();
+            FEATURE_BROKER_EXPORT void Reserve(std::pmr::memory_resource *upstream, std::size_t size);
+            // The next piece of the block, which must have been reserved with room for it.
+            FEATURE_BROKER_EXPORT void *Take(std::size_t bytes, std::size_t alignment);
+
+           private:
+            std::pmr::memory_resource *_upstream{nullptr};
+            char *_data{nullptr};
+            // Narrow, since the block only ever holds a few pointers per input, and there is one per output pipe.
+            std::uint32_t _size{0};
+            std::uint32_t _used{0};
+        };
+
+        // A run of elements in the block, sized exactly when the pipe binds and never grown, so that unlike a vector it
+        // keeps neither a capacity nor an allocator.
+        template <typename TElement>
+        class BlockArray {
+           public:
+            BlockArray() = default;
+            BlockArray(const BlockArray &) = delete;
+            BlockArray &operator=(const BlockArray &) = delete;
+            ~BlockArray() {
+                std::for_each(begin(), end(), [](TElement &element) { element.~TElement(); });
+            }
+
+            void Reserve(Block &block, std::size_t count) {
+                _data = static_cast<TElement *>(block.Take(count * sizeof(TElement), alignof(TElement)));
+            }
+            void push_back(TElement element) { new (_data + _size++) TElement(std::move(element)); }
+
+            std::size_t size() const { return _size; }
+            TElement *data() const { return _data; }
+            TElement *begin() const { return _data; }
+            TElement *end() const { return _data + _size; }
+            TElement &operator[](std::size_t index) const { return _data[index]; }
+
+           private:
+            TElement *_data{nullptr};
+            std::uint32_t _size{0};
+        };
+
+        // Declared ahead of the arrays laid out in it, so that it outlives them.
+        Block _block;
         InputsType _inputToHandle;
 
-        FEATURE_BROKER_EXPORT bool UpdateIfChangedPrePeek();
+        // The handles of the outputs, which are owned through the output pipes they belong to, in _outputToPipe.
+        IHandle *const *OutputHandles() const { return _handles.data() + _inputHandleCount; }
+
+        FEATURE_BROKER_EXPORT rt::expected<bool> UpdateIfChangedPrePeek();
         FEATURE_BROKER_EXPORT rt::expected<bool> UpdateIfChangedInference();
         FEATURE_BROKER_EXPORT void UpdateIfChangedPostPoke();
         FEATURE_BROKER_EXPORT rt::expected<void> WaitUntilChangedImpl();
+        FEATURE_BROKER_EXPORT rt::expected<bool> WaitUntilChangedImpl(Deadline deadline);
+        // Whether the pipe has ever had a value, which an update that runs out of time can fall back on.
+        bool FetchedOnce() const { return _firstOutputFetched; }
+        FEATURE_BROKER_EXPORT rt::expected<void> NotifyWhenChangedImpl(std::function<void()> callback);
 
        private:
+        bool InputUpdaterChanged(std::size_t index) const;
+        bool SwapPending() const;
+        void AdoptSwappedModel();
+
         bool _firstOutputFetched{false};
-        std::vector<std::shared_ptr<IHandle>> _handlesForInputs;
-        std::vector<std::shared_ptr<ValueUpdater>> _updatersForInputs;
+        // Whether every input has been brought in or started at least once. Until then an update waits for all of them
+        // to have something. An update that did bring them in may still have failed or run out of time, but what it
+        // brought in stays in the handles. So from then on, any input in flight or changed is reason to try again.
+        bool _inputsFetched{false};
+        // Readiness never reverts once reached, so once observed it is remembered rather than queried each time.
+        mutable bool _ready{false};
+        bool _synchronous{false};
+        bool _forceInference{false};
+        // The handles of pipe inputs come first, then those of provider inputs, then those of the outputs. Those of the
+        // inputs are owned through _inputToHandle.
+        BlockArray<IHandle *> _handles;
+        std::uint32_t _inputHandleCount{0};
+        std::uint32_t _pipeInputCount{0};
+        // An updater of inputs, along with its asynchronous view or null, and any update of it still in flight. These
+        // are kept together in the one vector rather than in parallel vectors, to spare allocations per output pipe.
+        struct InputUpdater {
+            std::shared_ptr<ValueUpdater> Updater;
+            AsyncValueUpdater *Async;
+            std::future<std::error_code> Pending;
+        };
+        // In synchronous mode the updaters of the pipe inputs are not kept, and these are only those of the providers.
+        BlockArray<InputUpdater> _updatersForInputs;
 
         std::shared_ptr<ValueUpdater> _spEngineForOutput;
 
-        // We need these to update the _handlesForOutputs, since we are using the async capable DirectInputPipe for this
-        // purpose. Once we switch to another input pipe that does not have async support (since even in async scenarios
-        // this is not necessary for this purpose), we do not need to keep this around any longer.
-        std::vector<std::shared_ptr<ValueUpdater>> _updatersForOutputs;
+        // The slot of the model the engine above came from, and its generation at the time. When the slot moves on, a
+        // replacement engine is created over the same handles and pipes, but the current engine keeps serving until the
+        // replacement signals it is ready. Once adopted, the next update is forced to rerun the model.
+        std::shared_ptr<ModelSlot> _modelSlot;
+        std::uint64_t _modelGeneration{0};
+        std::map<std::string, std::shared_ptr<InputPipe>> _outputToPipe;
+        // A replacement engine, and whether it has signalled it is ready. Only there while a swap is under way, so that
+        // pipes are no larger for it the rest of the time.
+        struct PendingSwap {
+            std::shared_ptr<ValueUpdater> Engine;
+            std::shared_ptr<std::atomic<bool>> Ready;
+        };
+        std::unique_ptr<PendingSwap> _swap;
+
+        // Exactly one of these is set: the waiter in the usual case, and the count of outstanding first notifications
+        // from the providers and the model in the synchronous case.
         std::shared_ptr<InputPipe::OutputWaiter> _waiter;
+        std::shared_ptr<std::atomic<std::size_t>> _pendingNotifications;
     };
 
     template <typename T>
@@ -94,12 +228,31 @@ class FeatureBrokerBase {
 
         bool Changed() override;
         rt::expected<bool> UpdateIfChanged(T &value) override;
+        rt::expected<UpdateStatus> UpdateIfChanged(T &value, Deadline deadline) override;
         rt::expected<void> WaitUntilChanged() override;
+        rt::expected<bool> WaitUntilChanged(Deadline deadline) override;
+        rt::expected<void> NotifyWhenChanged(std::function<void()> callback) override;
         const InputsType &Inputs() override { return _inputToHandle; }
+        void SetPriority(PriorityClass priority) override { _priority.store(priority, std::memory_order_relaxed); }
+        PriorityClass Priority() const override { return _priority.load(std::memory_order_relaxed); }
+        void SuppressUnchanged(bool suppress, double tolerance) override;
+        std::uint64_t Suppressed() const override { return _suppression ? _suppression->Suppressed : 0; }
 
        protected:
         virtual void Peek(T &value) = 0;
         virtual void Poke(T &value) const = 0;
+
+       private:
+        // Only pipes that suppress unchanged outputs have this, so that the others are no larger for it.
+        struct Suppression {
+            bool Enabled{true};
+            double Tolerance{0};
+            std::uint64_t Suppressed{0};
+            // The outputs are poked into this first, so that the caller's value is untouched if they are the same.
+            T Fresh{};
+            detail::OutputFilter<T> Filter;
+        };
+        std::unique_ptr<Suppression> _suppression;
     };
 
     template <typename T>
@@ -138,8 +291,8 @@ class FeatureBrokerBase {
                                           std::vector<std::string> const &outputNames) const {
                 return err_feature_ok();
             }
-            void Peek(std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value) {}
-            void Poke(std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value) const {}
+            void Peek(IHandle *const *handles, std::tuple<T...> &value) {}
+            void Poke(IHandle *const *handles, std::tuple<T...> &value) const {}
         };
 
         // Recursive case.
@@ -147,8 +300,8 @@ class FeatureBrokerBase {
         struct Unpacker<K, THead, TRest...> : Unpacker<K + 1, TRest...> {
             std::error_code BindTypeCheck(FeatureBrokerBase &featureBroker,
                                           std::vector<std::string> const &outputNames) const;
-            void Peek(std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value);
-            void Poke(std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value) const;
+            void Peek(IHandle *const *handles, std::tuple<T...> &value);
+            void Poke(IHandle *const *handles, std::tuple<T...> &value) const;
         };
 
         Unpacker<0, T...> _unpacker;
@@ -174,10 +327,25 @@ class FeatureBrokerBase {
         return CheckModelOutput(name, TypeDescriptor::CreateExpected<T>());
     }
 
+    // Takes the input lock shared if asked to, unless the broker is frozen, when nothing the lock guards can change.
+    std::shared_lock<std::shared_mutex> LockForLookup(bool lock) const {
+        if (!lock || _frozen.load(std::memory_order_acquire)) return {};
+        return std::shared_lock<std::shared_mutex>(_inputMutex);
+    }
+
+    // Guards the model and the parent. Binds hold it shared, so that they wait only on changes to those and not on one
+    // another, and the binding table has locks of its own.
     mutable std::shared_mutex _inputMutex;
-    std::map<std::string, std::shared_ptr<InputPipe>> _boundInputs;
-    std::map<std::string, std::shared_ptr<FeatureProvider>> _boundInputsFromProviders;
+    detail::BindingTable _bindings;
+    // Set once, with the input lock held exclusively, after which the bindings, model and parent never change.
+    std::atomic<bool> _frozen{false};
     std::shared_ptr<const Model> _model;
+    const std::shared_ptr<ModelSlot> _modelSlot;
+    const std::shared_ptr<BindingPlanCache> _planCache;
+    const bool _synchronous{false};
+    // What the pipes bound on this broker and the output pipes bound through it are allocated from, along with what
+    // those allocate in turn. The binding plans are left out, since their cache is shared with ancestors and forks.
+    std::pmr::memory_resource *const _resource{std::pmr::get_default_resource()};
 };
 
 template <typename T>
@@ -185,7 +353,7 @@ rt::expected<std::shared_ptr<OutputPipeWithInput<T, FeatureBrokerBase::InputsTyp
     std::string const &name) {
     std::error_code error = CheckModelOutput<T>(name);
     if (error) return tl::make_unexpected(error);
-    auto brokerOutputPipe = std::make_shared<SingleValueOutputPipe<T>>();
+    auto brokerOutputPipe = detail::AllocateShared<SingleValueOutputPipe<T>>(_resource);
     if ((error = brokerOutputPipe->Bind(*this, name))) return tl::make_unexpected(error);
     return std::static_pointer_cast<OutputPipeWithInput<T, FeatureBrokerBase::InputsType>>(brokerOutputPipe);
 }
@@ -196,7 +364,7 @@ FeatureBrokerBase::_BindOutputs(const std::initializer_list<std::string> names)
     if (names.size() != std::tuple_size<std::tuple<T...>>())
         return make_feature_unexpected(feature_errc::invalid_operation);
 
-    auto brokerOutputPipe = std::make_shared<TupleOutputPipe<T...>>();
+    auto brokerOutputPipe = detail::AllocateShared<TupleOutputPipe<T...>>(_resource);
     std::vector<std::string> namesVec = names;
     if (auto error = brokerOutputPipe->Bind(*this, namesVec)) return tl::make_unexpected(error);
     return std::static_pointer_cast<OutputPipeWithInput<std::tuple<T...>, FeatureBrokerBase::InputsType>>(
@@ -208,7 +376,8 @@ rt::expected<std::shared_ptr<TPipe>> FeatureBrokerBase::BindCore(std::string con
     std::error_code error;
     auto requestedTypeExpected = TypeDescriptor::CreateExpected<TData>();
     if (!requestedTypeExpected) return tl::make_unexpected(requestedTypeExpected.error());
-    auto input = std::make_shared<TPipeImplementation>();
+    auto input = detail::AllocateShared<TPipeImplementation>(_resource);
+    input->_resource = _resource;
     auto expected = BindCore(name, input);
     if (!expected) return tl::make_unexpected(expected.error());
     return std::static_pointer_cast<TPipe>(input);
@@ -221,20 +390,71 @@ bool FeatureBrokerBase::BrokerOutputPipe<T>::Changed() {
 
 template <typename T>
 rt::expected<bool> FeatureBrokerBase::BrokerOutputPipe<T>::UpdateIfChanged(T &value) {
-    if (!BrokerOutputPipeGeneral::UpdateIfChangedPrePeek()) return false;
+    auto preExpected = BrokerOutputPipeGeneral::UpdateIfChangedPrePeek();
+    if (!(preExpected && preExpected.value())) return preExpected;
     Peek(value);
     auto inferenceExpected = BrokerOutputPipeGeneral::UpdateIfChangedInference();
     if (!(inferenceExpected && inferenceExpected.value())) return inferenceExpected;
+    if (_suppression && _suppression->Enabled) {
+        Poke(_suppression->Fresh);
+        BrokerOutputPipeGeneral::UpdateIfChangedPostPoke();
+        if (_suppression->Filter.Same(_suppression->Fresh, _suppression->Tolerance)) {
+            ++_suppression->Suppressed;
+            return false;
+        }
+        _suppression->Filter.Record(_suppression->Fresh);
+        using std::swap;
+        swap(value, _suppression->Fresh);
+        return true;
+    }
     Poke(value);
     BrokerOutputPipeGeneral::UpdateIfChangedPostPoke();
     return true;
 }
 
+template <typename T>
+void FeatureBrokerBase::BrokerOutputPipe<T>::SuppressUnchanged(bool suppress, double tolerance) {
+    if (!suppress) {
+        if (_suppression) _suppression->Enabled = false;
+        return;
+    }
+    if (!_suppression) _suppression = std::make_unique<Suppression>();
+    // What was last reported while this was off is not known, so the next outputs are reported whatever they are.
+    if (!_suppression->Enabled) _suppression->Filter = detail::OutputFilter<T>();
+    _suppression->Enabled = true;
+    _suppression->Tolerance = tolerance;
+}
+
+template <typename T>
+rt::expected<UpdateStatus> FeatureBrokerBase::BrokerOutputPipe<T>::UpdateIfChanged(T &value, Deadline deadline) {
+    rt::expected<bool> updated;
+    {
+        // Whatever waits along the way, here or in the providers and model, reads the deadline from the thread.
+        detail::DeadlineScope scope(deadline);
+        updated = UpdateIfChanged(value);
+    }
+    if (updated) return *updated ? UpdateStatus::Updated : UpdateStatus::Unchanged;
+    if (updated.error() != make_feature_error(feature_errc::deadline_exceeded) ||
+        !BrokerOutputPipeGeneral::FetchedOnce())
+        return tl::make_unexpected(updated.error());
+    return UpdateStatus::Stale;
+}
+
 template <typename T>
 rt::expected<void> FeatureBrokerBase::BrokerOutputPipe<T>::WaitUntilChanged() {
     return BrokerOutputPipeGeneral::WaitUntilChangedImpl();
 }
 
+template <typename T>
+rt::expected<bool> FeatureBrokerBase::BrokerOutputPipe<T>::WaitUntilChanged(Deadline deadline) {
+    return BrokerOutputPipeGeneral::WaitUntilChangedImpl(deadline);
+}
+
+template <typename T>
+rt::expected<void> FeatureBrokerBase::BrokerOutputPipe<T>::NotifyWhenChanged(std::function<void()> callback) {
+    return BrokerOutputPipeGeneral::NotifyWhenChangedImpl(std::move(callback));
+}
+
 // SINGLE
 
 template <typename T>
@@ -246,16 +466,14 @@ std::error_code FeatureBrokerBase::SingleValueOutputPipe<T>::Bind(FeatureBrokerB
 
 template <typename T>
 void FeatureBrokerBase::SingleValueOutputPipe<T>::Peek(T &value) {
-    auto untypedHandle = FeatureBrokerBase::BrokerOutputPipeGeneral::_handlesForOutputs[0];
-    auto handle = std::static_pointer_cast<Handle<T>>(untypedHandle);
+    auto handle = static_cast<Handle<T> *>(FeatureBrokerBase::BrokerOutputPipeGeneral::OutputHandles()[0]);
     handle->MutableValue() = value;
 }
 
 template <typename T>
 void FeatureBrokerBase::SingleValueOutputPipe<T>::Poke(T &value) const {
-    std::vector<std::shared_ptr<IHandle>>::const_iterator iter = FeatureBrokerBase::BrokerOutputPipeGeneral::_handlesForOutputs.cbegin();
-    auto handle = std::static_pointer_cast<const Handle<T>>(*iter);
-    value = handle->Value();
+    auto handle = static_cast<const Handle<T> *>(FeatureBrokerBase::BrokerOutputPipeGeneral::OutputHandles()[0]);
+    value = handle->_value;
 }
 
 // TUPLE
@@ -271,12 +489,12 @@ std::error_code FeatureBrokerBase::TupleOutputPipe<T...>::Bind(FeatureBrokerBase
 
 template <class... T>
 void FeatureBrokerBase::TupleOutputPipe<T...>::Peek(std::tuple<T...> &value) {
-    _unpacker.Peek(FeatureBrokerBase::BrokerOutputPipe<std::tuple<T...>>::_handlesForOutputs, value);
+    _unpacker.Peek(FeatureBrokerBase::BrokerOutputPipe<std::tuple<T...>>::OutputHandles(), value);
 }
 
 template <class... T>
 void FeatureBrokerBase::TupleOutputPipe<T...>::Poke(std::tuple<T...> &value) const {
-    _unpacker.Poke(FeatureBrokerBase::BrokerOutputPipe<std::tuple<T...>>::_handlesForOutputs, value);
+    _unpacker.Poke(FeatureBrokerBase::BrokerOutputPipe<std::tuple<T...>>::OutputHandles(), value);
 }
 
 template <class... T>
@@ -291,8 +509,8 @@ std::error_code FeatureBrokerBase::TupleOutputPipe<T...>::Unpacker<K, THead, TRe
 template <class... T>
 template <size_t K, class THead, class... TRest>
 void FeatureBrokerBase::TupleOutputPipe<T...>::Unpacker<K, THead, TRest...>::Peek(
-    std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value) {
-    auto handle = std::static_pointer_cast<Handle<THead>>(handles.at(K));
+    IHandle *const *handles, std::tuple<T...> &value) {
+    auto handle = static_cast<Handle<THead> *>(handles[K]);
     handle->MutableValue() = std::get<K>(value);
     Unpacker<K + 1, TRest...>::Peek(handles, value);
 }
@@ -300,9 +518,9 @@ void FeatureBrokerBase::TupleOutputPipe<T...>::Unpacker<K, THead, TRest...>::Pee
 template <class... T>
 template <size_t K, class THead, class... TRest>
 void FeatureBrokerBase::TupleOutputPipe<T...>::Unpacker<K, THead, TRest...>::Poke(
-    std::vector<std::shared_ptr<IHandle>> const &handles, std::tuple<T...> &value) const {
-    auto handle = std::static_pointer_cast<Handle<THead>>(handles.at(K));
-    std::get<K>(value) = handle->Value();
+    IHandle *const *handles, std::tuple<T...> &value) const {
+    auto handle = static_cast<const Handle<THead> *>(handles[K]);
+    std::get<K>(value) = handle->_value;
     Unpacker<K + 1, TRest...>::Poke(handles, value);
 }
 }  // namespace inference
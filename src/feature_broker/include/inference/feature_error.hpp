@@ -24,6 +24,8 @@ enum class feature_errc : int {
     feature_provider_inconsistent,
     circular_structure,
     multiple_waiting,
+    frozen,
+    deadline_exceeded,
 };
 
 FEATURE_BROKER_EXPORT const std::error_category& feature_error_category() noexcept;
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <functional>
 #include <inference/input_pipe.hpp>
 #include <inference/type_descriptor.hpp>
 #include <inference/value_updater.hpp>
@@ -11,6 +12,8 @@
 #include <rt/rt_expected.hpp>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace inference {
 
@@ -32,6 +35,23 @@ class FeatureProvider : public std::enable_shared_from_this<FeatureProvider> {
         std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
         std::function<void()> valuesChangedNotifier) const = 0;
 
+    /**
+     * @brief Create a pull value updater object. Providers with expensive outputs can implement this so that the broker
+     * only asks for outputs that are both needed and stale, rather than everything on every change. When this is
+     * supported the broker uses it in preference to CreateValueUpdater.
+     *
+     * @param outputToPipe The output names and the pipes to which their values should be fed. This will be a subset of
+     * the outputs, and the position of each in this list is how it is identified to the notifier and the updater.
+     * @param staleNotifier The provider should call this with the index of an output whenever that output has
+     * occasion to change. Until it has been called at least once the broker considers those values unavailable.
+     * @return The updater, or a null updater if the provider does not support pulling, which is the default.
+     */
+    virtual rt::expected<std::shared_ptr<PullValueUpdater>> CreatePullValueUpdater(
+        std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> const& /*outputToPipe*/,
+        std::function<void(std::size_t)> /*staleNotifier*/) const {
+        return std::shared_ptr<PullValueUpdater>();
+    }
+
    protected:
     FeatureProvider() = default;
 };
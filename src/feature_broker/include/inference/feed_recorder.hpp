@@ -0,0 +1,187 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_broker.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/value_codec.hpp>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <string>
+#include <utility>
+#include "feature_broker_export.h"
+
+namespace inference {
+namespace detail {
+class MappedFile;
+}
+
+/**
+ * @brief Records the values fed to input pipes into a compact, append-only binary log, so that the stream of inputs a
+ * broker saw can later be replayed into a broker by FeedReplayer, for example to reproduce a problem or to benchmark a
+ * model against real traffic.
+ *
+ * Feeding a recorded pipe encodes the value and hands it to a bounded lock-free queue, and the log is written by a
+ * thread of the recorder's own, so the feeding thread never waits on the file. Should the writer fall so far behind
+ * that the queue is full, the value is still fed to the pipe but is not recorded, and is counted by Dropped instead.
+ */
+class FeedRecorder final : public std::enable_shared_from_this<FeedRecorder> {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t DefaultCapacity = 4096;
+
+    /**
+     * @brief Creates a recorder writing a new log at the path, replacing any file already there.
+     *
+     * @param capacity The number of values that can be queued for the writer, rounded up to a power of two.
+     * @return The recorder, or the system error that prevented creating the file.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<FeedRecorder>> Create(
+        std::string const &path, std::size_t capacity = DefaultCapacity);
+
+    FEATURE_BROKER_EXPORT ~FeedRecorder();
+
+    /**
+     * @brief Wraps an input pipe, so that each value fed to the wrapper is recorded under the name and then fed to the
+     * pipe. Only values fed through the wrapper are recorded.
+     *
+     * @return The wrapper, or an error if the pipe is null (not_bound) or the recorder is closed (invalid_operation).
+     */
+    template <typename T>
+    rt::expected<std::shared_ptr<DirectInputPipe<T>>> Record(std::string const &name,
+                                                             std::shared_ptr<DirectInputPipe<T>> pipe);
+
+    /**
+     * @brief Binds an input on the broker as FeatureBroker::BindInput does, and records it under the same name.
+     */
+    template <typename T>
+    rt::expected<std::shared_ptr<DirectInputPipe<T>>> BindInput(FeatureBroker &broker, std::string const &name) {
+        auto pipeExpected = broker.BindInput<T>(name);
+        if (!pipeExpected) return pipeExpected;
+        return Record<T>(name, std::move(pipeExpected).value());
+    }
+
+    /**
+     * @brief The number of values fed that could not be recorded, because the queue to the writer was full.
+     */
+    FEATURE_BROKER_EXPORT std::uint64_t Dropped() const noexcept;
+
+    /**
+     * @brief Writes out what is queued and closes the log. Values fed after this are no longer recorded, though they
+     * still reach their pipes. The destructor closes the log if this was not called.
+     *
+     * @return Nothing, or the first system error met writing the log.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<void> Close();
+
+   private:
+    // The queue, the writer thread and the file, defined in the implementation.
+    class Log;
+
+    explicit FeedRecorder(std::unique_ptr<Log> log);
+
+    FEATURE_BROKER_EXPORT rt::expected<std::uint32_t> AddStream(std::string const &name, detail::CodecItem item,
+                                                                 detail::CodecContainer container);
+    FEATURE_BROKER_EXPORT void Append(std::uint32_t stream, Clock::time_point time, std::string payload);
+
+    // Have a private deleted cctor to avoid copying.
+    FeedRecorder(const FeedRecorder &other) = delete;
+
+    template <typename T>
+    friend class DirectInputPipe;
+
+    const std::unique_ptr<Log> _log;
+};
+
+enum class ReplaySpeed {
+    // Values are fed with the same spacing in time as they were when recorded.
+    Original,
+    // Values are fed one after the other as fast as possible.
+    Maximum
+};
+
+/**
+ * @brief Replays a log written by FeedRecorder. The log is memory mapped rather than read, so that a log of any length
+ * can be replayed without holding it in memory, and without copying what is replayed more than once.
+ */
+class FeedReplayer final {
+   public:
+    /**
+     * @return The replayer, or the system error that prevented opening the log, or illegal_byte_sequence if the file
+     * is not a log.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<FeedReplayer>> Open(std::string const &path);
+
+    FEATURE_BROKER_EXPORT ~FeedReplayer();
+
+    /**
+     * @brief Binds an input on the broker for each name recorded, with the type it was recorded with, and feeds them
+     * the values recorded in the order they were recorded. A log cut short, as by the recording process dying, is
+     * replayed up to the last value written whole.
+     *
+     * @return The number of values fed, or an error binding the inputs, or illegal_byte_sequence if the log is
+     * corrupt. Values fed before the error was met stay fed.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<std::size_t> Replay(FeatureBroker &broker,
+                                                           ReplaySpeed speed = ReplaySpeed::Maximum) const;
+
+   private:
+    explicit FeedReplayer(std::shared_ptr<detail::MappedFile> file);
+
+    // Have a private deleted cctor to avoid copying.
+    FeedReplayer(const FeedReplayer &other) = delete;
+
+    const std::shared_ptr<detail::MappedFile> _file;
+};
+
+// The pipe handed out by FeedRecorder::Record. It is not bound itself, but should it be asked for handles it hands out
+// those of the pipe it wraps, so that it can stand in for that pipe anywhere.
+template <typename T>
+class DirectInputPipe<T>::Recorded final : public DirectInputPipe<T> {
+   public:
+    Recorded(std::shared_ptr<DirectInputPipe<T>> pipe, std::shared_ptr<FeedRecorder> recorder, std::uint32_t stream)
+        : _pipe(std::move(pipe)), _recorder(std::move(recorder)), _stream(stream) {}
+
+    void Feed(T value) override {
+        auto time = FeedRecorder::Clock::now();
+        std::string payload;
+        detail::ValueCodec<T>::Encode(value, payload);
+        _recorder->Append(_stream, time, std::move(payload));
+        _pipe->Feed(std::move(value));
+    }
+
+    // Every value is recorded, so that replaying the recording feeds the same values. Whether repeats then change the
+    // input is up to the pipe this wraps.
+    void SuppressUnchanged(bool suppress = true) noexcept override { _pipe->SuppressUnchanged(suppress); }
+    std::uint64_t Suppressed() const noexcept override { return _pipe->Suppressed(); }
+
+   private:
+    bool LastFed(T &value) override { return _pipe->LastFed(value); }
+
+    std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
+        std::shared_ptr<InputPipe::OutputWaiter> waiter) override {
+        return static_cast<InputPipe &>(*_pipe).CreateHandleAndUpdater(std::move(waiter));
+    }
+
+    const std::shared_ptr<DirectInputPipe<T>> _pipe;
+    const std::shared_ptr<FeedRecorder> _recorder;
+    const std::uint32_t _stream;
+};
+
+template <typename T>
+rt::expected<std::shared_ptr<DirectInputPipe<T>>> FeedRecorder::Record(std::string const &name,
+                                                                        std::shared_ptr<DirectInputPipe<T>> pipe) {
+    if (!pipe) return make_feature_unexpected(feature_errc::not_bound);
+    auto streamExpected = AddStream(name, detail::ValueCodec<T>::Item, detail::ValueCodec<T>::Container);
+    if (!streamExpected) return tl::make_unexpected(streamExpected.error());
+    auto recorded =
+        std::make_shared<typename DirectInputPipe<T>::Recorded>(std::move(pipe), shared_from_this(), *streamExpected);
+    return std::static_pointer_cast<DirectInputPipe<T>>(recorded);
+}
+
+}  // namespace inference
@@ -20,9 +20,14 @@ class IHandle {
     template <typename T>
     friend class DirectInputPipe;
     template <typename T>
+    friend class StreamInputPipe;
+    template <typename T>
     friend class OutputPipe;  // Output pipe should not be changing handles.
     friend class TypeDescriptor;
     friend class FeatureBrokerBase;
+    friend class ModelGraph;
+    template <class TSchema>
+    friend class StaticFeatureBroker;
 
     IHandle() = default;
     void Changed(bool changed) { _changed = changed; }
@@ -42,9 +47,13 @@ class Handle final : public IHandle {
     template <typename TT>
     friend class DirectInputPipe;
     template <typename TT>
+    friend class StreamInputPipe;
+    template <typename TT>
     friend class OutputPipe;  // Output pipe should not be changing handles.
     friend class TypeDescriptor;
     friend class FeatureBrokerBase;
+    template <class TSchema>
+    friend class StaticFeatureBroker;
 
     T& MutableValue() { return _value; }
 
@@ -0,0 +1,176 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <inference/deadline.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "feature_broker_export.h"
+
+namespace inference {
+
+/**
+ * @brief A pool of worker threads that runs inference for any number of brokers and models, so that however many
+ * models a process has, inference runs on no more threads than the pool has workers.
+ *
+ * Work is submitted through tenants, which might be a model, or all the models of some client. When there is more work
+ * than workers, tenants share the workers in proportion to their weights by weighted fair queueing: each task is tagged
+ * with the virtual time at which its tenant's share would have it start, and the workers take the task with the
+ * earliest tag. A tenant with twice the weight of another has twice the tasks run while both have work queued, and a
+ * tenant that has been idle does not build up credit to crowd out the others when it returns.
+ *
+ * A task runs with the priority class and deadline of the thread that submitted it. Each class has a queue of its own,
+ * and the tenants' shares apply within each. The workers take from the most urgent class with anything queued, so
+ * that interactive work does not wait behind the background work of others. As with PriorityScheduler, so that a
+ * steady stream of urgent work cannot starve the rest, the first task in line of a class that has waited longer than
+ * the starvation limit goes next whatever its class, the longest waiting first.
+ */
+class InferenceExecutor final {
+   public:
+    class Tenant final : public std::enable_shared_from_this<Tenant> {
+       public:
+        std::string const &Name() const { return _name; }
+        FEATURE_BROKER_EXPORT double Weight() const;
+        // Changes the weight of the tenant, for the work it submits from then on. The weight must be positive.
+        FEATURE_BROKER_EXPORT void SetWeight(double weight);
+
+        /**
+         * @brief Queues the task to run on one of the workers.
+         */
+        FEATURE_BROKER_EXPORT void Submit(std::function<void()> task);
+
+        /**
+         * @brief Runs the function on one of the workers, and waits for it to complete. Called from a worker of the
+         * same executor, this runs it right away on the calling thread, since the calling thread is already one of the
+         * workers and waiting on another could leave every worker waiting.
+         */
+        FEATURE_BROKER_EXPORT void Run(std::function<void()> const &func);
+
+        /**
+         * @brief As Run, but for work that has a deadline. Should the deadline pass before the function starts, it is
+         * withdrawn and never runs. Should it pass while the function runs, cancel is called to ask it to stop early,
+         * and this then waits for it to return as usual.
+         *
+         * @return Whether the function ran.
+         */
+        FEATURE_BROKER_EXPORT bool RunUntil(std::function<void()> const &func, Deadline deadline,
+                                            std::function<void()> const &cancel);
+
+        /**
+         * @brief Something that submits tasks to this tenant, suitable as the executor of a model graph or the
+         * scheduler of NextValue. As with Run, tasks submitted from a worker of the same executor run right away.
+         */
+        FEATURE_BROKER_EXPORT std::function<void(std::function<void()>)> AsExecutor();
+
+        // The number of tasks of the tenant that have run.
+        std::uint64_t Completed() const { return _completed.load(std::memory_order_relaxed); }
+
+       private:
+        friend class InferenceExecutor;
+
+        Tenant(InferenceExecutor *executor, std::string name, double weight);
+
+        // Have a private deleted cctor to avoid copying.
+        Tenant(const Tenant &other) = delete;
+
+        InferenceExecutor *const _executor;
+        const std::string _name;
+        // Both are guarded by the mutex of the executor.
+        double _weight;
+        // The virtual time at which the tenant's last queued task would finish.
+        double _finish{0};
+        std::atomic<std::uint64_t> _completed{0};
+    };
+
+    /**
+     * @brief Creates the executor, and starts its workers.
+     *
+     * @param workers The number of worker threads. If 0, there is a worker for each core.
+     * @param starvationLimit How long queued work waits behind more urgent work before it goes first regardless.
+     */
+    FEATURE_BROKER_EXPORT explicit InferenceExecutor(
+        std::size_t workers = 0, std::chrono::nanoseconds starvationLimit = std::chrono::milliseconds(100));
+
+    /**
+     * @brief Runs whatever tasks remain queued, and then stops the workers. Tenants must not submit work once the
+     * executor is being destroyed.
+     */
+    FEATURE_BROKER_EXPORT ~InferenceExecutor();
+
+    /**
+     * @brief Creates a tenant to submit work through. The executor must outlive its tenants.
+     *
+     * @param name A name for the tenant, for monitoring.
+     * @param weight The tenant's share of the workers relative to the other tenants. Must be positive.
+     */
+    FEATURE_BROKER_EXPORT std::shared_ptr<Tenant> CreateTenant(std::string name, double weight = 1);
+
+    std::size_t Workers() const { return _workers.size(); }
+
+    // The number of tasks queued and not yet started, of all tenants.
+    FEATURE_BROKER_EXPORT std::size_t Queued() const;
+
+    /**
+     * @brief The executor shared by the whole process, created on first use. The model libraries run their inference
+     * on it. It is never destroyed, so that models released while the process exits can still use it.
+     */
+    FEATURE_BROKER_EXPORT static InferenceExecutor &Global();
+
+    /**
+     * @brief Sets the number of workers the global executor will have, which by default is one for each core.
+     *
+     * @return invalid_operation if the global executor has already been created, in which case it keeps the workers it
+     * has.
+     */
+    FEATURE_BROKER_EXPORT static std::error_code ConfigureGlobal(std::size_t workers);
+
+   private:
+    struct Task {
+        // The virtual time at which the task would start, and the order it was queued in to break ties.
+        double Start;
+        std::uint64_t Sequence;
+        std::chrono::steady_clock::time_point Since;
+        // Holds the tenant, should it be released with work still queued.
+        std::shared_ptr<Tenant> Owner;
+        std::function<void()> Func;
+
+        bool operator>(Task const &other) const {
+            return Start > other.Start || (Start == other.Start && Sequence > other.Sequence);
+        }
+    };
+
+    void Enqueue(std::shared_ptr<Tenant> tenant, std::function<void()> task);
+    void Work();
+    bool OnWorker() const noexcept;
+
+    // Have a private deleted cctor to avoid copying.
+    InferenceExecutor(const InferenceExecutor &other) = delete;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _available;
+    const std::chrono::nanoseconds _starvationLimit;
+    // A queue for each priority class, with the number of tasks in all of them.
+    std::array<std::priority_queue<Task, std::vector<Task>, std::greater<Task>>, PriorityClassCount> _queues;
+    std::size_t _queued{0};
+    // The start tag of the task most recently started.
+    double _virtualTime{0};
+    std::uint64_t _sequence{0};
+    bool _stopping{false};
+    std::vector<std::thread> _workers;
+};
+
+}  // namespace inference
@@ -4,8 +4,12 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
+#include <inference/deadline.hpp>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <utility>
 #include "feature_broker_export.h"
 
 namespace inference {
@@ -23,7 +27,12 @@ class InputPipe : public std::enable_shared_from_this<InputPipe> {
     friend class FeatureBrokerBase;
     template <typename T>
     friend class DirectInputPipe;
+    template <typename T>
+    friend class StreamInputPipe;
     friend class OutputWaiterSinglePing;
+    friend class ModelGraph;
+    template <class TSchema>
+    friend class StaticFeatureBroker;
 
     InputPipe() = default;
 
@@ -33,6 +42,12 @@ class InputPipe : public std::enable_shared_from_this<InputPipe> {
 
         FEATURE_BROKER_EXPORT void Ping(bool subsequentCall);
         FEATURE_BROKER_EXPORT std::error_code Wait();
+        // As Wait, but returns deadline_exceeded if the deadline passes first.
+        FEATURE_BROKER_EXPORT std::error_code WaitUntil(Deadline deadline);
+        // The non-blocking counterpart of Wait: the callback is called once, on whatever thread makes this ready, or
+        // immediately if it already is. It takes the place of a waiting thread, so the two cannot be mixed. An empty
+        // callback withdraws the one registered, if it has not yet been called.
+        FEATURE_BROKER_EXPORT std::error_code NotifyWhenReady(std::function<void()> callback);
         FEATURE_BROKER_EXPORT bool Cleared();
 
        private:
@@ -41,10 +56,24 @@ class InputPipe : public std::enable_shared_from_this<InputPipe> {
         std::condition_variable _cv;
         bool _ready;
         bool _waiting{false};
+        std::function<void()> _callback;
     };
 
     virtual std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
         std::shared_ptr<OutputWaiter> waiter) = 0;
+
+    // What the pipe allocates its handles, updaters and values from, which is that of the broker that created it. The
+    // updaters of a pipe may be observed by the pipe itself long after the output pipes they serve are gone, so they
+    // come from the pipe's resource rather than from that of the broker the output pipe was bound through.
+    std::pmr::memory_resource *_resource = std::pmr::get_default_resource();
 };
 
+namespace detail {
+// As std::allocate_shared, with the object and its control block allocated together from the resource.
+template <typename T, typename... TArgs>
+std::shared_ptr<T> AllocateShared(std::pmr::memory_resource *resource, TArgs &&... args) {
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource), std::forward<TArgs>(args)...);
+}
+}  // namespace detail
+
 }  // namespace inference
@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <functional>
+#include <inference/handle.hpp>
+#include <inference/input_pipe.hpp>
+#include <inference/model.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "feature_broker_export.h"
+
+namespace inference {
+
+/**
+ * @brief A model composed of other models, where the outputs of some models are the inputs of others.
+ *
+ * The graph is derived from the models' inputs and outputs by name: an input of one model with the same name as an
+ * output of another is fed from that output, and inputs that no model produces are the inputs of the graph as a whole.
+ * All the outputs of all the models are outputs of the graph. Since this is itself a model it can be bound to a feature
+ * broker like any other.
+ *
+ * Values pass between the models through handles directly, without intermediate pipes or waking any consumer. On each
+ * update only the models downstream of a changed input are run, level by level in dependency order, and models on the
+ * same level are independent of each other, so can run in parallel on an executor.
+ */
+class ModelGraph final : public Model {
+   public:
+    /**
+     * @brief Something that runs a task, possibly on another thread. The graph waits for the tasks it submits to
+     * complete before moving on to the next level of the graph.
+     */
+    using Executor = std::function<void(std::function<void()>)>;
+
+    /**
+     * @brief Creates the graph over a set of models.
+     *
+     * @param models The models. No two may have an output of the same name.
+     * @param executor Runs the models of each level. If empty, the models are run one after the other on the thread
+     * doing the update.
+     * @return The graph, or an error if an output is produced by more than one model (already_bound), an input does not
+     * have the type of the output that feeds it (type_mismatch), or the models depend upon each other circularly
+     * (circular_structure).
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<ModelGraph>> Create(
+        std::vector<std::shared_ptr<const Model>> models, Executor executor = nullptr);
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+    FEATURE_BROKER_EXPORT std::vector<std::string> GetRequirements(std::string const& outputName) const override;
+
+    FEATURE_BROKER_EXPORT rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override;
+
+   private:
+    class Updater;
+
+    ModelGraph(std::vector<std::shared_ptr<const Model>> models, Executor executor);
+    std::error_code Build();
+
+    const std::vector<std::shared_ptr<const Model>> _models;
+    const Executor _executor;
+
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+    // Which model produces each output.
+    std::unordered_map<std::string, std::size_t> _producers;
+    // The models grouped into levels, where each model depends only on the models of lower levels.
+    std::vector<std::vector<std::size_t>> _levels;
+};
+
+}  // namespace inference
@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <functional>
+#include <inference/output_pipe_with_input.hpp>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define FEATURE_BROKER_HAS_COROUTINES 1
+#endif
+
+namespace inference {
+
+/**
+ * @brief Something that runs a task later, on whatever thread or event loop consumes an output pipe. It must not run
+ * the task inline, since it is called from the thread that changed an input of the pipe, which may hold locks the task
+ * would need.
+ */
+using Scheduler = std::function<void(std::function<void()>)>;
+
+namespace detail {
+// The state of one wait for the next value of an output pipe. A notification from the pipe only means there may be a
+// new value, so every time one arrives the pipe is updated on the scheduler, and if nothing actually changed the wait
+// is simply registered again.
+template <typename T, class TInputs>
+class NextValueOperation final : public std::enable_shared_from_this<NextValueOperation<T, TInputs>> {
+   public:
+    using Continuation = std::function<void(rt::expected<T>)>;
+
+    NextValueOperation(std::shared_ptr<OutputPipeWithInput<T, TInputs>> pipe, Scheduler scheduler,
+                       Continuation continuation)
+        : _pipe(std::move(pipe)), _scheduler(std::move(scheduler)), _continuation(std::move(continuation)) {}
+
+    // Tries for a value now, and waits for one if there is none yet.
+    void Start() {
+        auto updated = _pipe->UpdateIfChanged(_value);
+        if (!updated) return _continuation(tl::make_unexpected(updated.error()));
+        if (updated.value()) return _continuation(std::move(_value));
+        auto registered = Arm();
+        if (!registered) _continuation(tl::make_unexpected(registered.error()));
+    }
+
+    // Waits for a value without first trying for one. Only if this succeeds will the continuation be called.
+    rt::expected<void> Arm() {
+        auto self = this->shared_from_this();
+        return _pipe->NotifyWhenChanged([self]() { self->_scheduler([self]() { self->Start(); }); });
+    }
+
+   private:
+    const std::shared_ptr<OutputPipeWithInput<T, TInputs>> _pipe;
+    const Scheduler _scheduler;
+    const Continuation _continuation;
+    T _value{};
+};
+}  // namespace detail
+
+/**
+ * @brief Calls the continuation with the next value of the output pipe, without blocking any thread while waiting for
+ * it. If the pipe has a new value already the continuation is called immediately on this thread, otherwise it is
+ * called on the scheduler once the pipe has a new value. Like WaitUntilChanged, only one wait on a pipe may be
+ * outstanding, and the pipe is kept alive until the continuation is called.
+ *
+ * @param pipe The output pipe.
+ * @param scheduler Runs the update of the pipe, and the continuation, once notified of a change.
+ * @param continuation Called exactly once, with the next value or the error that prevented getting it.
+ */
+template <typename T, class TInputs>
+void OnNextValue(std::shared_ptr<OutputPipeWithInput<T, TInputs>> pipe, Scheduler scheduler,
+                 typename detail::NextValueOperation<T, TInputs>::Continuation continuation) {
+    std::make_shared<detail::NextValueOperation<T, TInputs>>(std::move(pipe), std::move(scheduler),
+                                                             std::move(continuation))
+        ->Start();
+}
+
+#ifdef FEATURE_BROKER_HAS_COROUTINES
+/**
+ * @brief The awaitable form of OnNextValue, so that a coroutine can write `auto value = co_await NextValue(pipe,
+ * scheduler);`. The coroutine is suspended while waiting, and resumed on the scheduler, with no thread parked.
+ */
+template <typename T, class TInputs>
+class NextValueAwaitable final {
+   public:
+    NextValueAwaitable(std::shared_ptr<OutputPipeWithInput<T, TInputs>> pipe, Scheduler scheduler)
+        : _pipe(std::move(pipe)), _scheduler(std::move(scheduler)) {}
+
+    bool await_ready() {
+        T value{};
+        auto updated = _pipe->UpdateIfChanged(value);
+        if (updated && !updated.value()) return false;
+        _result = updated ? rt::expected<T>(std::move(value)) : rt::expected<T>(tl::make_unexpected(updated.error()));
+        return true;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto operation = std::make_shared<detail::NextValueOperation<T, TInputs>>(
+            _pipe, _scheduler, [this, handle](rt::expected<T> result) {
+                _result = std::move(result);
+                handle.resume();
+            });
+        auto registered = operation->Arm();
+        if (registered) return true;
+        // Nothing will ever resume the coroutine, so carry on with the error instead.
+        _result = tl::make_unexpected(registered.error());
+        return false;
+    }
+
+    rt::expected<T> await_resume() { return std::move(_result); }
+
+   private:
+    const std::shared_ptr<OutputPipeWithInput<T, TInputs>> _pipe;
+    const Scheduler _scheduler;
+    rt::expected<T> _result;
+};
+
+template <typename T, class TInputs>
+NextValueAwaitable<T, TInputs> NextValue(std::shared_ptr<OutputPipeWithInput<T, TInputs>> pipe, Scheduler scheduler) {
+    return NextValueAwaitable<T, TInputs>(std::move(pipe), std::move(scheduler));
+}
+#endif
+
+}  // namespace inference
@@ -3,16 +3,89 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <inference/deadline.hpp>
+#include <inference/output_pipe.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <rt/rt_expected.hpp>
+
 namespace inference {
 
+/**
+ * @brief What an update with a deadline came to.
+ */
+enum class UpdateStatus : std::uint8_t {
+    // Nothing changed, so the value was left as it was.
+    Unchanged = 0,
+    // The value was updated.
+    Updated = 1,
+    // Something changed, but the deadline passed before the update could complete, so the value was left as it was.
+    // The update is taken up again on the next call.
+    Stale = 2
+};
+
 template <typename T, class TInputs>
 class OutputPipeWithInput : public OutputPipe<T> {
    public:
     OutputPipeWithInput() = default;
     virtual ~OutputPipeWithInput() = default;
 
+    using OutputPipe<T>::UpdateIfChanged;
+
+    /**
+     * @brief As UpdateIfChanged, but for callers with a budget. The update stops waiting on asynchronous providers and
+     * on models that it would have to queue for once the deadline passes, and models that can stop a run early do so.
+     * Providers and models read the deadline through CurrentDeadline. Those that cannot give up early still run to
+     * completion, and their updates are then counted whatever the time.
+     *
+     * @return Whether the value was updated, or if the deadline passed first, Stale, in which case the value is left as
+     * it was. If the deadline passes before the pipe ever had a value, that is the error deadline_exceeded instead,
+     * since there is no last value to fall back on.
+     */
+    virtual rt::expected<UpdateStatus> UpdateIfChanged(T &value, Deadline deadline) = 0;
+
     virtual const TInputs &Inputs() = 0;
     virtual rt::expected<void> WaitUntilChanged() = 0;
+
+    /**
+     * @brief As WaitUntilChanged, but gives up once the deadline passes.
+     *
+     * @return Whether there may be something new, or false if the deadline passed first.
+     */
+    virtual rt::expected<bool> WaitUntilChanged(Deadline deadline) = 0;
+
+    /**
+     * @brief The non-blocking form of WaitUntilChanged. Rather than block until there may be something new, the
+     * callback is called once when there is. The callback is called on whichever thread caused the change, possibly
+     * while that thread holds locks of its own, so it should do no more than hand off to whatever will call
+     * UpdateIfChanged. See NextValue for a convenient way of doing this.
+     *
+     * @param callback The callback. If empty, this instead withdraws any callback registered and not yet called.
+     * @return Nothing, or an error if something is already waiting on this pipe (multiple_waiting), or this pipe can
+     * never be waited upon (invalid_operation).
+     */
+    virtual rt::expected<void> NotifyWhenChanged(std::function<void()> callback) = 0;
+
+    /**
+     * @brief The class of work the inference of this pipe's updates is, which models that schedule their inference by
+     * priority read through CurrentPriority while they run. Pipes are Normal until set otherwise.
+     */
+    virtual void SetPriority(PriorityClass priority) = 0;
+    virtual PriorityClass Priority() const = 0;
+
+    /**
+     * @brief Has UpdateIfChanged report a change only when the outputs differ from those it last reported, so that a
+     * consumer can skip its own work when the model's inputs changed but its outputs did not. Floating point values,
+     * alone or as the elements of tensors, differ only by more than the tolerance. Other values are compared with their
+     * equality operator, and those that cannot be compared always differ. When the outputs are the same, the value is
+     * left as it was and false is returned. This is off unless turned on, and should be set on the thread that updates
+     * the pipe.
+     */
+    virtual void SuppressUnchanged(bool suppress = true, double tolerance = 0) = 0;
+
+    // The number of updates that ran the model, but were not reported for the outputs being the same.
+    virtual std::uint64_t Suppressed() const = 0;
 };
 
 }  // namespace inference
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <inference/output_pipe_with_input.hpp>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <unordered_map>
+#include <vector>
+#include "feature_broker_export.h"
+
+namespace inference {
+
+/**
+ * @brief Waits on many output pipes at once, so that one consumer thread can service any number of them rather than
+ * blocking a thread on each, or polling each for changes.
+ *
+ * Each pipe added is given an identifier, and the waits return the identifiers of the pipes that may have changed,
+ * after which the consumer calls UpdateIfChanged on those. As with WaitUntilChanged a pipe reported may turn out not to
+ * have changed after all, but no change is ever missed: a pipe that changes after it was reported, even before it was
+ * updated, is reported again by the next wait.
+ *
+ * A pipe added to a selector is waited on by it, so nothing else may wait on that pipe until it is removed. Other than
+ * the notifications coming in from the pipes, the selector is meant to be used from a single consumer thread.
+ */
+class PipeSelector final {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    FEATURE_BROKER_EXPORT PipeSelector();
+    FEATURE_BROKER_EXPORT ~PipeSelector();
+
+    /**
+     * @brief Adds an output pipe to the set waited upon.
+     *
+     * @return The identifier of the pipe in the waits, or an error if the pipe cannot be waited upon, for example
+     * because something is already waiting on it (multiple_waiting).
+     */
+    template <typename T, class TInputs>
+    rt::expected<std::size_t> Add(std::shared_ptr<OutputPipeWithInput<T, TInputs>> pipe) {
+        return AddCore([pipe](std::function<void()> callback) { return pipe->NotifyWhenChanged(std::move(callback)); });
+    }
+
+    /**
+     * @brief Removes a pipe from the set waited upon. It will not be reported by any later wait.
+     */
+    FEATURE_BROKER_EXPORT void Remove(std::size_t id);
+
+    /**
+     * @brief Waits for any of the pipes to change.
+     *
+     * @return The identifiers of the pipes that changed, which is never empty, or an error if a pipe could no longer be
+     * waited upon.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<std::vector<std::size_t>> Wait();
+
+    /**
+     * @brief Waits for any of the pipes to change, giving up at the deadline. A deadline already past polls.
+     *
+     * @return The identifiers of the pipes that changed, which is empty if the deadline came first.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<std::vector<std::size_t>> WaitUntil(Clock::time_point deadline);
+
+    template <class TRep, class TPeriod>
+    rt::expected<std::vector<std::size_t>> WaitFor(std::chrono::duration<TRep, TPeriod> const& timeout) {
+        return WaitUntil(Clock::now() + timeout);
+    }
+
+#ifdef __linux__
+    /**
+     * @brief An eventfd that is readable whenever there are pipes to report, so that the selector can be integrated
+     * into an epoll or similar loop. On it becoming readable, call WaitUntil with a past deadline to collect the pipes.
+     * The descriptor is owned by the selector.
+     *
+     * @return The file descriptor, or the system error that prevented creating it.
+     */
+    FEATURE_BROKER_EXPORT rt::expected<int> EventFd();
+#endif
+
+   private:
+    using Arm = std::function<rt::expected<void>(std::function<void()>)>;
+
+    // Shared with the callbacks registered on the pipes, which may outlive the selector.
+    class Signals;
+
+    struct Entry {
+        Arm ArmPipe;
+        bool Armed{false};
+    };
+
+    FEATURE_BROKER_EXPORT rt::expected<std::size_t> AddCore(Arm arm);
+    rt::expected<void> ArmEntry(std::size_t id, Entry& entry);
+    rt::expected<std::vector<std::size_t>> WaitCore(bool forever, Clock::time_point deadline);
+
+    // Have a private deleted cctor to avoid copying.
+    PipeSelector(const PipeSelector& other) = delete;
+
+    const std::shared_ptr<Signals> _signals;
+    std::unordered_map<std::size_t, Entry> _entries;
+    std::size_t _nextId{0};
+};
+
+}  // namespace inference
@@ -0,0 +1,137 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <inference/deadline.hpp>
+#include <mutex>
+#include <optional>
+#include "feature_broker_export.h"
+
+namespace inference {
+
+/**
+ * @brief The class of work an inference is, by how long it can afford to wait for a model it shares with others.
+ */
+enum class PriorityClass : std::uint8_t {
+    // Latency critical requests, which go ahead of everything else waiting.
+    Interactive = 0,
+    Normal = 1,
+    // Bulk or background scoring, which goes once nothing more urgent is waiting.
+    Background = 2
+};
+
+constexpr std::size_t PriorityClassCount = 3;
+
+/**
+ * @brief The priority class of the inference running on this thread, as set by the output pipe updating it. Models
+ * that schedule their inference by priority read it when they run. It is Normal outside of any output pipe's update.
+ */
+FEATURE_BROKER_EXPORT PriorityClass CurrentPriority() noexcept;
+
+namespace detail {
+// Sets the priority class of the thread for as long as it lives, and then restores the one there was before.
+class PriorityScope final {
+   public:
+    FEATURE_BROKER_EXPORT explicit PriorityScope(PriorityClass priority) noexcept;
+    FEATURE_BROKER_EXPORT ~PriorityScope();
+
+   private:
+    PriorityScope(const PriorityScope &other) = delete;
+
+    const PriorityClass _previous;
+};
+}  // namespace detail
+
+/**
+ * @brief Serializes the use of something that can only run one inference at a time, as a mutex would, except that it
+ * is handed on to the most urgent of those waiting rather than to whichever the mutex happens to wake. Interactive work
+ * goes ahead of Normal, which goes ahead of Background, and within a class work goes in the order it arrived.
+ *
+ * So that a steady stream of urgent work cannot starve the rest, anything that has waited longer than the starvation
+ * limit goes next whatever its class, the longest waiting first.
+ *
+ * How long each class waits is kept, for monitoring.
+ */
+class PriorityScheduler final {
+   public:
+    /**
+     * @brief Holds the scheduler until destroyed.
+     */
+    class Lease final {
+       public:
+        Lease(Lease &&other) noexcept : _scheduler(other._scheduler) { other._scheduler = nullptr; }
+        ~Lease() {
+            if (_scheduler) _scheduler->Release();
+        }
+
+       private:
+        friend class PriorityScheduler;
+
+        explicit Lease(PriorityScheduler *scheduler) noexcept : _scheduler(scheduler) {}
+
+        // Have a private deleted cctor to avoid copying.
+        Lease(const Lease &other) = delete;
+
+        PriorityScheduler *_scheduler;
+    };
+
+    struct ClassStats {
+        // The number of times the scheduler was acquired.
+        std::uint64_t Acquired{0};
+        // Of those, the number granted ahead of more urgent work because they had waited past the starvation limit.
+        std::uint64_t Promoted{0};
+        std::chrono::nanoseconds TotalWait{0};
+        std::chrono::nanoseconds MaxWait{0};
+        // The number of times the deadline passed before the scheduler could be acquired.
+        std::uint64_t TimedOut{0};
+    };
+
+    FEATURE_BROKER_EXPORT explicit PriorityScheduler(
+        std::chrono::nanoseconds starvationLimit = std::chrono::milliseconds(100));
+
+    /**
+     * @brief Waits for the scheduler, and holds it until the lease returned is destroyed.
+     */
+    FEATURE_BROKER_EXPORT Lease Acquire(PriorityClass priority);
+    Lease Acquire() { return Acquire(CurrentPriority()); }
+
+    /**
+     * @brief As Acquire, but gives up waiting once the deadline passes.
+     *
+     * @return The lease, or nothing if the deadline passed first.
+     */
+    FEATURE_BROKER_EXPORT std::optional<Lease> TryAcquireUntil(PriorityClass priority, Deadline deadline);
+
+    FEATURE_BROKER_EXPORT ClassStats Stats(PriorityClass priority) const;
+
+    // The number of acquisitions of the class now waiting.
+    FEATURE_BROKER_EXPORT std::size_t Waiting(PriorityClass priority) const;
+
+   private:
+    struct Waiter {
+        std::chrono::steady_clock::time_point Since;
+        std::condition_variable Granted;
+        bool IsGranted{false};
+        bool Promoted{false};
+    };
+
+    FEATURE_BROKER_EXPORT void Release();
+
+    // Have a private deleted cctor to avoid copying.
+    PriorityScheduler(const PriorityScheduler &other) = delete;
+
+    const std::chrono::nanoseconds _starvationLimit;
+    mutable std::mutex _mutex;
+    bool _busy{false};
+    std::array<std::deque<Waiter *>, PriorityClassCount> _waiting;
+    std::array<ClassStats, PriorityClassCount> _stats;
+};
+
+}  // namespace inference
@@ -0,0 +1,218 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/feature_provider.hpp>
+#include <inference/value_codec.hpp>
+#include <memory>
+#include <mutex>
+#include <rt/rt_expected.hpp>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "feature_broker_export.h"
+
+namespace inference {
+namespace detail {
+class SharedRegion;
+}
+
+/**
+ * @brief Publishes values into a named POSIX shared memory region, so that brokers in other processes can observe them
+ * through a SharedMemoryProvider opened on the same name.
+ *
+ * The region has a fixed slot for each value, laid out when the publisher is created. Each slot is a seqlock: the
+ * publisher writes a value straight into its slot, and readers copy it out and retry should it have been written over
+ * meanwhile, so neither side ever takes a lock that the other could be holding when it dies. Values are kept in the
+ * encoding of detail::ValueCodec, which for numbers and tensors of numbers is their bytes.
+ *
+ * There is one publisher for a region, which owns it: creating the publisher replaces any region of that name, and
+ * destroying it removes the name, though processes that already opened the region keep it.
+ */
+class SharedMemoryPublisher final : public std::enable_shared_from_this<SharedMemoryPublisher> {
+   public:
+    // The longest name a slot may have.
+    static constexpr std::size_t MaxNameLength = 63;
+
+    /**
+     * @brief The slots of a region.
+     */
+    class Layout final {
+       public:
+        /**
+         * @brief Adds a slot for values of type T.
+         *
+         * @param capacity The most bytes a value can take in the slot. This defaults to the size of a number, and must
+         * be given for strings and tensors: a string takes four bytes more than its length, and a tensor four bytes,
+         * plus eight for each dimension, plus its items.
+         */
+        template <typename T>
+        Layout &Add(std::string name, std::size_t capacity = 0) {
+            if (capacity == 0 && std::is_arithmetic<T>::value) capacity = sizeof(T);
+            _slots.push_back(
+                {std::move(name), detail::ValueCodec<T>::Item, detail::ValueCodec<T>::Container, capacity});
+            return *this;
+        }
+
+       private:
+        friend class SharedMemoryPublisher;
+
+        struct Slot {
+            std::string Name;
+            detail::CodecItem Item;
+            detail::CodecContainer Container;
+            std::size_t Capacity;
+        };
+        std::vector<Slot> _slots;
+    };
+
+    /**
+     * @brief Creates the region.
+     *
+     * @return The publisher, or an error: invalid_operation if the layout has a slot without a capacity, a slot name
+     * that is too long, or two slots of the same name, or otherwise the system error that prevented creating the
+     * region.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<SharedMemoryPublisher>> Create(std::string const &name,
+                                                                                              Layout const &layout);
+
+    FEATURE_BROKER_EXPORT ~SharedMemoryPublisher();
+
+    /**
+     * @brief Creates the input pipe that writes values to the slot of the name. Each slot can have only one.
+     *
+     * Values fed take effect in the region and wake any observer before Feed returns. A value too large for its slot is
+     * not published, and is counted by Oversized instead.
+     *
+     * @return The pipe, or an error if there is no slot of the name (name_not_found), it holds a different type
+     * (type_mismatch), or it already has a pipe (already_bound).
+     */
+    template <typename T>
+    rt::expected<std::shared_ptr<DirectInputPipe<T>>> BindInput(std::string const &name);
+
+    /**
+     * @brief The number of values fed that were too large for their slots.
+     */
+    std::uint64_t Oversized() const noexcept { return _oversized.load(std::memory_order_relaxed); }
+
+   private:
+    explicit SharedMemoryPublisher(std::unique_ptr<detail::SharedRegion> region);
+
+    FEATURE_BROKER_EXPORT rt::expected<std::size_t> BindSlot(std::string const &name, detail::CodecItem item,
+                                                              detail::CodecContainer container);
+    FEATURE_BROKER_EXPORT void Write(std::size_t slot, std::string const &encoded);
+
+    // Have a private deleted cctor to avoid copying.
+    SharedMemoryPublisher(const SharedMemoryPublisher &other) = delete;
+
+    template <typename T>
+    friend class DirectInputPipe;
+
+    const std::unique_ptr<detail::SharedRegion> _region;
+    std::mutex _bindMutex;
+    std::vector<bool> _bound;
+    std::atomic<std::uint64_t> _oversized{0};
+};
+
+/**
+ * @brief A feature provider whose outputs are the slots of a region published by a SharedMemoryPublisher, usually in
+ * another process. Each slot is an output of the same name and type.
+ *
+ * Reading a slot copies its value out, once, into the value fed to the output's pipe. A thread of the provider's own
+ * sleeps on a futex in the region, which the publisher wakes whenever it writes, and pings the broker for those
+ * updaters whose slots changed. Where futexes are not available the thread polls instead.
+ */
+class SharedMemoryProvider final : public FeatureProvider {
+   public:
+    /**
+     * @return The provider, or an error: the system error that prevented opening the region, or illegal_byte_sequence
+     * if it is not a region as a publisher of this version creates them.
+     */
+    FEATURE_BROKER_EXPORT static rt::expected<std::shared_ptr<SharedMemoryProvider>> Open(std::string const &name);
+
+    FEATURE_BROKER_EXPORT ~SharedMemoryProvider();
+
+    FEATURE_BROKER_EXPORT std::unordered_map<std::string, TypeDescriptor> const &Outputs() const override;
+
+    FEATURE_BROKER_EXPORT rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<InputPipe>> const &outputToPipe,
+        std::function<void()> valuesChangedNotifier) const override;
+
+   private:
+    class Updater;
+
+    // Decodes a value of the slot's type and feeds it to a pipe of that type.
+    using Feeder = bool (*)(char const *begin, char const *end, InputPipe &pipe);
+
+    struct Slot {
+        std::size_t Index;
+        Feeder Feed;
+    };
+
+    explicit SharedMemoryProvider(std::unique_ptr<detail::SharedRegion> region);
+
+    void Watch(std::uint32_t seen);
+
+    // Have a private deleted cctor to avoid copying.
+    SharedMemoryProvider(const SharedMemoryProvider &other) = delete;
+
+    // Shared with the updaters, which outlive the provider should the broker be released before the output pipes.
+    const std::shared_ptr<detail::SharedRegion> _region;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+    std::unordered_map<std::string, Slot> _slots;
+    mutable std::mutex _updatersMutex;
+    mutable std::vector<std::weak_ptr<Updater>> _updaters;
+    std::atomic<bool> _stopping{false};
+    std::thread _watcher;
+};
+
+// The pipe handed out by SharedMemoryPublisher::BindInput. It writes to its slot rather than to any handle, so it is
+// not meant to be bound in a broker.
+template <typename T>
+class DirectInputPipe<T>::Published final : public DirectInputPipe<T> {
+   public:
+    Published(std::shared_ptr<SharedMemoryPublisher> publisher, std::size_t slot)
+        : _publisher(std::move(publisher)), _slot(slot) {}
+
+    void Feed(T value) override {
+        // The lock keeps the one slot to one writer at a time, which the seqlock requires, and guards the buffer the
+        // value is encoded into, which is kept so that feeding does not allocate once it has grown large enough.
+        std::lock_guard<std::mutex> lock(_mutex);
+        _encoded.clear();
+        detail::ValueCodec<T>::Encode(value, _encoded);
+        _publisher->Write(_slot, _encoded);
+    }
+
+   private:
+    std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
+        std::shared_ptr<InputPipe::OutputWaiter>) override {
+        return {};
+    }
+
+    const std::shared_ptr<SharedMemoryPublisher> _publisher;
+    const std::size_t _slot;
+    std::mutex _mutex;
+    std::string _encoded;
+};
+
+template <typename T>
+rt::expected<std::shared_ptr<DirectInputPipe<T>>> SharedMemoryPublisher::BindInput(std::string const &name) {
+    auto slotExpected = BindSlot(name, detail::ValueCodec<T>::Item, detail::ValueCodec<T>::Container);
+    if (!slotExpected) return tl::make_unexpected(slotExpected.error());
+    auto pipe = std::make_shared<typename DirectInputPipe<T>::Published>(shared_from_this(), *slotExpected);
+    return std::static_pointer_cast<DirectInputPipe<T>>(pipe);
+}
+
+}  // namespace inference
+
+#endif
@@ -0,0 +1,308 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/handle.hpp>
+#include <inference/input_pipe.hpp>
+#include <inference/model.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace inference {
+
+/**
+ * @brief A compile time descriptor of one named and typed input or output of a static schema. Fields derive from
+ * this and supply the name, for example:
+ *
+ *     struct Height : StaticField<float> { static constexpr const char* Name = "Height"; };
+ */
+template <typename T>
+struct StaticField {
+    static_assert(TypeDescriptor::IsSupported<T>(), "StaticField type is not supported by the feature broker.");
+    using Type = T;
+};
+
+/**
+ * @brief A compile time list of StaticField descriptors. A schema for StaticFeatureBroker is any type with nested
+ * `Inputs` and `Outputs` aliases of this template.
+ */
+template <class... TFields>
+class StaticFields final {
+   public:
+    static constexpr std::size_t Count = sizeof...(TFields);
+
+    template <std::size_t I>
+    using FieldAt = std::tuple_element_t<I, std::tuple<TFields...>>;
+
+    /** @brief The position of TField in this list, or Count if it is not present. */
+    template <class TField>
+    static constexpr std::size_t IndexOf() noexcept {
+        constexpr bool matches[] = {std::is_same<TField, TFields>::value..., false};
+        std::size_t i = 0;
+        while (i < Count && !matches[i]) ++i;
+        return i;
+    }
+
+    template <template <typename> class TWrap>
+    using Apply = std::tuple<TWrap<typename TFields::Type>...>;
+
+    static constexpr bool NamesDistinct() noexcept {
+        const char* names[] = {TFields::Name..., nullptr};
+        for (std::size_t i = 0; i < Count; ++i) {
+            for (std::size_t j = i + 1; j < Count; ++j) {
+                if (NamesEqual(names[i], names[j])) return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Calls func with a std::integral_constant for each field index in order, stopping at the first call that
+     * returns an error.
+     */
+    template <class TFunc>
+    static std::error_code ForEach(TFunc&& func) {
+        return ForEachImpl(func, std::make_index_sequence<Count>{});
+    }
+
+   private:
+    static constexpr bool NamesEqual(const char* a, const char* b) noexcept {
+        while (*a != '\0' && *a == *b) {
+            ++a;
+            ++b;
+        }
+        return *a == *b;
+    }
+
+    template <class TFunc, std::size_t... I>
+    static std::error_code ForEachImpl(TFunc& func, std::index_sequence<I...>) {
+        std::error_code err;
+        (void)(... || static_cast<bool>(err = func(std::integral_constant<std::size_t, I>{})));
+        return err;
+    }
+};
+
+/**
+ * @brief A feature broker for a single model whose inputs, outputs and their types are all fixed at compile time.
+ *
+ * Where FeatureBroker and SynchronousFeatureBroker resolve names, types and pipes at runtime, here the schema is a
+ * type, so feeding or reading a field that is not in the schema, or with the wrong type, fails to compile. All input
+ * and output handles live in one contiguous allocation and are addressed by compile time index, so a feed is a plain
+ * store and an update is a single call into the model's value updater. The model itself is still any inference::Model
+ * bound through the usual CreateValueUpdater contract, and its declared types are checked against the schema once, in
+ * Create.
+ *
+ * Like SynchronousFeatureBroker, this is not thread safe: feeds and updates should happen on one thread.
+ *
+ * @tparam TSchema A type with nested `Inputs` and `Outputs` aliases, each a StaticFields list.
+ */
+template <class TSchema>
+class StaticFeatureBroker final {
+   public:
+    using Inputs = typename TSchema::Inputs;
+    using Outputs = typename TSchema::Outputs;
+
+    static_assert(Outputs::Count > 0, "A static schema needs at least one output.");
+    static_assert(Inputs::NamesDistinct(), "Input names in a static schema must be distinct.");
+    static_assert(Outputs::NamesDistinct(), "Output names in a static schema must be distinct.");
+
+    /**
+     * @brief Binds every output of the schema against the model.
+     *
+     * @return The broker, or an error if the model lacks a schema output (name_not_found), a model input or output has
+     * a different type than the schema (type_mismatch), or an output requires an input outside the schema (not_bound).
+     */
+    static rt::expected<std::shared_ptr<StaticFeatureBroker>> Create(std::shared_ptr<const Model> model) {
+        std::shared_ptr<StaticFeatureBroker> broker(new StaticFeatureBroker());
+        auto err = broker->Bind(std::move(model));
+        if (err) return tl::make_unexpected(err);
+        return broker;
+    }
+
+    template <class TField>
+    void Feed(typename TField::Type value) {
+        constexpr std::size_t index = Inputs::template IndexOf<TField>();
+        static_assert(index < Inputs::Count, "Field is not an input of this schema.");
+        auto& handle = std::get<index>(_storage->InputHandles);
+        handle.MutableValue() = std::move(value);
+        handle.Changed(true);
+    }
+
+    /**
+     * @brief Runs the model if any input it depends upon has been fed since the last run, and all of them have been
+     * fed at least once.
+     *
+     * @return Whether any of the outputs changed, or the error from the model.
+     */
+    rt::expected<bool> UpdateIfChanged() {
+        if (!_storage->Ready.load(std::memory_order_acquire)) return false;
+        if (!InputsChanged()) return false;
+        if (!_updater->Changed()) return false;
+        ClearChanged(_storage->OutputHandles);
+        auto err = _updater->UpdateOutput();
+        if (err) return tl::make_unexpected(err);
+        _firstOutputFetched = true;
+        ClearChanged(_storage->InputHandles);
+        return OutputsChanged();
+    }
+
+    /** @brief The last value the model published for an output field. */
+    template <class TField>
+    typename TField::Type const& Value() const {
+        constexpr std::size_t index = Outputs::template IndexOf<TField>();
+        static_assert(index < Outputs::Count, "Field is not an output of this schema.");
+        return std::get<index>(_storage->OutputHandles).MutableValue();
+    }
+
+    /** @brief Whether the last successful UpdateIfChanged published a new value for an output field. */
+    template <class TField>
+    bool Changed() const {
+        constexpr std::size_t index = Outputs::template IndexOf<TField>();
+        static_assert(index < Outputs::Count, "Field is not an output of this schema.");
+        return std::get<index>(_storage->OutputHandles).Changed();
+    }
+
+   private:
+    // The model pushes outputs into pipes. This one writes directly into the broker's output handle, so there is no
+    // intermediate handle or value updater between the model and the value the caller reads.
+    template <typename T>
+    class OutputSink final : public DirectInputPipe<T> {
+       public:
+        OutputSink() = default;
+
+        void Feed(T value) override {
+            _target->MutableValue() = std::move(value);
+            _target->Changed(true);
+        }
+
+       private:
+        friend class StaticFeatureBroker;
+
+        std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
+            std::shared_ptr<InputPipe::OutputWaiter>) override {
+            return {};
+        }
+
+        Handle<T>* _target{nullptr};
+    };
+
+    struct Storage {
+        typename Inputs::template Apply<Handle> InputHandles;
+        typename Outputs::template Apply<Handle> OutputHandles;
+        typename Outputs::template Apply<OutputSink> Sinks;
+        std::atomic<bool> Ready{false};
+    };
+
+    StaticFeatureBroker() : _storage(std::make_shared<Storage>()) {}
+    StaticFeatureBroker(const StaticFeatureBroker&) = delete;
+    StaticFeatureBroker& operator=(const StaticFeatureBroker&) = delete;
+
+    std::error_code Bind(std::shared_ptr<const Model> model) {
+        if (!model) return make_feature_error(feature_errc::not_bound);
+
+        auto const& modelInputs = model->Inputs();
+        auto const& modelOutputs = model->Outputs();
+        std::map<std::string, std::shared_ptr<InputPipe>> outputToPipe;
+
+        auto err = Outputs::ForEach([&](auto index) -> std::error_code {
+            using TField = typename Outputs::template FieldAt<decltype(index)::value>;
+            auto found = modelOutputs.find(TField::Name);
+            if (found == modelOutputs.end()) return make_feature_error(feature_errc::name_not_found);
+            if (found->second != TypeDescriptor::CreateExpected<typename TField::Type>().value())
+                return make_feature_error(feature_errc::type_mismatch);
+
+            auto& sink = std::get<index>(_storage->Sinks);
+            sink._target = &std::get<index>(_storage->OutputHandles);
+            // The sinks live inside the storage block, so share its ownership rather than allocating each one.
+            outputToPipe.emplace(TField::Name, std::shared_ptr<InputPipe>(_storage, &sink));
+
+            for (auto const& requirement : model->GetRequirements(TField::Name)) {
+                std::size_t input = InputIndex(requirement);
+                if (input == Inputs::Count) return make_feature_error(feature_errc::not_bound);
+                _required[input] = true;
+            }
+            return err_feature_ok();
+        });
+        if (err) return err;
+
+        std::map<std::string, std::shared_ptr<IHandle>> inputToHandle;
+        err = Inputs::ForEach([&](auto index) -> std::error_code {
+            using TField = typename Inputs::template FieldAt<decltype(index)::value>;
+            if (!_required[index]) return err_feature_ok();
+            auto found = modelInputs.find(TField::Name);
+            if (found != modelInputs.end() &&
+                found->second != TypeDescriptor::CreateExpected<typename TField::Type>().value())
+                return make_feature_error(feature_errc::type_mismatch);
+            inputToHandle.emplace(TField::Name,
+                                  std::shared_ptr<IHandle>(_storage, &std::get<index>(_storage->InputHandles)));
+            return err_feature_ok();
+        });
+        if (err) return err;
+
+        auto storage = _storage;
+        auto updaterExpected = model->CreateValueUpdater(
+            inputToHandle, outputToPipe, [storage]() { storage->Ready.store(true, std::memory_order_release); });
+        if (!updaterExpected) return updaterExpected.error();
+        _updater = std::move(updaterExpected.value());
+        _model = std::move(model);
+        return err_feature_ok();
+    }
+
+    static std::size_t InputIndex(std::string const& name) {
+        std::size_t result = Inputs::Count;
+        Inputs::ForEach([&](auto index) -> std::error_code {
+            if (name == Inputs::template FieldAt<decltype(index)::value>::Name) {
+                result = index;
+                return make_feature_error(feature_errc::name_not_found);  // Only used to stop the iteration.
+            }
+            return err_feature_ok();
+        });
+        return result;
+    }
+
+    bool InputsChanged() const {
+        return InputsChangedImpl(std::make_index_sequence<Inputs::Count>{});
+    }
+
+    template <std::size_t... I>
+    bool InputsChangedImpl(std::index_sequence<I...>) const {
+        auto const& handles = _storage->InputHandles;
+        // Until the first output is computed every required input must have been fed, as in the other brokers.
+        if (_firstOutputFetched) return (false || ... || (_required[I] && std::get<I>(handles).Changed()));
+        return (true && ... && (!_required[I] || std::get<I>(handles).Changed()));
+    }
+
+    bool OutputsChanged() const {
+        return std::apply([](auto const&... handles) { return (false || ... || handles.Changed()); },
+                          _storage->OutputHandles);
+    }
+
+    template <class TTuple>
+    static void ClearChanged(TTuple& handles) {
+        std::apply([](auto&... handle) { (handle.Changed(false), ...); }, handles);
+    }
+
+    const std::shared_ptr<Storage> _storage;
+    std::array<bool, Inputs::Count> _required{};
+    std::shared_ptr<ValueUpdater> _updater;
+    std::shared_ptr<const Model> _model;
+    bool _firstOutputFetched{false};
+};
+
+}  // namespace inference
@@ -0,0 +1,258 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <inference/bounded_queue.hpp>
+#include <inference/input_pipe.hpp>
+#include <inference/value_updater.hpp>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace inference {
+class TypeDescriptor;
+class IHandle;
+template <typename T>
+class Handle;
+template <typename T>
+class Tensor;
+
+/**
+ * @brief What a stream input does with an event fed to it while its queue is full.
+ */
+enum class StreamPolicy {
+    // Feed waits until the consumer drains the queue. A stream that nothing drains blocks its producers forever.
+    Block,
+    // The oldest event queued is dropped to make room.
+    DropOldest,
+    // The event fed is dropped.
+    DropNewest
+};
+
+/**
+ * @brief An input that queues every event fed to it, rather than keeping only the last value as DirectInputPipe does.
+ * Models see it as an input of type Tensor<T>: a one dimensional tensor of the events fed since the previous inference,
+ * oldest first, which is empty if there were none.
+ *
+ * Events are queued in a bounded lock-free queue, so producers never wait on a consumer running inference, nor on each
+ * other. The queue is drained on the consumer's thread when it next updates. Only the first event of each batch wakes
+ * consumers waiting on their outputs.
+ *
+ * Each event is delivered once. Should several output pipes depend on the stream, each event goes to the one that
+ * drains it first, so a stream is meant to have a single consumer.
+ */
+template <typename T>
+class StreamInputPipe final : public InputPipe {
+   public:
+    virtual ~StreamInputPipe() = default;
+
+    TypeDescriptor Type() const override;
+
+    void Feed(T value);
+
+    /**
+     * @brief The number of events dropped because the queue was full, under the DropOldest and DropNewest policies.
+     */
+    std::uint64_t Dropped() const noexcept { return _dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief The most events the queue holds, which is the capacity asked for rounded up to a power of two.
+     */
+    std::size_t Capacity() const noexcept { return _queue.Capacity(); }
+
+   private:
+    friend class FeatureBroker;  // For the constructor.
+
+    StreamInputPipe(std::size_t capacity, StreamPolicy policy, std::pmr::memory_resource *resource)
+        : _queue(capacity), _policy(policy) {
+        _resource = resource;
+    }
+
+    class Updater : public ValueUpdater {
+       public:
+        Updater(std::shared_ptr<StreamInputPipe<T>> parent, std::shared_ptr<InputPipe::OutputWaiter> waiter);
+
+        bool Changed() override;
+        std::error_code UpdateOutput() override;
+
+       private:
+        friend class StreamInputPipe;
+
+        void Ping();
+
+        const std::shared_ptr<StreamInputPipe<T>> _parent;
+        Handle<Tensor<T>> _handle;
+        // The events of the batch in the handle, kept so that events drained before the batch was consumed are added
+        // to rather than replaced.
+        std::vector<T> _batch;
+        std::shared_ptr<InputPipe::OutputWaiter> _waiter;
+        // Guarded by the parent's observers mutex.
+        bool _pinged{false};
+    };
+
+    std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> CreateHandleAndUpdater(
+        std::shared_ptr<InputPipe::OutputWaiter> waiter) override;
+
+    // Pings the observers, unless they were already pinged for the batch being queued.
+    void Signal();
+    // Moves up to a queue's worth of events to the end of the batch.
+    void Drain(std::vector<T> &batch);
+
+    // Have a private deleted cctor to avoid copying.
+    StreamInputPipe(const StreamInputPipe &other) = delete;
+
+    detail::BoundedQueue<T> _queue;
+    const StreamPolicy _policy;
+    std::atomic<std::uint64_t> _dropped{0};
+
+    // Set by the feed that finds it clear and cleared by the consumer before it drains, so that observers are pinged
+    // once per batch rather than once per event.
+    std::atomic<bool> _signalled{false};
+    std::mutex _observersMutex;
+    std::list<std::weak_ptr<Updater>> _observers;
+
+    // For producers waiting on a full queue under the Block policy. The count lets the consumer skip the notification
+    // when there are none.
+    std::atomic<std::uint32_t> _blocked{0};
+    std::mutex _spaceMutex;
+    std::condition_variable _space;
+};
+
+}  // namespace inference
+
+#include <inference/feature_error.hpp>
+#include <inference/handle.hpp>
+#include <inference/tensor.hpp>
+#include <inference/type_descriptor.hpp>
+
+namespace inference {
+
+template <typename T>
+TypeDescriptor StreamInputPipe<T>::Type() const {
+    // The broker validates the type before creating the pipe.
+    return TypeDescriptor::_CreateUnsafe<Tensor<T>>();
+}
+
+template <typename T>
+void StreamInputPipe<T>::Feed(T value) {
+    if (!_queue.TryPush(std::move(value))) {
+        switch (_policy) {
+            case StreamPolicy::Block:
+                _blocked.fetch_add(1, std::memory_order_seq_cst);
+                // Pairs with the fence in Drain, so that either this sees the room the consumer made, or the consumer
+                // sees this waiting.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                {
+                    std::unique_lock<std::mutex> lock(_spaceMutex);
+                    _space.wait(lock, [this, &value]() { return _queue.TryPush(std::move(value)); });
+                }
+                _blocked.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            case StreamPolicy::DropOldest: {
+                T oldest;
+                do {
+                    if (_queue.TryPop(oldest)) _dropped.fetch_add(1, std::memory_order_relaxed);
+                } while (!_queue.TryPush(std::move(value)));
+                break;
+            }
+            case StreamPolicy::DropNewest:
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+        }
+    }
+
+    Signal();
+}
+
+template <typename T>
+void StreamInputPipe<T>::Signal() {
+    if (_signalled.exchange(true, std::memory_order_acq_rel)) return;
+    std::lock_guard<std::mutex> lock(_observersMutex);
+    for (auto iter = _observers.begin(); iter != _observers.end();) {
+        if (auto observer = iter->lock()) {
+            observer->Ping();
+            iter++;
+        } else {
+            iter = _observers.erase(iter);
+        }
+    }
+}
+
+template <typename T>
+void StreamInputPipe<T>::Drain(std::vector<T> &batch) {
+    _signalled.store(false, std::memory_order_seq_cst);
+    // Bounded, so that producers feeding as fast as this drains cannot keep the consumer here.
+    std::size_t drained = 0;
+    T value;
+    while (drained < _queue.Capacity() && _queue.TryPop(value)) {
+        batch.push_back(std::move(value));
+        ++drained;
+    }
+    // Whatever was left behind is signalled anew.
+    if (drained == _queue.Capacity()) Signal();
+
+    if (_policy != StreamPolicy::Block || drained == 0) return;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_blocked.load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> lock(_spaceMutex);
+    _space.notify_all();
+}
+
+template <typename T>
+std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>> StreamInputPipe<T>::CreateHandleAndUpdater(
+    std::shared_ptr<InputPipe::OutputWaiter> waiter) {
+    auto thisPtr = std::static_pointer_cast<StreamInputPipe<T>>(shared_from_this());
+    std::lock_guard<std::mutex> lock(_observersMutex);
+    auto updater = detail::AllocateShared<Updater>(_resource, std::move(thisPtr), std::move(waiter));
+    _observers.push_back(updater);
+    std::shared_ptr<IHandle> handle(updater, &updater->_handle);
+    return std::pair<std::shared_ptr<IHandle>, std::shared_ptr<ValueUpdater>>(std::move(handle), std::move(updater));
+}
+
+template <typename T>
+StreamInputPipe<T>::Updater::Updater(std::shared_ptr<StreamInputPipe<T>> parent,
+                                     std::shared_ptr<InputPipe::OutputWaiter> waiter)
+    : _parent(std::move(parent)), _waiter(std::move(waiter)) {
+    // Events queued before this was created are there to be drained.
+    if (_parent->_signalled.load(std::memory_order_acquire)) Ping();
+}
+
+template <typename T>
+void StreamInputPipe<T>::Updater::Ping() {
+    if (_waiter) _waiter->Ping(_pinged);
+    _pinged = true;
+}
+
+template <typename T>
+bool StreamInputPipe<T>::Updater::Changed() {
+    // A batch already consumed counts as a change too, so that it is replaced by an empty one before the model next
+    // runs for some other input's sake, rather than being seen twice.
+    return _parent->_signalled.load(std::memory_order_acquire) || (!_handle.Changed() && !_batch.empty());
+}
+
+template <typename T>
+std::error_code StreamInputPipe<T>::Updater::UpdateOutput() {
+    if (!_handle.Changed()) _batch.clear();
+    _parent->Drain(_batch);
+    auto count = _batch.size();
+    std::shared_ptr<T> data;
+    if (count > 0) {
+        data = std::shared_ptr<T>(new T[count], std::default_delete<T[]>());
+        std::copy(_batch.begin(), _batch.end(), data.get());
+    }
+    _handle.MutableValue() = Tensor<T>(std::move(data), {count});
+    _handle.Changed(count > 0);
+    return err_feature_ok();
+}
+
+}  // namespace inference
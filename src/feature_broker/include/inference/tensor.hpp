@@ -13,8 +13,9 @@ class Tensor final {
    public:
     Tensor() = default;
     Tensor(std::shared_ptr<T> ptr, std::vector<size_t> const& dimensions)
-        : m_data(std::move(ptr)), m_dims(dimensions) {}
+        : m_data(std::move(ptr)), m_dims(std::make_shared<const std::vector<size_t>>(dimensions)) {}
     Tensor(const Tensor<T>& other) : m_data(other.m_data), m_dims(other.m_dims) {}
+    Tensor(Tensor<T>&& other) noexcept = default;
     ~Tensor() = default;
 
     Tensor<T>& operator=(const Tensor<T>& other) {
@@ -22,14 +23,22 @@ class Tensor final {
         m_dims = other.m_dims;
         return *this;
     }
+    Tensor<T>& operator=(Tensor<T>&& other) noexcept = default;
 
     T* Data() noexcept { return m_data.get(); }
     const T* Data() const noexcept { return m_data.get(); }
-    std::vector<size_t> const& Dimensions() const noexcept { return m_dims; }
+    std::vector<size_t> const& Dimensions() const noexcept { return m_dims ? *m_dims : NoDimensions(); }
 
    private:
+    static std::vector<size_t> const& NoDimensions() noexcept {
+        static const std::vector<size_t> none;
+        return none;
+    }
+
     std::shared_ptr<T> m_data;
-    std::vector<size_t> m_dims;
+    // The dimensions never change once constructed, so copies share them rather than each allocating their own. This
+    // is what lets tensors be fed through pipes and handles without allocating.
+    std::shared_ptr<const std::vector<size_t>> m_dims;
 };
 
 }  // namespace inference
@@ -6,8 +6,10 @@
 
 #include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <system_error>
+#include <type_traits>
 #ifdef INFERENCE_USE_RTTI
 #include <typeindex>
 #endif
@@ -18,6 +20,7 @@
 namespace inference {
 
 class InputPipe;
+class IHandle;
 
 /**
  * Modeled after std::type_index but a more restricted set of types and not using RTTI.
@@ -31,6 +34,21 @@ class TypeDescriptor final {
     template <typename T>
     static TypeDescriptor Create() noexcept = delete;
 
+    /**
+     * @brief Whether CreateExpected<T> can succeed, evaluated at compile time so that statically typed consumers like
+     * StaticFeatureBroker can reject unsupported types with a static_assert rather than an error code.
+     */
+    template <typename T>
+    static constexpr bool IsSupported() noexcept {
+#ifdef INFERENCE_USE_RTTI
+        return true;
+#else
+        using U = typename IsTensor<T>::Item;
+        return std::is_same<U, int32_t>::value || std::is_same<U, int64_t>::value || std::is_same<U, float>::value ||
+               std::is_same<U, double>::value || std::is_same<U, std::string>::value;
+#endif
+    }
+
     const static bool RuntimeTypesSupported =
 #ifdef INFERENCE_USE_RTTI
         true;
@@ -83,6 +101,17 @@ class TypeDescriptor final {
     friend class Handle;
     template <typename T>
     friend class DirectInputPipe;
+    template <typename T>
+    friend class StreamInputPipe;
+
+    template <typename T>
+    struct IsTensor : std::false_type {
+        using Item = T;
+    };
+    template <typename T>
+    struct IsTensor<Tensor<T>> : std::true_type {
+        using Item = T;
+    };
 
     // It might be better if this was shared and pointing to some singleton, but maybe not -- the class itself is empty,
     // so basically an "instance" contains nothing but a virtual method table.
@@ -91,7 +120,7 @@ class TypeDescriptor final {
     inline static TypeDescriptor _CreateUnsafe() noexcept {
         auto td = TypeDescriptor::CreateExpected<T>();
         if (td) return td.value();
-        return TypeDescriptor(ItemType::Undefined, ContainerType::Scalar, new TypeServices<T>());
+        return TypeDescriptor(ItemType::Undefined, ContainerType::Scalar, TypeServices<T>::Instance());
     }
 
 #ifdef INFERENCE_USE_RTTI
@@ -115,19 +144,21 @@ class TypeDescriptor final {
 
     class ITypeServices {
        public:
-        virtual std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer() const noexcept = 0;
+        virtual std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer(
+            std::pmr::memory_resource* resource) const noexcept = 0;
+        virtual void FeedFromHandle(IHandle const& handle, InputPipe& pipe) const = 0;
         virtual ~ITypeServices() = default;
     };
 
-    // There is no reason for this to be shared. I *think* we could get away with using a unique ptr if we were explicit
-    // about copy or more constructors?
-    const std::shared_ptr<ITypeServices> _typeServices;
+    // The services of a type are stateless, so there is one instance of them for each type, and creating or copying a
+    // descriptor never allocates.
+    ITypeServices const* const _typeServices;
 
 #ifdef INFERENCE_USE_RTTI
-    TypeDescriptor(const std::type_index typeIndex, ITypeServices* services)
+    TypeDescriptor(const std::type_index typeIndex, ITypeServices const* services)
         : _typeIndex(typeIndex), _typeServices(services) {}
 #else
-    TypeDescriptor(const ItemType itemType, const ContainerType containerType, ITypeServices* services)
+    TypeDescriptor(const ItemType itemType, const ContainerType containerType, ITypeServices const* services)
         : _itemType(itemType), _containerType(containerType), _typeServices(services) {}
 #endif
 
@@ -139,14 +170,26 @@ class TypeDescriptor final {
        public:
         TypeServices() = default;
         virtual ~TypeServices() = default;
-        std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer() const noexcept;
+        std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer(
+            std::pmr::memory_resource* resource) const noexcept;
+        void FeedFromHandle(IHandle const& handle, InputPipe& pipe) const;
+
+        static ITypeServices const* Instance() noexcept {
+            static const TypeServices<T> instance;
+            return &instance;
+        }
     };
 
     friend class FeatureBrokerBase;
+    friend class ModelGraph;
 
-    std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer() const noexcept {
-        return _typeServices->CreateDirectInputPipeSyncSingleConsumer();
+    std::shared_ptr<InputPipe> CreateDirectInputPipeSyncSingleConsumer(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const noexcept {
+        return _typeServices->CreateDirectInputPipeSyncSingleConsumer(resource);
     }
+
+    // Feeds the value of a handle of this type to a direct input pipe of this type.
+    void FeedFromHandle(IHandle const& handle, InputPipe& pipe) const { _typeServices->FeedFromHandle(handle, pipe); }
 };
 
 }  // namespace inference
@@ -157,21 +200,22 @@ class TypeDescriptor final {
 namespace inference {
 template <typename T>
 rt::expected<TypeDescriptor> TypeDescriptor::CreateExpected() noexcept {
+    auto services = TypeServices<T>::Instance();
 #ifdef INFERENCE_USE_RTTI
-    return TypeDescriptor(typeid(T), new TypeServices<T>());
+    return TypeDescriptor(typeid(T), services);
 #else
     const auto scalar = ContainerType::Scalar;
-    if (std::is_same<T, int32_t>()) return TypeDescriptor(ItemType::Int, scalar, new TypeServices<T>());
-    if (std::is_same<T, int64_t>()) return TypeDescriptor(ItemType::Long, scalar, new TypeServices<T>());
-    if (std::is_same<T, float>()) return TypeDescriptor(ItemType::Single, scalar, new TypeServices<T>());
-    if (std::is_same<T, double>()) return TypeDescriptor(ItemType::Double, scalar, new TypeServices<T>());
-    if (std::is_same<T, std::string>()) return TypeDescriptor(ItemType::String, scalar, new TypeServices<T>());
+    if (std::is_same<T, int32_t>()) return TypeDescriptor(ItemType::Int, scalar, services);
+    if (std::is_same<T, int64_t>()) return TypeDescriptor(ItemType::Long, scalar, services);
+    if (std::is_same<T, float>()) return TypeDescriptor(ItemType::Single, scalar, services);
+    if (std::is_same<T, double>()) return TypeDescriptor(ItemType::Double, scalar, services);
+    if (std::is_same<T, std::string>()) return TypeDescriptor(ItemType::String, scalar, services);
     const auto tensor = ContainerType::Tensor;
-    if (std::is_same<T, Tensor<int32_t>>()) return TypeDescriptor(ItemType::Int, tensor, new TypeServices<T>());
-    if (std::is_same<T, Tensor<int64_t>>()) return TypeDescriptor(ItemType::Long, tensor, new TypeServices<T>());
-    if (std::is_same<T, Tensor<float>>()) return TypeDescriptor(ItemType::Single, tensor, new TypeServices<T>());
-    if (std::is_same<T, Tensor<double>>()) return TypeDescriptor(ItemType::Double, tensor, new TypeServices<T>());
-    if (std::is_same<T, Tensor<std::string>>()) return TypeDescriptor(ItemType::String, tensor, new TypeServices<T>());
+    if (std::is_same<T, Tensor<int32_t>>()) return TypeDescriptor(ItemType::Int, tensor, services);
+    if (std::is_same<T, Tensor<int64_t>>()) return TypeDescriptor(ItemType::Long, tensor, services);
+    if (std::is_same<T, Tensor<float>>()) return TypeDescriptor(ItemType::Single, tensor, services);
+    if (std::is_same<T, Tensor<double>>()) return TypeDescriptor(ItemType::Double, tensor, services);
+    if (std::is_same<T, Tensor<std::string>>()) return TypeDescriptor(ItemType::String, tensor, services);
     //    return TypeDescriptor(ItemType::Single, ContainerType::Tensor);
 
     return make_feature_unexpected(feature_errc::type_unsupported);
@@ -179,8 +223,15 @@ rt::expected<TypeDescriptor> TypeDescriptor::CreateExpected() noexcept {
 }
 
 template <typename T>
-std::shared_ptr<InputPipe> TypeDescriptor::TypeServices<T>::CreateDirectInputPipeSyncSingleConsumer() const noexcept {
-    return std::static_pointer_cast<InputPipe>(std::make_shared<typename DirectInputPipe<T>::SyncSingleConsumer>());
+std::shared_ptr<InputPipe> TypeDescriptor::TypeServices<T>::CreateDirectInputPipeSyncSingleConsumer(
+    std::pmr::memory_resource* resource) const noexcept {
+    return std::static_pointer_cast<InputPipe>(
+        detail::AllocateShared<typename DirectInputPipe<T>::SyncSingleConsumer>(resource));
+}
+
+template <typename T>
+void TypeDescriptor::TypeServices<T>::FeedFromHandle(IHandle const& handle, InputPipe& pipe) const {
+    static_cast<DirectInputPipe<T>&>(pipe).Feed(static_cast<Handle<T> const&>(handle)._value);
 }
 
 /**
@@ -188,8 +239,6 @@ std::shared_ptr<InputPipe> TypeDescriptor::TypeServices<T>::CreateDirectInputPip
  */
 template <>
 inline TypeDescriptor TypeDescriptor::Create<int32_t>() noexcept {
-    // You could imagine a more direct version of these that returns a singleton for the common types rather than
-    // creating a new one.
     return _CreateUnsafe<int32_t>();
 }
 
@@ -230,8 +279,6 @@ inline TypeDescriptor TypeDescriptor::Create<std::string>() noexcept {
  */
 template <>
 inline TypeDescriptor TypeDescriptor::Create<Tensor<int32_t>>() noexcept {
-    // You could imagine a more direct version of these that returns a singleton for the common types rather than
-    // creating a new one.
     return _CreateUnsafe<Tensor<int32_t>>();
 }
 
@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "tensor.hpp"
+#include "type_descriptor.hpp"
+
+namespace inference {
+namespace detail {
+
+// Identifies the type of a value in an encoded stream. These are written to files, so must never be renumbered.
+enum class CodecItem : std::uint8_t { Single = 1, Double = 2, Int = 3, Long = 4, String = 5 };
+enum class CodecContainer : std::uint8_t { Scalar = 0, Tensor = 1 };
+
+/**
+ * @brief Encodes values of the types the broker supports into a flat sequence of bytes, and decodes them again. The
+ * encoding is in the byte order of the host, and no alignment is assumed of the encoded bytes.
+ *
+ * Scalar numbers are their bytes, and a string is its length as a uint32_t followed by its characters. A tensor is its
+ * rank as a uint32_t, then its dimensions as uint64_t, then its items encoded as above one after the other. A tensor
+ * with no data, as default constructed, is encoded as the rank NoData alone.
+ */
+template <typename T>
+struct ValueCodec;
+
+template <typename T>
+struct NumberCodec {
+    static constexpr CodecContainer Container = CodecContainer::Scalar;
+
+    static void Encode(T const& value, std::string& out) {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    static bool Decode(char const*& cursor, char const* end, T& value) {
+        if (static_cast<std::size_t>(end - cursor) < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+};
+
+template <>
+struct ValueCodec<float> : NumberCodec<float> {
+    static constexpr CodecItem Item = CodecItem::Single;
+};
+
+template <>
+struct ValueCodec<double> : NumberCodec<double> {
+    static constexpr CodecItem Item = CodecItem::Double;
+};
+
+template <>
+struct ValueCodec<int32_t> : NumberCodec<int32_t> {
+    static constexpr CodecItem Item = CodecItem::Int;
+};
+
+template <>
+struct ValueCodec<int64_t> : NumberCodec<int64_t> {
+    static constexpr CodecItem Item = CodecItem::Long;
+};
+
+template <>
+struct ValueCodec<std::string> {
+    static constexpr CodecItem Item = CodecItem::String;
+    static constexpr CodecContainer Container = CodecContainer::Scalar;
+
+    static void Encode(std::string const& value, std::string& out) {
+        auto length = static_cast<std::uint32_t>(value.size());
+        NumberCodec<std::uint32_t>::Encode(length, out);
+        out.append(value);
+    }
+
+    static bool Decode(char const*& cursor, char const* end, std::string& value) {
+        std::uint32_t length;
+        if (!NumberCodec<std::uint32_t>::Decode(cursor, end, length)) return false;
+        if (static_cast<std::size_t>(end - cursor) < length) return false;
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+template <typename T>
+struct ValueCodec<Tensor<T>> {
+    static constexpr CodecItem Item = ValueCodec<T>::Item;
+    static constexpr CodecContainer Container = CodecContainer::Tensor;
+
+    static constexpr std::uint32_t NoData = UINT32_MAX;
+
+    static void Encode(Tensor<T> const& value, std::string& out) {
+        if (!value.Data()) {
+            NumberCodec<std::uint32_t>::Encode(NoData, out);
+            return;
+        }
+        auto const& dims = value.Dimensions();
+        NumberCodec<std::uint32_t>::Encode(static_cast<std::uint32_t>(dims.size()), out);
+        for (auto dim : dims) NumberCodec<std::uint64_t>::Encode(static_cast<std::uint64_t>(dim), out);
+        auto count = Count(dims);
+        if (std::is_arithmetic<T>::value) {
+            out.append(reinterpret_cast<char const*>(value.Data()), count * sizeof(T));
+        } else {
+            for (std::size_t i = 0; i < count; ++i) ValueCodec<T>::Encode(value.Data()[i], out);
+        }
+    }
+
+    static bool Decode(char const*& cursor, char const* end, Tensor<T>& value) {
+        std::uint32_t rank;
+        if (!NumberCodec<std::uint32_t>::Decode(cursor, end, rank)) return false;
+        if (rank == NoData) {
+            value = Tensor<T>();
+            return true;
+        }
+        if (static_cast<std::size_t>(end - cursor) / sizeof(std::uint64_t) < rank) return false;
+        std::vector<std::size_t> dims(rank);
+        if (!DecodeDimensions(cursor, end, dims)) return false;
+        std::size_t count;
+        if (!CheckedCount(dims, count)) return false;
+        // Every item takes at least a byte, so this rejects absurd sizes before trying to allocate for them.
+        if (static_cast<std::size_t>(end - cursor) < count) return false;
+        std::shared_ptr<T> data(new T[count], std::default_delete<T[]>());
+        if (std::is_arithmetic<T>::value) {
+            if (static_cast<std::size_t>(end - cursor) / sizeof(T) < count) return false;
+            std::memcpy(static_cast<void*>(data.get()), cursor, count * sizeof(T));
+            cursor += count * sizeof(T);
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                if (!ValueCodec<T>::Decode(cursor, end, data.get()[i])) return false;
+            }
+        }
+        value = Tensor<T>(std::move(data), dims);
+        return true;
+    }
+
+    static std::size_t Count(std::vector<std::size_t> const& dims) {
+        std::size_t count = 1;
+        for (auto dim : dims) count *= dim;
+        return count;
+    }
+
+    // Decodes dimensions already known to fit before the end. Fails for those too large for a size_t.
+    static bool DecodeDimensions(char const*& cursor, char const* end, std::vector<std::size_t>& dims) {
+        for (auto& dim : dims) {
+            std::uint64_t encoded;
+            NumberCodec<std::uint64_t>::Decode(cursor, end, encoded);
+            if (encoded > std::numeric_limits<std::size_t>::max()) return false;
+            dim = static_cast<std::size_t>(encoded);
+        }
+        return true;
+    }
+
+    // As Count, for dimensions read from outside. Fails should the product overflow, since crafted dimensions could
+    // otherwise wrap around to a count small enough to pass for the data that follows.
+    static bool CheckedCount(std::vector<std::size_t> const& dims, std::size_t& count) {
+        count = 1;
+        for (auto dim : dims) {
+            if (dim != 0 && count > std::numeric_limits<std::size_t>::max() / dim) return false;
+            count *= dim;
+        }
+        return true;
+    }
+};
+
+template <typename T>
+struct TypeTag {
+    using Type = T;
+};
+
+template <typename... T>
+struct TypeList {};
+
+// Every type with a codec.
+using CodecTypes = TypeList<float, double, int32_t, int64_t, std::string, Tensor<float>, Tensor<double>,
+                            Tensor<int32_t>, Tensor<int64_t>, Tensor<std::string>>;
+
+template <typename F>
+bool VisitCodecType(TypeList<>, TypeDescriptor const&, F&) {
+    return false;
+}
+
+template <typename F, typename T, typename... TRest>
+bool VisitCodecType(TypeList<T, TRest...>, TypeDescriptor const& type, F& visit) {
+    if (type != TypeDescriptor::Create<T>()) return VisitCodecType(TypeList<TRest...>(), type, visit);
+    visit(TypeTag<T>());
+    return true;
+}
+
+template <typename F>
+bool VisitCodecType(TypeList<>, CodecItem, CodecContainer, F&) {
+    return false;
+}
+
+template <typename F, typename T, typename... TRest>
+bool VisitCodecType(TypeList<T, TRest...>, CodecItem item, CodecContainer container, F& visit) {
+    if (ValueCodec<T>::Item != item || ValueCodec<T>::Container != container)
+        return VisitCodecType(TypeList<TRest...>(), item, container, visit);
+    visit(TypeTag<T>());
+    return true;
+}
+
+/**
+ * @brief Calls visit with the TypeTag of the type described, if it is one with a codec, so that code handling values
+ * whose type is only known at runtime can get back to the static type.
+ *
+ * @return Whether the type has a codec, and so whether visit was called.
+ */
+template <typename F>
+bool VisitCodecType(TypeDescriptor const& type, F&& visit) {
+    return VisitCodecType(CodecTypes(), type, visit);
+}
+
+/**
+ * @brief Calls visit with the TypeTag of the type with the codes, if there is one.
+ */
+template <typename F>
+bool VisitCodecType(CodecItem item, CodecContainer container, F&& visit) {
+    return VisitCodecType(CodecTypes(), item, container, visit);
+}
+
+}  // namespace detail
+}  // namespace inference
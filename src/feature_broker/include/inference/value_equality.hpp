@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <inference/tensor.hpp>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace inference {
+namespace detail {
+
+template <typename T, typename = void>
+struct IsEqualityComparable : std::false_type {};
+
+template <typename T>
+struct IsEqualityComparable<T, std::void_t<decltype(std::declval<T const &>() == std::declval<T const &>())>>
+    : std::true_type {};
+
+// Tells whether a value fed to a pipe is the same as the one fed before it, so that feeding it again need not count as
+// a change. Values are compared with their own equality operator.
+template <typename T, bool = IsEqualityComparable<T>::value>
+class ChangeFilter final {
+   public:
+    // Whether the value is the same as the last one, which is null if there was none.
+    bool Repeats(T const *last, T const &value) { return last && *last == value; }
+};
+
+// Values that cannot be compared are never the same.
+template <typename T>
+class ChangeFilter<T, false> final {
+   public:
+    bool Repeats(T const *, T const &) { return false; }
+};
+
+// A tensor may be refilled in place and fed again, in which case the last value shares its data with the new one and
+// comparing the two tells nothing. So instead the filter keeps the dimensions of the last tensor and a hash of its
+// content, and compares those. Two different tensors of the same dimensions are only taken for the same if their
+// hashes collide. The content of trivially copyable elements is hashed as bytes, and that of others, such as strings
+// whose bytes are only pointers to their text, element by element.
+template <typename T>
+class ChangeFilter<Tensor<T>, false> final {
+   public:
+    bool Repeats(Tensor<T> const *last, Tensor<T> const &value) {
+        auto const &dims = value.Dimensions();
+        std::size_t count = value.Data() ? 1 : 0;
+        for (auto dim : dims) count *= dim;
+        auto hash = Hash(value.Data(), count);
+
+        bool repeats = last && _known && hash == _hash && dims == _dims;
+        _known = true;
+        _hash = hash;
+        if (!repeats) _dims = dims;
+        return repeats;
+    }
+
+   private:
+    static std::size_t Hash(T const *data, std::size_t count) {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            return std::hash<std::string_view>()(
+                std::string_view(reinterpret_cast<char const *>(data), count * sizeof(T)));
+        } else {
+            std::size_t hash = count;
+            for (std::size_t i = 0; i < count; ++i)
+                hash ^= std::hash<T>()(data[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+    }
+
+    bool _known{false};
+    std::size_t _hash{0};
+    std::vector<std::size_t> _dims;
+};
+
+// Tells whether the outputs of a model are the same as those last reported to the consumer, within a tolerance for
+// floating point values. Same compares a value with the one last recorded, and Record records a value reported. Unlike
+// ChangeFilter this keeps a copy of what it compares against, since a model may write each output over the last.
+template <typename T>
+class OutputFilter final {
+   public:
+    bool Same(T const &value, double tolerance) const {
+        if constexpr (std::is_floating_point<T>::value) {
+            return _last && std::abs(static_cast<double>(value) - static_cast<double>(*_last)) <= tolerance;
+        } else if constexpr (IsEqualityComparable<T>::value) {
+            return _last && *_last == value;
+        } else {
+            return false;
+        }
+    }
+
+    void Record(T const &value) {
+        if constexpr (std::is_floating_point<T>::value || IsEqualityComparable<T>::value) _last = value;
+    }
+
+   private:
+    std::optional<T> _last;
+};
+
+template <typename T>
+class OutputFilter<Tensor<T>> final {
+   public:
+    bool Same(Tensor<T> const &value, double tolerance) const {
+        if (!_known || value.Dimensions() != _dims || Count(value) != _content.size()) return false;
+        auto data = value.Data();
+        for (std::size_t i = 0; i < _content.size(); ++i) {
+            if constexpr (std::is_floating_point<T>::value) {
+                if (!(std::abs(static_cast<double>(data[i]) - static_cast<double>(_content[i])) <= tolerance))
+                    return false;
+            } else {
+                if (!(data[i] == _content[i])) return false;
+            }
+        }
+        return true;
+    }
+
+    void Record(Tensor<T> const &value) {
+        _known = true;
+        _dims = value.Dimensions();
+        _content.assign(value.Data(), value.Data() + Count(value));
+    }
+
+   private:
+    static std::size_t Count(Tensor<T> const &value) {
+        std::size_t count = value.Data() ? 1 : 0;
+        for (auto dim : value.Dimensions()) count *= dim;
+        return count;
+    }
+
+    bool _known{false};
+    std::vector<std::size_t> _dims;
+    std::vector<T> _content;
+};
+
+// The outputs of a tuple are the same only if each of them is, and when any is not all are recorded, since then the
+// consumer is handed all of them.
+template <typename... T>
+class OutputFilter<std::tuple<T...>> final {
+   public:
+    bool Same(std::tuple<T...> const &value, double tolerance) const {
+        return SameEach(value, tolerance, std::index_sequence_for<T...>());
+    }
+
+    void Record(std::tuple<T...> const &value) { RecordEach(value, std::index_sequence_for<T...>()); }
+
+   private:
+    template <std::size_t... I>
+    bool SameEach(std::tuple<T...> const &value, double tolerance, std::index_sequence<I...>) const {
+        return (std::get<I>(_filters).Same(std::get<I>(value), tolerance) && ...);
+    }
+
+    template <std::size_t... I>
+    void RecordEach(std::tuple<T...> const &value, std::index_sequence<I...>) {
+        (std::get<I>(_filters).Record(std::get<I>(value)), ...);
+    }
+
+    std::tuple<OutputFilter<T>...> _filters;
+};
+
+}  // namespace detail
+}  // namespace inference
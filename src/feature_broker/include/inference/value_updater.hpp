@@ -3,19 +3,71 @@
 
 #pragma once
 
+#include <future>
 #include <string>
 #include <system_error>
+#include <vector>
 
 namespace inference {
 
+class AsyncValueUpdater;
+
 class ValueUpdater {
    public:
     virtual ~ValueUpdater() = default;
     virtual bool Changed() { return true; }
     virtual std::error_code UpdateOutput() = 0;
 
+    /**
+     * @brief This updater as an asynchronous updater, or null if it is not one. This lets the broker tell the two apart
+     * without relying on RTTI.
+     */
+    virtual AsyncValueUpdater* AsAsync() noexcept { return nullptr; }
+
    protected:
     ValueUpdater() = default;
 };
 
+/**
+ * @brief A value updater whose update completes asynchronously, for example a feature provider that must go to a
+ * remote store. The broker starts the updates of all asynchronous updaters an output depends upon before waiting upon
+ * any of them, so that they proceed concurrently, and will start them early where it can, such as when the output is
+ * bound.
+ */
+class AsyncValueUpdater : public ValueUpdater {
+   public:
+    virtual ~AsyncValueUpdater() = default;
+
+    /**
+     * @brief Starts an update. The values should have been fed to the pipes by the time the returned future is ready,
+     * and the future must be valid.
+     */
+    virtual std::future<std::error_code> UpdateOutputAsync() = 0;
+
+    std::error_code UpdateOutput() override { return UpdateOutputAsync().get(); }
+    AsyncValueUpdater* AsAsync() noexcept override final { return this; }
+
+   protected:
+    AsyncValueUpdater() = default;
+};
+
+/**
+ * @brief The pull counterpart of ValueUpdater, for feature providers that would rather compute only what is asked of
+ * them. Rather than publishing everything whenever asked, the updater is told which of its outputs are stale, meaning
+ * the provider reported them changed and they have not been published since, and publishes only those.
+ */
+class PullValueUpdater {
+   public:
+    virtual ~PullValueUpdater() = default;
+
+    /**
+     * @param staleOutputs Indices into the outputs the updater was created with, for those outputs that should have
+     * fresh values fed into their pipes. This is never empty.
+     */
+    virtual std::error_code UpdateOutputs(std::vector<std::size_t> const& staleOutputs) = 0;
+
+   protected:
+    PullValueUpdater() = default;
+};
+
 }  // namespace inference
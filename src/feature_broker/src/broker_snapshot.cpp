@@ -0,0 +1,294 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <inference/broker_snapshot.hpp>
+#include <inference/value_codec.hpp>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+#ifndef _WIN32
+#include <errno.h>
+#endif
+
+namespace inference {
+
+// The snapshot is a header followed by its entries one after the other. Everything is in the byte order of the host
+// that saved it. The header is the magic, the version, and the number of entries. Each entry is the length of its name,
+// the item and container codes of its type, where it came from, a reserved byte, and the length of its value, followed
+// by the name and then the value. Values are as encoded by detail::ValueCodec, save for tensors of numbers: those have
+// zero padding between their dimensions and their data, so that their data starts at an offset into the file that is
+// a multiple of TensorAlignment, and can be used in place once the file is mapped.
+namespace {
+constexpr char SnapshotMagic[8] = {'F', 'B', 'S', 'N', 'A', 'P', 'S', 'H'};
+constexpr std::uint32_t SnapshotVersion = 1;
+constexpr std::size_t HeaderSize = sizeof(SnapshotMagic) + 2 * sizeof(std::uint32_t);
+constexpr std::size_t EntryHeaderSize = sizeof(std::uint32_t) + 4 + sizeof(std::uint64_t);
+constexpr std::size_t TensorAlignment = 64;
+
+enum class Origin : std::uint8_t { Input = 0, Provider = 1 };
+
+std::error_code CorruptSnapshot() { return std::make_error_code(std::errc::illegal_byte_sequence); }
+
+std::error_code LastSystemError() { return std::error_code(errno, std::system_category()); }
+
+// How values are laid out in the snapshot. The encoding appends to the whole of the snapshot, so that the offset of
+// what it appends into the file is known.
+template <typename T, typename Enable = void>
+struct SnapshotCodec {
+    static void Encode(T const& value, std::string& snapshot) { detail::ValueCodec<T>::Encode(value, snapshot); }
+
+    static bool Decode(char const* begin, char const* end, std::shared_ptr<detail::MappedFile> const&, T& value) {
+        return detail::ValueCodec<T>::Decode(begin, end, value) && begin == end;
+    }
+};
+
+template <typename T>
+struct SnapshotCodec<Tensor<T>, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+    using Codec = detail::ValueCodec<Tensor<T>>;
+
+    static void Encode(Tensor<T> const& value, std::string& snapshot) {
+        if (!value.Data()) {
+            detail::NumberCodec<std::uint32_t>::Encode(Codec::NoData, snapshot);
+            return;
+        }
+        auto const& dims = value.Dimensions();
+        detail::NumberCodec<std::uint32_t>::Encode(static_cast<std::uint32_t>(dims.size()), snapshot);
+        for (auto dim : dims) detail::NumberCodec<std::uint64_t>::Encode(static_cast<std::uint64_t>(dim), snapshot);
+        snapshot.append(Padding(snapshot.size()), '\0');
+        snapshot.append(reinterpret_cast<char const*>(value.Data()), Codec::Count(dims) * sizeof(T));
+    }
+
+    static bool Decode(char const* begin, char const* end, std::shared_ptr<detail::MappedFile> const& file,
+                       Tensor<T>& value) {
+        std::uint32_t rank;
+        if (!detail::NumberCodec<std::uint32_t>::Decode(begin, end, rank)) return false;
+        if (rank == Codec::NoData) {
+            value = Tensor<T>();
+            return begin == end;
+        }
+        if (static_cast<std::size_t>(end - begin) / sizeof(std::uint64_t) < rank) return false;
+        std::vector<std::size_t> dims(rank);
+        if (!Codec::DecodeDimensions(begin, end, dims)) return false;
+        auto padding = Padding(static_cast<std::size_t>(begin - file->Data()));
+        if (static_cast<std::size_t>(end - begin) < padding) return false;
+        begin += padding;
+        std::size_t count;
+        if (!Codec::CheckedCount(dims, count)) return false;
+        if (static_cast<std::size_t>(end - begin) / sizeof(T) != count ||
+            static_cast<std::size_t>(end - begin) % sizeof(T) != 0)
+            return false;
+        // The tensor refers to the mapping, and keeps it open for as long as it does.
+        value = Tensor<T>(std::shared_ptr<T>(file, reinterpret_cast<T*>(const_cast<char*>(begin))), dims);
+        return true;
+    }
+
+    static std::size_t Padding(std::size_t offset) {
+        return (TensorAlignment - offset % TensorAlignment) % TensorAlignment;
+    }
+};
+
+template <typename T>
+void Put(std::string& snapshot, std::size_t offset, T const& value) {
+    std::memcpy(&snapshot[offset], &value, sizeof(T));
+}
+}  // namespace
+
+template <typename T>
+class BrokerSnapshot::Entry final {
+   public:
+    // A pipe of this type for providers to feed their outputs to when the snapshot is saved.
+    static std::shared_ptr<InputPipe> CreateSink() {
+        return std::make_shared<typename DirectInputPipe<T>::SyncSingleConsumer>();
+    }
+
+    // Appends an entry with the value last fed to the pipe, if it has one. The type alone does not tell a direct pipe
+    // from a stream pipe, whose type is that of the tensors it batches its events into, and which has no last value.
+    static bool Save(InputPipe& pipe, std::string const& name, Origin origin, std::string& snapshot) {
+        auto direct = dynamic_cast<DirectInputPipe<T>*>(&pipe);
+        T value;
+        if (!direct || !direct->LastFed(value)) return false;
+        auto start = snapshot.size();
+        snapshot.append(EntryHeaderSize, '\0');
+        Put(snapshot, start, static_cast<std::uint32_t>(name.size()));
+        snapshot[start + 4] = static_cast<char>(detail::ValueCodec<T>::Item);
+        snapshot[start + 5] = static_cast<char>(detail::ValueCodec<T>::Container);
+        snapshot[start + 6] = static_cast<char>(origin);
+        snapshot.append(name);
+        auto valueStart = snapshot.size();
+        SnapshotCodec<T>::Encode(value, snapshot);
+        Put(snapshot, start + 8, static_cast<std::uint64_t>(snapshot.size() - valueStart));
+        return true;
+    }
+
+    // Feeds the value to the pipe bound under the name, binding one if there is none.
+    static rt::expected<void> Restore(FeatureBroker& broker, std::string const& name, std::shared_ptr<InputPipe> bound,
+                                      char const* begin, char const* end,
+                                      std::shared_ptr<detail::MappedFile> const& file) {
+        T value;
+        if (!SnapshotCodec<T>::Decode(begin, end, file, value)) return tl::make_unexpected(CorruptSnapshot());
+        std::shared_ptr<DirectInputPipe<T>> pipe;
+        if (bound) {
+            pipe = std::dynamic_pointer_cast<DirectInputPipe<T>>(bound);
+            if (!pipe || bound->Type() != TypeDescriptor::Create<T>())
+                return make_feature_unexpected(feature_errc::type_mismatch);
+        } else {
+            auto pipeExpected = broker.BindInput<T>(name);
+            if (!pipeExpected) return tl::make_unexpected(pipeExpected.error());
+            pipe = std::move(pipeExpected).value();
+        }
+        pipe->Feed(std::move(value));
+        return {};
+    }
+};
+
+BrokerSnapshot::BrokerSnapshot(std::shared_ptr<detail::MappedFile> file) : _file(std::move(file)) {}
+
+BrokerSnapshot::~BrokerSnapshot() = default;
+
+rt::expected<std::size_t> BrokerSnapshot::Save(FeatureBroker const& broker, std::string const& path) {
+    std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> inputs;
+    std::map<std::shared_ptr<FeatureProvider>, std::vector<std::string>> providers;
+    broker._bindings.ForEach(
+        [&inputs](std::string const& name, std::shared_ptr<InputPipe> const& pipe) { inputs.emplace_back(name, pipe); },
+        [&providers](std::string const& name, std::shared_ptr<FeatureProvider> const& provider) {
+            providers[provider].push_back(name);
+        });
+    // The table is visited in the order of its shards, so sort to keep the entries in the order of their names.
+    std::sort(inputs.begin(), inputs.end(),
+              [](auto const& left, auto const& right) { return left.first < right.first; });
+    for (auto& pair : providers) std::sort(pair.second.begin(), pair.second.end());
+
+    std::string snapshot(HeaderSize, '\0');
+    std::uint32_t count = 0;
+    for (auto const& input : inputs) {
+        auto save = [&](auto tag) {
+            using T = typename decltype(tag)::Type;
+            if (Entry<T>::Save(*input.second, input.first, Origin::Input, snapshot)) ++count;
+        };
+        detail::VisitCodecType(input.second->Type(), save);
+    }
+
+    for (auto const& pair : providers) {
+        auto const& provider = pair.first;
+        std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> sinks;
+        for (auto const& name : pair.second) {
+            auto output = provider->Outputs().find(name);
+            if (output == provider->Outputs().end()) continue;
+            auto create = [&](auto tag) {
+                using T = typename decltype(tag)::Type;
+                sinks.emplace_back(name, Entry<T>::CreateSink());
+            };
+            detail::VisitCodecType(output->second, create);
+        }
+        if (sinks.empty()) continue;
+
+        // Ask for the outputs the same way a bound output would, preferring the pull updater if there is one.
+        auto pullExpected = provider->CreatePullValueUpdater(sinks, [](std::size_t) {});
+        if (!pullExpected) return tl::make_unexpected(pullExpected.error());
+        if (auto& pull = pullExpected.value()) {
+            std::vector<std::size_t> all(sinks.size());
+            for (std::size_t i = 0; i < all.size(); ++i) all[i] = i;
+            if (auto error = pull->UpdateOutputs(all)) return tl::make_unexpected(error);
+        } else {
+            std::map<std::string, std::shared_ptr<InputPipe>> outputToPipe(sinks.begin(), sinks.end());
+            auto updaterExpected = provider->CreateValueUpdater(outputToPipe, []() {});
+            if (!updaterExpected) return tl::make_unexpected(updaterExpected.error());
+            if (auto error = updaterExpected.value()->UpdateOutput()) return tl::make_unexpected(error);
+        }
+
+        for (auto const& sink : sinks) {
+            auto save = [&](auto tag) {
+                using T = typename decltype(tag)::Type;
+                if (Entry<T>::Save(*sink.second, sink.first, Origin::Provider, snapshot)) ++count;
+            };
+            detail::VisitCodecType(sink.second->Type(), save);
+        }
+    }
+
+    std::memcpy(&snapshot[0], SnapshotMagic, sizeof(SnapshotMagic));
+    Put(snapshot, sizeof(SnapshotMagic), SnapshotVersion);
+    Put(snapshot, sizeof(SnapshotMagic) + sizeof(SnapshotVersion), count);
+
+    auto temporaryPath = path + ".tmp";
+    auto file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) return tl::make_unexpected(LastSystemError());
+    bool written = std::fwrite(snapshot.data(), 1, snapshot.size(), file) == snapshot.size();
+    auto error = written ? std::error_code() : LastSystemError();
+    if (std::fclose(file) != 0 && !error) error = LastSystemError();
+#ifdef _WIN32
+    // Unlike POSIX, renaming over an existing file fails here.
+    if (!error) std::remove(path.c_str());
+#endif
+    if (!error && std::rename(temporaryPath.c_str(), path.c_str()) != 0) error = LastSystemError();
+    if (error) {
+        std::remove(temporaryPath.c_str());
+        return tl::make_unexpected(error);
+    }
+    return count;
+}
+
+rt::expected<std::shared_ptr<BrokerSnapshot>> BrokerSnapshot::Open(std::string const& path) {
+    auto fileExpected = detail::MappedFile::Open(path, detail::MappedFile::Access::CopyOnWrite,
+                                                 detail::MappedFile::Pattern::Sequential);
+    if (!fileExpected) return tl::make_unexpected(fileExpected.error());
+    auto& file = *fileExpected;
+    if (file->Size() < HeaderSize || std::memcmp(file->Data(), SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+        return tl::make_unexpected(CorruptSnapshot());
+    std::uint32_t version;
+    std::memcpy(&version, file->Data() + sizeof(SnapshotMagic), sizeof(version));
+    if (version != SnapshotVersion) return tl::make_unexpected(CorruptSnapshot());
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<BrokerSnapshot>(new BrokerSnapshot(std::move(file)));
+}
+
+rt::expected<std::size_t> BrokerSnapshot::Restore(FeatureBroker& broker) const {
+    char const* cursor = _file->Data() + sizeof(SnapshotMagic) + sizeof(SnapshotVersion);
+    char const* end = _file->Data() + _file->Size();
+    std::uint32_t count;
+    detail::NumberCodec<std::uint32_t>::Decode(cursor, end, count);
+
+    std::size_t fed = 0;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (static_cast<std::size_t>(end - cursor) < EntryHeaderSize) return tl::make_unexpected(CorruptSnapshot());
+        std::uint32_t nameLength;
+        std::uint64_t valueLength;
+        std::memcpy(&nameLength, cursor, sizeof(nameLength));
+        auto item = static_cast<detail::CodecItem>(cursor[4]);
+        auto container = static_cast<detail::CodecContainer>(cursor[5]);
+        std::memcpy(&valueLength, cursor + 8, sizeof(valueLength));
+        cursor += EntryHeaderSize;
+        if (static_cast<std::size_t>(end - cursor) < nameLength ||
+            static_cast<std::size_t>(end - cursor) - nameLength < valueLength)
+            return tl::make_unexpected(CorruptSnapshot());
+        std::string name(cursor, nameLength);
+        char const* value = cursor + nameLength;
+        cursor = value + valueLength;
+
+        // A live provider supersedes whatever value the snapshot has.
+        if (broker._bindings.FindProvider(name)) continue;
+        auto bound = broker._bindings.FindInput(name);
+
+        rt::expected<void> restored = tl::make_unexpected(CorruptSnapshot());
+        auto restore = [&](auto tag) {
+            using T = typename decltype(tag)::Type;
+            restored = Entry<T>::Restore(broker, name, std::move(bound), value, cursor, _file);
+        };
+        detail::VisitCodecType(item, container, restore);
+        if (!restored) return tl::make_unexpected(restored.error());
+        ++fed;
+    }
+    return fed;
+}
+
+}  // namespace inference
@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <inference/deadline.hpp>
+
+namespace {
+thread_local inference::Deadline currentDeadline = inference::NoDeadline;
+}  // namespace
+
+namespace inference {
+
+Deadline CurrentDeadline() noexcept { return currentDeadline; }
+
+detail::DeadlineScope::DeadlineScope(Deadline deadline) noexcept : _previous(currentDeadline) {
+    currentDeadline = deadline;
+}
+
+detail::DeadlineScope::~DeadlineScope() { currentDeadline = _previous; }
+
+}  // namespace inference
@@ -1,47 +1,103 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+#include <algorithm>
 #include <inference/feature_broker.hpp>
-
-namespace {
-// Because SetParent can introduce non-local looping structures, in order to make FeatureBroker::SetParent concurrency
-// safe, we actually want a more-or-less global exclusive lock for SetParent to be held. Attempting to rely on the local
-// locks to each feature broker too easily results in deadlocks. If we did not have to check for loops on parentage.
-std::mutex setParentMutex;
-
-}  // namespace
+#include <unordered_set>
+#include <vector>
 
 namespace inference {
 
-FeatureBroker::FeatureBroker(std::shared_ptr<const Model> model) : FeatureBrokerBase(model) {}
+FeatureBroker::FeatureBroker(std::shared_ptr<const Model> model, std::pmr::memory_resource* resource)
+    : FeatureBrokerBase(model, resource) {}
 
 FeatureBroker::~FeatureBroker() {}
 
-FeatureBroker::FeatureBroker(std::shared_ptr<const FeatureBroker> parent, std::shared_ptr<const Model> model)
-    : FeatureBrokerBase(model), _parent(std::move(parent)) {}
+// Forks share the binding plan cache of the broker they were forked from, since forks of the same broker tend to bind
+// the same outputs of the same models.
+FeatureBroker::FeatureBroker(std::shared_ptr<const FeatureBroker> parent, std::shared_ptr<const Model> model,
+                             std::pmr::memory_resource* resource)
+    : FeatureBrokerBase(model, parent->_planCache, resource), _parent(std::move(parent)) {}
 
-rt::expected<std::shared_ptr<FeatureBroker>> FeatureBroker::Fork(std::shared_ptr<const Model> model) const {
+rt::expected<std::shared_ptr<FeatureBroker>> FeatureBroker::Fork(std::shared_ptr<const Model> model,
+                                                                 std::pmr::memory_resource* resource) const {
     if (model) {
-        std::shared_lock<std::shared_mutex> localLock(_inputMutex);
+        auto localLock = LockForLookup(true);
         for (auto pair : model->Inputs()) {
             auto existingType = GetBindingType(pair.first, false);
             if (!existingType) continue;
             if (existingType.value() != pair.second) return make_feature_unexpected(feature_errc::type_mismatch);
         }
     }
-    return std::shared_ptr<FeatureBroker>(new FeatureBroker(shared_from_this(), std::move(model)));
+    if (!resource) resource = _resource;
+    // The constructor is private, so allocate_shared cannot be used. The fork is constructed in memory from the
+    // resource instead, and its control block allocated from there too.
+    std::pmr::polymorphic_allocator<FeatureBroker> allocator(resource);
+    auto memory = allocator.allocate(1);
+    try {
+        new (memory) FeatureBroker(shared_from_this(), std::move(model), resource);
+    } catch (...) {
+        allocator.deallocate(memory, 1);
+        throw;
+    }
+    return std::shared_ptr<FeatureBroker>(
+        memory,
+        [resource](FeatureBroker* fork) {
+            fork->~FeatureBroker();
+            std::pmr::polymorphic_allocator<FeatureBroker>(resource).deallocate(fork, 1);
+        },
+        allocator);
 }
 
 rt::expected<void> FeatureBroker::SetParent(std::shared_ptr<const FeatureBroker> newParent) {
     // In this trivial case, we consider this a no-op.
     if (newParent.get() == this) return {};
 
-    std::unique_lock<std::mutex> globalLock(::setParentMutex);
+    // Two calls could each introduce half of a loop that neither sees alone, should one reparent a broker the other
+    // changes the ancestry of or depends on for its own. So this broker's parent lock is held exclusively, and those of
+    // its new ancestors shared, so that none of them can be reparented meanwhile. They are taken in the order of their
+    // addresses, so that calls cannot deadlock. Calls in unrelated trees, or that merely share ancestors, do not wait
+    // on one another, as they would on a single lock for the whole process.
+    std::vector<std::shared_ptr<const FeatureBroker>> ancestors;
+    std::vector<FeatureBroker const*> lockOrder;
+    std::unique_lock<std::shared_mutex> parentLock(_parentMutex, std::defer_lock);
+    std::vector<std::shared_lock<std::shared_mutex>> ancestorLocks;
+    for (bool stable = false; !stable;) {
+        ancestors.clear();
+        for (auto ancestor = newParent; ancestor;) {
+            ancestors.push_back(ancestor);
+            std::shared_lock<std::shared_mutex> ancestorLock(ancestor->_parentMutex);
+            ancestor = ancestor->_parent;
+        }
+        lockOrder.clear();
+        lockOrder.push_back(this);
+        for (auto const& ancestor : ancestors) {
+            if (ancestor.get() != this) lockOrder.push_back(ancestor.get());
+        }
+        std::sort(lockOrder.begin(), lockOrder.end());
+        for (auto broker : lockOrder) {
+            if (broker == this)
+                parentLock.lock();
+            else
+                ancestorLocks.emplace_back(broker->_parentMutex);
+        }
+        // The ancestry was read a link at a time, so it may have changed before the locks were all taken.
+        stable = true;
+        for (std::size_t i = 0; i < ancestors.size(); ++i) {
+            std::shared_ptr<const FeatureBroker> next = i + 1 < ancestors.size() ? ancestors[i + 1] : nullptr;
+            if (ancestors[i]->_parent != next) stable = false;
+        }
+        if (stable) break;
+        ancestorLocks.clear();
+        parentLock.unlock();
+    }
+
     std::unique_lock<std::shared_mutex> lock(_inputMutex);
+    if (_frozen.load(std::memory_order_relaxed)) return make_feature_unexpected(feature_errc::frozen);
 
     // Ensure no cycles, that is, that this object is never an ancestor. The only way that a cycle can be introduced is
     // if the new parent has as an ancestor this object.
-    for (auto newAncestor = newParent; newAncestor; newAncestor = newAncestor->_parent) {
+    for (auto const& newAncestor : ancestors) {
         if (newAncestor.get() == this) return make_feature_unexpected(feature_errc::circular_structure);
     }
     // We need to ensure there are no inconsistencies in its or our already bound inputs with our model; that is, if we
@@ -49,12 +105,13 @@ rt::expected<void> FeatureBroker::SetParent(std::shared_ptr<const FeatureBroker>
     if (newParent) {
         // Make sure there are no conflicting bindings. Note that we should not use the convenience functions directly
         // since they will traverse the existing hierarchy, and that may change.
-        for (const auto& namePipe : _boundInputs) {
-            if (newParent->GetBindingType(namePipe.first)) return make_feature_unexpected(feature_errc::already_bound);
-        }
-        for (const auto& nameProvider : _boundInputsFromProviders) {
-            if (newParent->GetBindingType(nameProvider.first)) return make_feature_unexpected(feature_errc::already_bound);
-        }
+        // Binds hold the input lock shared, so none are under way while it is held here.
+        bool conflict = false;
+        auto check = [&newParent, &conflict](std::string const& name, auto const&) {
+            if (!conflict && newParent->GetBindingType(name)) conflict = true;
+        };
+        _bindings.ForEach(check, check);
+        if (conflict) return make_feature_unexpected(feature_errc::already_bound);
         // Now that we've verified there are no bind conflicts, check the model inputs, if we have a local model. Note
         // that for the same reasons as elsewhere we don't use the GetModelOrNull accessors since that will traverse the
         // existing hierarchy, which we are (in principle) about to replace.
@@ -89,24 +146,67 @@ rt::expected<void> FeatureBroker::SetParent(std::shared_ptr<const FeatureBroker>
     return {};
 }
 
+rt::expected<void> FeatureBroker::SwapModel(std::shared_ptr<const Model> model) {
+    if (!model) return make_feature_unexpected(feature_errc::invalid_model);
+    std::unique_lock<std::shared_mutex> lock(_inputMutex);
+    if (_frozen.load(std::memory_order_relaxed)) return make_feature_unexpected(feature_errc::frozen);
+    if (!_model) return make_feature_unexpected(feature_errc::no_model_associated);
+
+    for (const auto& nameType : _model->Outputs()) {
+        auto found = model->Outputs().find(nameType.first);
+        if (found == model->Outputs().end()) return make_feature_unexpected(feature_errc::name_not_found);
+        if (found->second != nameType.second) return make_feature_unexpected(feature_errc::type_mismatch);
+
+        // Pipes already bound have handles for exactly the old requirements, so the new ones can be no more than that.
+        auto oldRequirements = _model->GetRequirements(nameType.first);
+        std::unordered_set<std::string> allowed(oldRequirements.begin(), oldRequirements.end());
+        for (const auto& requirement : model->GetRequirements(nameType.first)) {
+            if (!allowed.count(requirement)) return make_feature_unexpected(feature_errc::not_bound);
+        }
+    }
+    for (const auto& nameType : model->Inputs()) {
+        auto found = _model->Inputs().find(nameType.first);
+        if (found != _model->Inputs().end() && found->second != nameType.second)
+            return make_feature_unexpected(feature_errc::type_mismatch);
+        auto typeExpected = GetBindingType(nameType.first, false);
+        if (typeExpected && typeExpected.value() != nameType.second)
+            return make_feature_unexpected(feature_errc::type_mismatch);
+    }
+
+    _model = std::move(model);
+    PublishModel();
+    return {};
+}
+
+void FeatureBroker::Freeze() {
+    // Waits out any bind, reparenting or swap under way, after which there can be no more.
+    std::unique_lock<std::shared_mutex> lock(_inputMutex);
+    _bindings.Freeze();
+    FreezeModel();
+    _frozen.store(true, std::memory_order_release);
+}
+
 std::shared_ptr<const Model> FeatureBroker::GetModelOrNull(bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
+    auto localLock = LockForLookup(lock);
     if (_model || !_parent) return _model;
     return _parent->GetModelOrNull();
 }
 
+std::shared_ptr<FeatureBrokerBase::ModelSlot> FeatureBroker::GetModelSlot(bool lock) const {
+    auto localLock = LockForLookup(lock);
+    if (_model || !_parent) return _modelSlot;
+    return _parent->GetModelSlot();
+}
+
 std::shared_ptr<InputPipe> FeatureBroker::GetBindingOrNull(std::string const& name, bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
+    auto localLock = LockForLookup(lock);
     auto inputPipe = FeatureBrokerBase::GetBindingOrNull(name, false);
     if (inputPipe || !_parent) return inputPipe;
     return _parent->GetBindingOrNull(name);
 }
 
 std::shared_ptr<FeatureProvider> FeatureBroker::GetProviderOrNull(std::string const& name, bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
+    auto localLock = LockForLookup(lock);
     auto provider = FeatureBrokerBase::GetProviderOrNull(name, false);
     if (provider || !_parent) return provider;
     return _parent->GetProviderOrNull(name);
@@ -1,14 +1,246 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <inference/feature_broker.hpp>
 #include <mutex>
+#include <utility>
 
 namespace inference {
 
-static bool HandleChanged(std::shared_ptr<const IHandle> const& handle) { return handle->Changed(); }
-static bool UpdaterChanged(std::shared_ptr<ValueUpdater> const& updater) { return updater->Changed(); }
+static bool HandleChanged(const IHandle* handle) { return handle->Changed(); }
+
+/**
+ * A compiled binding plan for a particular model and ordered list of output names. The requirements portion of the plan
+ * is immutable once compiled. The topology portion records how the requirements were resolved the last time the plan
+ * was used, so that a subsequent bind that resolves them the same way can skip the type checks and the grouping of
+ * inputs by provider.
+ */
+class FeatureBrokerBase::BindingPlan final {
+   public:
+    struct Input {
+        std::string Name;
+        TypeDescriptor Type;
+    };
+
+    /**
+     * The resolution of the plan's inputs. Each input is bound either by a pipe or by a provider, and the provider
+     * inputs are additionally grouped by provider, since each provider gets one updater over all the inputs requested
+     * of it. This is keyed on the structure of the resolution rather than on the pipes themselves, since every fork
+     * that binds its own inputs has pipes of its own, but they are all used the same way. So only the providers are
+     * recorded, with an empty reference for an input bound by a pipe. Only weak references are held, so that a cached
+     * plan does not extend the lifetime of anything it describes.
+     */
+    class Topology final {
+       public:
+        std::vector<std::weak_ptr<FeatureProvider>> Providers;
+        std::vector<std::vector<std::size_t>> ProviderGroups;
+
+        // Every input resolves to either a pipe or a provider, so an input without a provider has a pipe, whose type
+        // must still be checked since it is not part of the key.
+        bool Matches(std::vector<Input> const& inputs, std::vector<std::shared_ptr<InputPipe>> const& pipes,
+                     std::vector<std::shared_ptr<FeatureProvider>> const& providers) const noexcept {
+            for (std::size_t i = 0; i < Providers.size(); ++i) {
+                if (!SameOwner(Providers[i], providers[i])) return false;
+                if (!providers[i] && pipes[i]->Type() != inputs[i].Type) return false;
+            }
+            return true;
+        }
+
+       private:
+        // Comparison by owner rather than by address, so that an object that has since been destroyed and had its
+        // address reused by some new object is not mistaken for the original.
+        template <typename T>
+        static bool SameOwner(std::weak_ptr<T> const& weak, std::shared_ptr<T> const& strong) noexcept {
+            return !weak.owner_before(strong) && !strong.owner_before(weak);
+        }
+    };
+
+    BindingPlan(std::shared_ptr<const Model> const& model, std::vector<std::string> const& outputNames,
+                bool fixedTopology = false)
+        : PlannedModel(model), OutputNames(outputNames), FixedTopology(fixedTopology) {}
+
+    bool IsFor(std::shared_ptr<const Model> const& model, std::vector<std::string> const& outputNames) const noexcept {
+        return !PlannedModel.owner_before(model) && !model.owner_before(PlannedModel) && OutputNames == outputNames;
+    }
+
+    std::shared_ptr<const Topology> GetTopology() const {
+        if (FixedTopology) return _topologySet.load(std::memory_order_acquire) ? _topology : nullptr;
+        std::lock_guard<std::mutex> lock(_topologyMutex);
+        return _topology;
+    }
+
+    void SetTopology(std::shared_ptr<const Topology> topology) {
+        if (FixedTopology) {
+            // Only the first topology is kept, and since it never changes after, it is read without the lock.
+            if (_topologyClaimed.exchange(true, std::memory_order_acq_rel)) return;
+            _topology = std::move(topology);
+            _topologySet.store(true, std::memory_order_release);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_topologyMutex);
+        _topology = std::move(topology);
+    }
+
+    const std::weak_ptr<const Model> PlannedModel;
+    const std::vector<std::string> OutputNames;
+    // The union of the requirements of all outputs without duplicates, in the order they were first required.
+    std::vector<Input> Inputs;
+    std::vector<TypeDescriptor> OutputTypes;
+    // Plans for the model of a frozen broker are bound through by many forks at once, so rather than take a lock to
+    // read a topology that keeps being replaced, they keep the first one set.
+    const bool FixedTopology;
+
+   private:
+    mutable std::mutex _topologyMutex;
+    std::atomic<bool> _topologyClaimed{false};
+    std::atomic<bool> _topologySet{false};
+    std::shared_ptr<const Topology> _topology;
+};
+
+class FeatureBrokerBase::BindingPlanCache final {
+   public:
+    std::shared_ptr<BindingPlan> Find(std::shared_ptr<const Model> const& model,
+                                      std::vector<std::string> const& outputNames) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _plans.find(model.get());
+        if (found == _plans.end()) return {};
+        for (auto const& plan : found->second) {
+            if (plan->IsFor(model, outputNames)) return plan;
+        }
+        return {};
+    }
+
+    void Store(std::shared_ptr<BindingPlan> plan, std::shared_ptr<const Model> const& model) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Plans for models that no longer exist can never be used again. Since storing is comparatively rare, this is a
+        // reasonable time to sweep those out.
+        for (auto iter = _plans.begin(); iter != _plans.end();) {
+            auto& plans = iter->second;
+            plans.erase(std::remove_if(plans.begin(), plans.end(),
+                                       [](std::shared_ptr<BindingPlan> const& p) { return p->PlannedModel.expired(); }),
+                        plans.end());
+            iter = plans.empty() ? _plans.erase(iter) : std::next(iter);
+        }
+        auto& plans = _plans[model.get()];
+        for (auto& existing : plans) {
+            if (existing->IsFor(model, plan->OutputNames)) {
+                existing = std::move(plan);
+                return;
+            }
+        }
+        plans.push_back(std::move(plan));
+    }
+
+   private:
+    mutable std::mutex _mutex;
+    std::unordered_map<const Model*, std::vector<std::shared_ptr<BindingPlan>>> _plans;
+};
+
+class FeatureBrokerBase::ModelSlot final {
+   public:
+    ModelSlot(std::shared_ptr<const Model> model, std::pmr::memory_resource* resource)
+        : _model(std::move(model)), _resource(resource) {}
+
+    ~ModelSlot() {
+        for (auto node = _frozenPlans.load(std::memory_order_relaxed); node;) delete std::exchange(node, node->Next);
+    }
+
+    // That of the broker the slot belongs to. The waiters it watches are allocated from this rather than from the
+    // resource of the fork binding the output, since the slot may well outlive that fork.
+    std::pmr::memory_resource* Resource() const noexcept { return _resource; }
+
+    // This is the only thing read on the update path, so it is just a relaxed load. Whoever sees it change reads the
+    // model itself through Current, which synchronizes through the mutex.
+    std::uint64_t Generation() const noexcept { return _generation.load(std::memory_order_relaxed); }
+
+    std::pair<std::shared_ptr<const Model>, std::uint64_t> Current() const {
+        if (Frozen()) return {_model, _generation.load(std::memory_order_relaxed)};
+        std::lock_guard<std::mutex> lock(_mutex);
+        return {_model, _generation.load(std::memory_order_relaxed)};
+    }
+
+    // Called as the broker the slot belongs to is frozen, after which its model can no longer be swapped. The model is
+    // then read without the lock, and there is nothing for waiters to be woken up for.
+    void Freeze() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::weak_ptr<InputPipe::OutputWaiter>>().swap(_waiters);
+        _frozen.store(true, std::memory_order_release);
+    }
+
+    bool Frozen() const noexcept { return _frozen.load(std::memory_order_acquire); }
+
+    // Once frozen, the plans for the slot's model are kept here rather than in the cache shared by the whole tree of
+    // brokers, so that forks binding through a frozen broker do not all contend on the cache's lock. The model never
+    // changes, so plans are only ever added, to a list that is read without locking.
+    std::shared_ptr<BindingPlan> FindFrozenPlan(std::vector<std::string> const& outputNames) const {
+        for (auto node = _frozenPlans.load(std::memory_order_acquire); node; node = node->Next) {
+            if (node->Plan->OutputNames == outputNames) return node->Plan;
+        }
+        return {};
+    }
+
+    // Two forks binding the same outputs at once may each add a plan. The one added later is never found, which is
+    // harmless.
+    void StoreFrozenPlan(std::shared_ptr<BindingPlan> plan) {
+        auto node = new FrozenPlan{std::move(plan), _frozenPlans.load(std::memory_order_relaxed)};
+        while (!_frozenPlans.compare_exchange_weak(node->Next, node, std::memory_order_release,
+                                                   std::memory_order_relaxed)) {
+        }
+    }
+
+    // Registers the waiter of an output pipe, so that a consumer blocked waiting on it wakes up to notice a swap.
+    void Watch(std::weak_ptr<InputPipe::OutputWaiter> waiter) {
+        if (Frozen()) return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Pipes come and go far more often than models are swapped, and an expired weak pointer still holds on to the
+        // memory of its waiter. So sweep those out whenever the list has doubled since last time.
+        if (_waiters.size() >= _sweepAt) {
+            _waiters.erase(std::remove_if(_waiters.begin(), _waiters.end(),
+                                          [](std::weak_ptr<InputPipe::OutputWaiter> const& w) { return w.expired(); }),
+                           _waiters.end());
+            _sweepAt = std::max<std::size_t>(16, 2 * _waiters.size());
+        }
+        _waiters.push_back(std::move(waiter));
+    }
+
+    void Publish(std::shared_ptr<const Model> model) {
+        std::vector<std::shared_ptr<InputPipe::OutputWaiter>> toPing;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _model = std::move(model);
+            _generation.fetch_add(1, std::memory_order_relaxed);
+            for (auto iter = _waiters.begin(); iter != _waiters.end();) {
+                if (auto waiter = iter->lock()) {
+                    toPing.push_back(std::move(waiter));
+                    ++iter;
+                } else {
+                    iter = _waiters.erase(iter);
+                }
+            }
+        }
+        for (auto& waiter : toPing) waiter->Ping(true);
+    }
+
+   private:
+    mutable std::mutex _mutex;
+    std::shared_ptr<const Model> _model;
+    std::atomic<std::uint64_t> _generation{0};
+    std::vector<std::weak_ptr<InputPipe::OutputWaiter>> _waiters;
+    std::size_t _sweepAt{16};
+    std::pmr::memory_resource* const _resource;
+    std::atomic<bool> _frozen{false};
+
+    struct FrozenPlan {
+        std::shared_ptr<BindingPlan> Plan;
+        FrozenPlan* Next;
+    };
+    std::atomic<FrozenPlan*> _frozenPlans{nullptr};
+};
 
 std::error_code FeatureBrokerBase::CheckInputOk(std::string const& name,
                                                 rt::expected<TypeDescriptor> const& typeDescriptorExpected) const
@@ -48,13 +280,43 @@ std::error_code FeatureBrokerBase::CheckModelOutput(std::string const& name,
 }
 
 // Pass by const ref because these were already passed by value in the derived classes.
-FeatureBrokerBase::FeatureBrokerBase(std::shared_ptr<const Model> model) : _model(std::move(model)) {}
+FeatureBrokerBase::FeatureBrokerBase(std::shared_ptr<const Model> model, std::pmr::memory_resource* resource)
+    : _bindings(true),
+      _model(std::move(model)),
+      _modelSlot(_model ? std::make_shared<ModelSlot>(_model, resource) : nullptr),
+      _planCache(std::make_shared<BindingPlanCache>()),
+      _resource(resource) {}
+
+// Only forks share a plan cache, so this is the constructor of forks.
+FeatureBrokerBase::FeatureBrokerBase(std::shared_ptr<const Model> model, std::shared_ptr<BindingPlanCache> planCache,
+                                     std::pmr::memory_resource* resource)
+    : _bindings(false),
+      _model(std::move(model)),
+      _modelSlot(_model ? std::make_shared<ModelSlot>(_model, resource) : nullptr),
+      _planCache(std::move(planCache)),
+      _resource(resource) {}
+
+FeatureBrokerBase::FeatureBrokerBase(std::shared_ptr<const Model> model, bool synchronous)
+    : _bindings(true),
+      _model(std::move(model)),
+      _modelSlot(_model ? std::make_shared<ModelSlot>(_model, std::pmr::get_default_resource()) : nullptr),
+      _planCache(std::make_shared<BindingPlanCache>()),
+      _synchronous(synchronous) {}
 
 std::shared_ptr<const Model> FeatureBrokerBase::GetModelOrNull(bool lock) const { return _model; }
 
+std::shared_ptr<FeatureBrokerBase::ModelSlot> FeatureBrokerBase::GetModelSlot(bool /*lock*/) const {
+    return _modelSlot;
+}
+
+void FeatureBrokerBase::PublishModel() { _modelSlot->Publish(_model); }
+
+void FeatureBrokerBase::FreezeModel() {
+    if (_modelSlot) _modelSlot->Freeze();
+}
+
 const rt::expected<TypeDescriptor> FeatureBrokerBase::GetBindingType(std::string const& name, bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
+    auto localLock = LockForLookup(lock);
     if (auto inputPipe = this->GetBindingOrNull(name, false)) return inputPipe->Type();
     if (auto provider = this->GetProviderOrNull(name, false)) {
         auto found = provider->Outputs().find(name);
@@ -67,45 +329,56 @@ const rt::expected<TypeDescriptor> FeatureBrokerBase::GetBindingType(std::string
     return make_feature_unexpected(feature_errc::not_bound);
 }
 
-std::shared_ptr<InputPipe> FeatureBrokerBase::GetBindingOrNull(std::string const& name, bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
-    auto found = _boundInputs.find(name);
-    if (found != _boundInputs.end()) return found->second;
-    return {};
+// The binding table has locks of its own, so the input lock is not needed to look up the bindings local to the broker.
+std::shared_ptr<InputPipe> FeatureBrokerBase::GetBindingOrNull(std::string const& name, bool /*lock*/) const {
+    return _bindings.FindInput(name);
 }
 
-std::shared_ptr<FeatureProvider> FeatureBrokerBase::GetProviderOrNull(std::string const& name, bool lock) const {
-    std::shared_lock<std::shared_mutex> localLock;
-    if (lock) localLock = std::shared_lock<std::shared_mutex>(_inputMutex);
-    auto found = _boundInputsFromProviders.find(name);
-
-    if (found != _boundInputsFromProviders.end()) return found->second;
-    return {};
+std::shared_ptr<FeatureProvider> FeatureBrokerBase::GetProviderOrNull(std::string const& name, bool /*lock*/) const {
+    return _bindings.FindProvider(name);
 }
 
 rt::expected<void> FeatureBrokerBase::BindCore(std::string const& name, std::shared_ptr<InputPipe> pipe) {
     // Under these circumstances, merely not being bound is not an error. But, anything else is.
-    std::unique_lock<std::shared_mutex> lock(_inputMutex);
+    std::shared_lock<std::shared_mutex> lock(_inputMutex);
+    if (_frozen.load(std::memory_order_relaxed)) return make_feature_unexpected(feature_errc::frozen);
     if (auto error = CheckInputOk(name, pipe->Type())) return tl::unexpected(error);
-    _boundInputs.emplace(name, pipe);
+    // Another thread may have bound the name since it was checked.
+    if (!_bindings.AddInput(name, std::move(pipe))) return make_feature_unexpected(feature_errc::already_bound);
     return {};
 }
 
 rt::expected<void> FeatureBrokerBase::BindInputs(std::shared_ptr<FeatureProvider> provider) {
-    std::unique_lock<std::shared_mutex> lock(_inputMutex);
+    std::shared_lock<std::shared_mutex> lock(_inputMutex);
+    if (_frozen.load(std::memory_order_relaxed)) return make_feature_unexpected(feature_errc::frozen);
     for (auto& pair : provider->Outputs()) {
         if (auto error = CheckInputOk(pair.first, pair.second)) return tl::unexpected(error);
     }
-    // Now that we've checked that it's OK, add it to the bindings.
-    for (auto& pair : provider->Outputs()) {
-        _boundInputsFromProviders.emplace(pair.first, provider);
-    }
+    // Now that we've checked that it's OK, add it to the bindings, unless another thread got to one of the names first.
+    if (!_bindings.AddProvider(provider)) return make_feature_unexpected(feature_errc::already_bound);
     return {};
 }
 
 FeatureBrokerBase::BrokerOutputPipeGeneral::BrokerOutputPipeGeneral() = default;
 
+FeatureBrokerBase::BrokerOutputPipeGeneral::Block::~Block() {
+    if (_data) _upstream->deallocate(_data, _size, alignof(std::max_align_t));
+}
+
+void FeatureBrokerBase::BrokerOutputPipeGeneral::Block::Reserve(std::pmr::memory_resource* upstream, std::size_t size) {
+    if (size == 0) return;
+    _upstream = upstream;
+    _data = static_cast<char*>(_upstream->allocate(size, alignof(std::max_align_t)));
+    _size = static_cast<std::uint32_t>(size);
+}
+
+void* FeatureBrokerBase::BrokerOutputPipeGeneral::Block::Take(std::size_t bytes, std::size_t alignment) {
+    if (bytes == 0) return nullptr;
+    auto offset = (_used + alignment - 1) / alignment * alignment;
+    _used = static_cast<std::uint32_t>(offset + bytes);
+    return _data + offset;
+}
+
 class OutputWaiterSinglePing final {
    public:
     OutputWaiterSinglePing(std::shared_ptr<InputPipe::OutputWaiter> waiter) : _waiter(std::move(waiter)) {}
@@ -119,150 +392,435 @@ class OutputWaiterSinglePing final {
     std::shared_ptr<InputPipe::OutputWaiter> _waiter;
 };
 
-std::error_code FeatureBrokerBase::BrokerOutputPipeGeneral::Bind(FeatureBrokerBase& featureBroker,
-                                                                 std::vector<std::string> const& outputNames) {
-    auto model = featureBroker.GetModelOrNull();
-    std::map<std::string, std::shared_ptr<InputPipe>> inputNameToPipe;
-    std::unordered_map<FeatureProvider*, std::unordered_set<std::string>> providerToRequested;
+// The synchronous counterpart of the above. Since nothing ever waits on a synchronous output, only the first
+// notification from each source matters, and only to count down to the output being ready.
+class PendingNotificationSinglePing final {
+   public:
+    PendingNotificationSinglePing(std::shared_ptr<std::atomic<std::size_t>> pending) : _pending(std::move(pending)) {}
+    void Ping() {
+        if (!_pinged.exchange(true)) _pending->fetch_sub(1, std::memory_order_release);
+    }
 
+   private:
+    std::atomic<bool> _pinged{false};
+    std::shared_ptr<std::atomic<std::size_t>> _pending;
+};
+
+// Adapts a provider's pull value updater to the push style ValueUpdater the output pipes work with, by tracking which
+// of the provider's outputs are stale. The provider may report staleness from any thread.
+class PulledProviderUpdater final : public ValueUpdater {
+   public:
+    PulledProviderUpdater(std::size_t outputs, std::function<void()> notifier)
+        : _stale(outputs), _notifier(std::move(notifier)) {}
+
+    void SetUpdater(std::shared_ptr<PullValueUpdater> updater) { _updater = std::move(updater); }
+
+    void MarkStale(std::size_t index) {
+        if (index >= _stale.size()) return;
+        _stale[index].store(true, std::memory_order_release);
+        _anyStale.store(true, std::memory_order_release);
+        _notifier();
+    }
+
+    bool Changed() override { return _anyStale.load(std::memory_order_acquire); }
+
+    std::error_code UpdateOutput() override {
+        if (!_anyStale.exchange(false, std::memory_order_acq_rel)) return err_feature_ok();
+        _staleIndices.clear();
+        for (std::size_t i = 0; i < _stale.size(); ++i) {
+            if (_stale[i].exchange(false, std::memory_order_acq_rel)) _staleIndices.push_back(i);
+        }
+        // A concurrent MarkStale may have been collected by a previous call, leaving nothing now.
+        if (_staleIndices.empty()) return err_feature_ok();
+        return _updater->UpdateOutputs(_staleIndices);
+    }
+
+   private:
+    std::vector<std::atomic<bool>> _stale;
+    std::atomic<bool> _anyStale{false};
+    std::vector<std::size_t> _staleIndices;
+    const std::function<void()> _notifier;
+    std::shared_ptr<PullValueUpdater> _updater;
+};
+
+// Stands in for the adapter in the notifier a provider is given, since whether there will be an adapter is only known
+// once the provider answers. Should the provider report staleness before then, that is held until the adapter is set.
+struct PulledProviderCell final {
+    std::mutex Mutex;
+    bool Set{false};
+    std::weak_ptr<PulledProviderUpdater> Pulled;
+    std::vector<std::size_t> Early;
+
+    void MarkStale(std::size_t index) {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (!Set) {
+            Early.push_back(index);
+            return;
+        }
+        auto pulled = Pulled.lock();
+        lock.unlock();
+        if (pulled) pulled->MarkStale(index);
+    }
+
+    void SetPulled(std::shared_ptr<PulledProviderUpdater> const& pulled) {
+        std::vector<std::size_t> early;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Set = true;
+            Pulled = pulled;
+            early.swap(Early);
+        }
+        for (auto index : early) pulled->MarkStale(index);
+    }
+};
+
+rt::expected<std::shared_ptr<FeatureBrokerBase::BindingPlan>> FeatureBrokerBase::GetBindingPlan(
+    ModelSlot& slot, std::shared_ptr<const Model> const& model, std::vector<std::string> const& outputNames) {
+    auto frozen = slot.Frozen();
+    if (auto plan = frozen ? slot.FindFrozenPlan(outputNames) : _planCache->Find(model, outputNames)) return plan;
+
+    auto plan = std::make_shared<BindingPlan>(model, outputNames, frozen);
+    std::unordered_set<std::string> seen;
     for (auto& outputName : outputNames) {
-        auto inputs = model->GetRequirements(outputName);
-        for (auto& inputName : inputs) {
+        auto outputIter = model->Outputs().find(outputName);
+        if (outputIter == model->Outputs().end()) return make_feature_unexpected(feature_errc::name_not_found);
+        plan->OutputTypes.push_back(outputIter->second);
+
+        for (auto& inputName : model->GetRequirements(outputName)) {
             auto inputIter = model->Inputs().find(inputName);
-            if (inputIter == model->Inputs().end()) return make_feature_error(feature_errc::name_not_found);
-            // If we already found the bound input, so no need to repeat it.
-            if (inputNameToPipe.find(inputName) != inputNameToPipe.end()) continue;
+            if (inputIter == model->Inputs().end()) return make_feature_unexpected(feature_errc::name_not_found);
+            if (seen.insert(inputName).second) plan->Inputs.push_back({inputName, inputIter->second});
+        }
+    }
+    if (frozen)
+        slot.StoreFrozenPlan(plan);
+    else
+        _planCache->Store(plan, model);
+    return plan;
+}
 
-            auto provider = featureBroker.GetProviderOrNull(inputName);
-            if (provider != nullptr) {
+std::error_code FeatureBrokerBase::BrokerOutputPipeGeneral::Bind(FeatureBrokerBase& featureBroker,
+                                                                 std::vector<std::string> const& outputNames) {
+    // The model and its generation are read together, so that a swap racing with this bind is noticed by the pipe.
+    auto slot = featureBroker.GetModelSlot();
+    if (!slot) return make_feature_error(feature_errc::no_model_associated);
+    auto current = slot->Current();
+    auto& model = current.first;
+    auto planExpected = featureBroker.GetBindingPlan(*slot, model, outputNames);
+    if (!planExpected) return planExpected.error();
+    auto& plan = *planExpected.value();
+    auto& planInputs = plan.Inputs;
+
+    // Resolve each of the required inputs to whatever is currently bound to provide it. This must be done on every
+    // bind, since bindings in this broker or its ancestors can change.
+    std::vector<std::shared_ptr<InputPipe>> pipes(planInputs.size());
+    std::vector<std::shared_ptr<FeatureProvider>> providers(planInputs.size());
+    for (std::size_t i = 0; i < planInputs.size(); ++i) {
+        auto const& inputName = planInputs[i].Name;
+        if (!(providers[i] = featureBroker.GetProviderOrNull(inputName)) &&
+            !(pipes[i] = featureBroker.GetBindingOrNull(inputName)))
+            return make_feature_error(feature_errc::not_bound);
+    }
+
+    // If what we resolved is exactly what the plan was last used with, everything below was already checked and can be
+    // reused as-is. Otherwise, check the types and group the provided inputs by their providers.
+    auto topology = plan.GetTopology();
+    if (!topology || !topology->Matches(planInputs, pipes, providers)) {
+        auto newTopology = std::make_shared<BindingPlan::Topology>();
+        newTopology->Providers.assign(providers.begin(), providers.end());
+        std::unordered_map<FeatureProvider*, std::size_t> providerToGroup;
+
+        for (std::size_t i = 0; i < planInputs.size(); ++i) {
+            auto const& input = planInputs[i];
+            if (auto& provider = providers[i]) {
                 // This input was bound by a provider. First check the type of the provider.
-                auto providerPair = provider->Outputs().find(inputName);
+                auto providerPair = provider->Outputs().find(input.Name);
                 if (providerPair == provider->Outputs().end())
                     return make_feature_error(feature_errc::feature_provider_inconsistent);
-                if (providerPair->second != inputIter->second) return make_feature_error(feature_errc::type_mismatch);
-                providerToRequested[provider.get()].insert(inputName);
-            } else if (auto inputPipe = featureBroker.GetBindingOrNull(inputName)) {
+                if (providerPair->second != input.Type) return make_feature_error(feature_errc::type_mismatch);
+                auto emplaced = providerToGroup.emplace(provider.get(), newTopology->ProviderGroups.size());
+                if (emplaced.second) newTopology->ProviderGroups.emplace_back();
+                newTopology->ProviderGroups[emplaced.first->second].push_back(i);
+            } else if (pipes[i]->Type() != input.Type) {
                 // This input was bound by a pipe.
-                if (inputPipe->Type() != inputIter->second) return make_feature_error(feature_errc::type_mismatch);
-                inputNameToPipe.emplace(inputName, inputPipe);
-            } else {
-                return make_feature_error(feature_errc::not_bound);
+                return make_feature_error(feature_errc::type_mismatch);
             }
         }
+        plan.SetTopology(newTopology);
+        topology = std::move(newTopology);
+    }
+
+    std::size_t pipeCount = 0;
+    for (auto& pipe : pipes) {
+        if (pipe) ++pipeCount;
     }
 
     // The number of waiters will be the number of input pipes, plus the number of providers,
-    // plus one more for the model itself.
-    auto outputWaiter =
-        std::make_shared<InputPipe::OutputWaiter>(inputNameToPipe.size() + providerToRequested.size() + 1);
+    // plus one more for the model itself. Synchronous pipes are ready as soon as they are bound, so in the synchronous
+    // case only the providers and the model are counted.
+    _synchronous = featureBroker._synchronous;
+    auto resource = featureBroker._resource;
+    std::shared_ptr<InputPipe::OutputWaiter> outputWaiter;
+    std::function<std::function<void()>()> createNotifier;
+    if (_synchronous) {
+        auto pending = detail::AllocateShared<std::atomic<std::size_t>>(resource, topology->ProviderGroups.size() + 1);
+        createNotifier = [pending, resource]() {
+            auto singlePing = detail::AllocateShared<PendingNotificationSinglePing>(resource, pending);
+            return std::function<void()>([singlePing]() { singlePing->Ping(); });
+        };
+        _pendingNotifications = std::move(pending);
+    } else {
+        // The model slot keeps a weak reference to the waiter, and so its control block. The slot may belong to an
+        // ancestor, so the waiter comes from the slot's resource.
+        outputWaiter = detail::AllocateShared<InputPipe::OutputWaiter>(
+            slot->Resource(), pipeCount + topology->ProviderGroups.size() + 1);
+        // We must use C++11, but with C++14 we could avoid the creation of this shared variable captured by value
+        // through generalized lambda capture.
+        createNotifier = [outputWaiter, resource]() {
+            auto singlePing = detail::AllocateShared<OutputWaiterSinglePing>(resource, outputWaiter);
+            return std::function<void()>([singlePing]() { singlePing->Ping(); });
+        };
+    }
 
     // Now that we've verified that the bindings are complete and compatible,
-    // set up the structures necessary to do the inference. Start with the pipes...
-
-    for (auto& inputPair : inputNameToPipe) {
-        std::string inputName = inputPair.first;
-        std::shared_ptr<InputPipe> inputPipe = inputPair.second;
-
-        auto pair = inputPipe->CreateHandleAndUpdater(outputWaiter);
-        auto handle = pair.first;
-        auto updater = pair.second;
-
-        _inputToHandle.emplace(inputName, handle);
-        _handlesForInputs.push_back(handle);
-        _updatersForInputs.push_back(updater);
+    // set up the structures necessary to do the inference. Everything is sized exactly up front, since with many forks
+    // each binding its own outputs the slack from growing these adds up. Start with the pipes...
+    auto updaterCount = (_synchronous ? 0 : pipeCount) + topology->ProviderGroups.size();
+    _block.Reserve(resource, updaterCount * sizeof(InputUpdater) +
+                                 (planInputs.size() + outputNames.size()) * sizeof(IHandle*));
+    _updatersForInputs.Reserve(_block, updaterCount);
+    _handles.Reserve(_block, planInputs.size() + outputNames.size());
+
+    for (std::size_t i = 0; i < planInputs.size(); ++i) {
+        if (!pipes[i]) continue;
+        auto pair = pipes[i]->CreateHandleAndUpdater(outputWaiter);
+        _inputToHandle.emplace(planInputs[i].Name, pair.first);
+        _handles.push_back(pair.first.get());
+        // The updater of a synchronous pipe does nothing, and reports exactly what its handle reports.
+        if (!_synchronous) _updatersForInputs.push_back({std::move(pair.second), nullptr, {}});
     }
+    _pipeInputCount = static_cast<std::uint32_t>(_handles.size());
 
     // Continue with the providers.
-    for (auto& inputPair : providerToRequested) {
-        auto providerPtr = inputPair.first;
-        auto& requestedInputs = inputPair.second;
-
-        // Form the map.
-        std::map<std::string, std::shared_ptr<InputPipe>> nameToPipe;
-        for (auto& inputName : requestedInputs) {
-            auto inputPipe = providerPtr->Outputs().at(inputName).CreateDirectInputPipeSyncSingleConsumer();
-            nameToPipe.emplace(inputName, inputPipe);
+    for (auto& group : topology->ProviderGroups) {
+        auto& provider = providers[group.front()];
+
+        // Form the list. Only the provider's outputs this model's outputs actually require are in the group.
+        std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> namesAndPipes;
+        for (auto index : group) {
+            auto& input = planInputs[index];
+            auto inputPipe = input.Type.CreateDirectInputPipeSyncSingleConsumer(resource);
+            namesAndPipes.emplace_back(input.Name, inputPipe);
             // Passing in the nullptr is fine in this case since we know it is a synchronous pipe.
             auto pair = inputPipe->CreateHandleAndUpdater(nullptr);
-            _inputToHandle.emplace(inputName, pair.first);
-            _handlesForInputs.push_back(pair.first);
+            _handles.push_back(pair.first.get());
+            _inputToHandle.emplace(input.Name, std::move(pair.first));
         }
 
-        // Using this map, feed it to the provider and get its updater.
-        // We must use C++11, but with C++14 we could avoid the creation of this shared variable captured by value
-        // through generalized lambda capture.
-        auto singlePing = std::make_shared<OutputWaiterSinglePing>(outputWaiter);
-        auto updaterExpected = providerPtr->CreateValueUpdater(nameToPipe, [singlePing]() { singlePing->Ping(); });
+        // Prefer pulling from the provider if it supports that, so it is only ever asked for what is stale. The adapter
+        // is only created for providers that do.
+        auto cell = detail::AllocateShared<PulledProviderCell>(resource);
+        auto pullExpected = provider->CreatePullValueUpdater(
+            namesAndPipes, [cell](std::size_t index) { cell->MarkStale(index); });
+        if (!pullExpected) return pullExpected.error();
+        if (pullExpected.value()) {
+            auto pulled =
+                detail::AllocateShared<PulledProviderUpdater>(resource, namesAndPipes.size(), createNotifier());
+            pulled->SetUpdater(std::move(pullExpected.value()));
+            cell->SetPulled(pulled);
+            _updatersForInputs.push_back({std::move(pulled), nullptr, {}});
+            continue;
+        }
+
+        // Otherwise, form the map, feed it to the provider and get its updater.
+        std::map<std::string, std::shared_ptr<InputPipe>> nameToPipe(namesAndPipes.begin(), namesAndPipes.end());
+        auto updaterExpected = provider->CreateValueUpdater(nameToPipe, createNotifier());
         if (!updaterExpected) return updaterExpected.error();
-        _updatersForInputs.push_back(updaterExpected.value());
+        _updatersForInputs.push_back({std::move(updaterExpected.value()), nullptr, {}});
     }
 
-    std::map<std::string, std::shared_ptr<InputPipe>> outputToInputPipe;
+    _inputHandleCount = static_cast<std::uint32_t>(_handles.size());
 
-    for (auto outputName : outputNames) {
-        auto outputIter = model->Outputs().find(outputName);
-        // The following should not happen since we already iterated over this.
-        if (outputIter == model->Outputs().end()) return make_feature_error(feature_errc::name_not_found);
-
-        auto inputPipe = outputIter->second.CreateDirectInputPipeSyncSingleConsumer();
-        // Similar to above, since synchronous the waiter is not relevant so can pass in nullptr.
-        auto inputHandleAndUpdater = inputPipe->CreateHandleAndUpdater(nullptr);
-        _handlesForOutputs.push_back(inputHandleAndUpdater.first);
-        _updatersForOutputs.push_back(inputHandleAndUpdater.second);
-        outputToInputPipe.emplace(outputName, inputPipe);
+    std::map<std::string, std::shared_ptr<InputPipe>> outputToInputPipe;
+    for (std::size_t i = 0; i < outputNames.size(); ++i) {
+        auto inputPipe = plan.OutputTypes[i].CreateDirectInputPipeSyncSingleConsumer(resource);
+        // Similar to above, since synchronous the waiter is not relevant so can pass in nullptr. The updater of a
+        // synchronous pipe does nothing, and the handle is part of the pipe, which is kept.
+        _handles.push_back(inputPipe->CreateHandleAndUpdater(nullptr).first.get());
+        outputToInputPipe.emplace(outputNames[i], inputPipe);
     }
 
-    auto singlePing = std::make_shared<OutputWaiterSinglePing>(outputWaiter);
-    auto updaterExpected =
-        model->CreateValueUpdater(_inputToHandle, outputToInputPipe, [singlePing]() { singlePing->Ping(); });
+    auto updaterExpected = model->CreateValueUpdater(_inputToHandle, outputToInputPipe, createNotifier());
     if (!updaterExpected) return updaterExpected.error();
     _spEngineForOutput = updaterExpected.value();
+    _outputToPipe = std::move(outputToInputPipe);
+    _modelSlot = std::move(slot);
+    _modelGeneration = current.second;
+    if (outputWaiter) _modelSlot->Watch(outputWaiter);
     _waiter = std::move(outputWaiter);
+
+    // Asynchronous updaters that already have something for us can start fetching now, so that by the time the output
+    // is first asked for some or all of that work is done. Any failures are reported from the update that consumes
+    // them.
+    for (auto& input : _updatersForInputs) {
+        input.Async = input.Updater->AsAsync();
+        if (input.Async && input.Async->Changed()) input.Pending = input.Async->UpdateOutputAsync();
+    }
     return {};
 }
 
+bool FeatureBrokerBase::BrokerOutputPipeGeneral::InputUpdaterChanged(std::size_t index) const {
+    // An update already in flight counts as a change, since its values will land once it is collected.
+    auto& input = _updatersForInputs[index];
+    return input.Pending.valid() || input.Updater->Changed();
+}
+
+bool FeatureBrokerBase::BrokerOutputPipeGeneral::SwapPending() const {
+    return _modelSlot->Generation() != _modelGeneration || (_swap && _swap->Ready->load(std::memory_order_acquire));
+}
+
+void FeatureBrokerBase::BrokerOutputPipeGeneral::AdoptSwappedModel() {
+    if (_modelSlot->Generation() != _modelGeneration) {
+        auto current = _modelSlot->Current();
+        _modelGeneration = current.second;
+        // The replacement gets the same handles and pipes. It notifies readiness, and every notification after, through
+        // the waiter so that anyone waiting on this output wakes up for it. Should the new model fail to create an
+        // updater over these, this pipe stays with the model it has.
+        auto ready = std::make_shared<std::atomic<bool>>(false);
+        std::weak_ptr<InputPipe::OutputWaiter> weakWaiter = _waiter;
+        auto updaterExpected =
+            current.first->CreateValueUpdater(_inputToHandle, _outputToPipe, [ready, weakWaiter]() {
+                ready->store(true, std::memory_order_release);
+                if (auto waiter = weakWaiter.lock()) waiter->Ping(true);
+            });
+        _swap.reset();
+        if (updaterExpected)
+            _swap.reset(new PendingSwap{std::move(updaterExpected.value()), std::move(ready)});
+    }
+    if (_swap && _swap->Ready->load(std::memory_order_acquire)) {
+        // The old engine is released here, on the consumer thread, so nothing can be running on it.
+        _spEngineForOutput = std::move(_swap->Engine);
+        _swap.reset();
+        // Before the first output there is nothing to recompute, and the usual rules about inputs apply.
+        _forceInference = _firstOutputFetched;
+    }
+}
+
 bool FeatureBrokerBase::BrokerOutputPipeGeneral::ChangedImpl() const {
-    if (!_waiter->Cleared()) return false;
-    if (_firstOutputFetched) {
-        return std::any_of(_updatersForInputs.begin(), _updatersForInputs.end(), UpdaterChanged);
+    if (!_ready) {
+        _ready = _synchronous ? _pendingNotifications->load(std::memory_order_acquire) == 0 : _waiter->Cleared();
+        if (!_ready) return false;
     }
-    return std::all_of(_updatersForInputs.begin(), _updatersForInputs.end(), UpdaterChanged);
+    if (_forceInference || SwapPending()) return true;
+    // In the synchronous case the pipe inputs are judged by their handles directly, rather than by their updaters.
+    auto pipesBegin = _handles.begin();
+    auto pipesEnd = _synchronous ? pipesBegin + _pipeInputCount : pipesBegin;
+    if (_firstOutputFetched || _inputsFetched) {
+        if (std::any_of(pipesBegin, pipesEnd, HandleChanged)) return true;
+        for (std::size_t i = 0; i < _updatersForInputs.size(); ++i) {
+            if (InputUpdaterChanged(i)) return true;
+        }
+        return false;
+    }
+    if (!std::all_of(pipesBegin, pipesEnd, HandleChanged)) return false;
+    for (std::size_t i = 0; i < _updatersForInputs.size(); ++i) {
+        if (!InputUpdaterChanged(i)) return false;
+    }
+    return true;
 }
 
-bool FeatureBrokerBase::BrokerOutputPipeGeneral::UpdateIfChangedPrePeek() {
-    // In principle all of these should succeed since the implementations are internal.
+rt::expected<bool> FeatureBrokerBase::BrokerOutputPipeGeneral::UpdateIfChangedPrePeek() {
+    if (_modelSlot->Generation() != _modelGeneration || _swap) AdoptSwappedModel();
     if (!ChangedImpl()) return false;
-    for (auto& updater : _updatersForInputs) updater->UpdateOutput();
-    if (_firstOutputFetched) {
-        if (!std::any_of(_handlesForInputs.begin(), _handlesForInputs.end(), HandleChanged)) return false;
-    } else {
-        if (!std::all_of(_handlesForInputs.begin(), _handlesForInputs.end(), HandleChanged)) return false;
+    // Only bring in what changed, so that an expensive provider is not asked to recompute when it was some other input
+    // that changed. All the asynchronous updates are started before any are waited upon, so they overlap with each
+    // other and with the synchronous updates.
+    for (auto& input : _updatersForInputs) {
+        if (input.Async && !input.Pending.valid() && input.Async->Changed())
+            input.Pending = input.Async->UpdateOutputAsync();
+    }
+    std::error_code error;
+    for (auto& input : _updatersForInputs) {
+        if (input.Async || !input.Updater->Changed()) continue;
+        auto updateError = input.Updater->UpdateOutput();
+        if (updateError && !error) error = updateError;
+    }
+    _inputsFetched = true;
+    // An update with a deadline leaves whatever is not ready by then in flight, to be collected on a later call.
+    auto deadline = CurrentDeadline();
+    bool late = false;
+    for (auto& input : _updatersForInputs) {
+        if (!input.Pending.valid()) continue;
+        if (deadline != NoDeadline && input.Pending.wait_until(deadline) != std::future_status::ready) {
+            late = true;
+            continue;
+        }
+        auto updateError = input.Pending.get();
+        if (updateError && !error) error = updateError;
+    }
+    if (error) return tl::make_unexpected(error);
+    if (late) return make_feature_unexpected(feature_errc::deadline_exceeded);
+    // A newly adopted model is rerun on the current inputs, whether or not they changed.
+    auto inputsEnd = _handles.begin() + _inputHandleCount;
+    if (!_forceInference) {
+        if (_firstOutputFetched) {
+            if (!std::any_of(_handles.begin(), inputsEnd, HandleChanged)) return false;
+        } else {
+            if (!std::all_of(_handles.begin(), inputsEnd, HandleChanged)) return false;
+        }
     }
     // Set the output pipes to unchanged so that we can detect whether the model's updater actually updated those
     // pipes.
-    for (auto& handle : _handlesForOutputs) handle->Changed(false);
+    std::for_each(inputsEnd, _handles.end(), [](IHandle* handle) { handle->Changed(false); });
     return true;
 }
 
 rt::expected<bool> FeatureBrokerBase::BrokerOutputPipeGeneral::UpdateIfChangedInference() {
     // Now query the model.
-    if (!_spEngineForOutput->Changed()) return false;
+    if (!_forceInference && !_spEngineForOutput->Changed()) return false;
     // Note that this update may potentially fail.
-    auto errc = _spEngineForOutput->UpdateOutput();
-    if (errc) return tl::make_unexpected(errc);
+    std::error_code errc;
+    {
+        detail::PriorityScope scope(_priority.load(std::memory_order_relaxed));
+        errc = _spEngineForOutput->UpdateOutput();
+    }
+    if (errc) {
+        // A model that ran out of time has consumed its inputs without computing anything from them, so the next call
+        // must run it again whether or not they change in the meantime.
+        if (errc == make_feature_error(feature_errc::deadline_exceeded)) _forceInference = true;
+        return tl::make_unexpected(errc);
+    }
 
-    // As with the input updaters, these should all succeed.
-    for (auto& outputUpdaters : _updatersForOutputs) outputUpdaters->UpdateOutput();
     _firstOutputFetched = true;
+    _forceInference = false;
 
-    return std::any_of(_handlesForOutputs.begin(), _handlesForOutputs.end(), HandleChanged);
+    return std::any_of(_handles.begin() + _inputHandleCount, _handles.end(), HandleChanged);
 }
 
 void FeatureBrokerBase::BrokerOutputPipeGeneral::UpdateIfChangedPostPoke() {
     // We do have an updated output. Set all the inputs to consumed.
-    for (auto& handle : _handlesForInputs) handle->Changed(false);
+    auto inputsEnd = _handles.begin() + _inputHandleCount;
+    std::for_each(_handles.begin(), inputsEnd, [](IHandle* handle) { handle->Changed(false); });
 }
 
-rt::expected<void> FeatureBrokerBase::BrokerOutputPipeGeneral::WaitUntilChangedImpl() { return tl::make_unexpected(_waiter->Wait()); }
+rt::expected<void> FeatureBrokerBase::BrokerOutputPipeGeneral::WaitUntilChangedImpl() {
+    // Nothing could ever wake a synchronous output, since anything that could change it happens on this same thread.
+    if (!_waiter) return make_feature_unexpected(feature_errc::invalid_operation);
+    return tl::make_unexpected(_waiter->Wait());
+}
+
+rt::expected<bool> FeatureBrokerBase::BrokerOutputPipeGeneral::WaitUntilChangedImpl(Deadline deadline) {
+    if (!_waiter) return make_feature_unexpected(feature_errc::invalid_operation);
+    auto error = _waiter->WaitUntil(deadline);
+    if (error == make_feature_error(feature_errc::deadline_exceeded)) return false;
+    if (error) return tl::make_unexpected(error);
+    return true;
+}
+
+rt::expected<void> FeatureBrokerBase::BrokerOutputPipeGeneral::NotifyWhenChangedImpl(std::function<void()> callback) {
+    if (!_waiter) return make_feature_unexpected(feature_errc::invalid_operation);
+    if (auto error = _waiter->NotifyWhenReady(std::move(callback))) return tl::make_unexpected(error);
+    return {};
+}
 
 }  // namespace inference
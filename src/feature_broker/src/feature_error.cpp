@@ -37,6 +37,10 @@ class FeatureErrorCategory final : public std::error_category {
                 return "An attempt to introduce a circular structure was detected. This is disallowed.";
             case feature_errc::multiple_waiting:
                 return "Multiple waiters appear to be waiting on an output pipe at the same time.";
+            case feature_errc::frozen:
+                return "The broker is frozen, so its bindings, parent and model cannot be changed.";
+            case feature_errc::deadline_exceeded:
+                return "The deadline passed before the update could complete.";
             default:
                 return "Unknown error code";
         }
@@ -56,6 +60,8 @@ class FeatureErrorCategory final : public std::error_category {
             case feature_errc::no_model_associated:
             case feature_errc::feature_provider_inconsistent:
             case feature_errc::circular_structure:
+            case feature_errc::frozen:
+            case feature_errc::deadline_exceeded:
                 return errc;
             default:
                 // Note that feature_errc::value_update_failure will fall through here for pass-through purposes.
@@ -0,0 +1,347 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <inference/bounded_queue.hpp>
+#include <inference/feed_recorder.hpp>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+#ifndef _WIN32
+#include <errno.h>
+#endif
+
+namespace inference {
+
+// The log is a header followed by records one after the other, with no padding. Everything is in the byte order of
+// the recording host. Each record is its kind, the stream it belongs to, its time in nanoseconds since the recorder was
+// created, and the length of its payload, followed by the payload. A stream record, which comes before any value
+// recorded for that stream, has as payload the item and container codes of the type recorded and then the name. A
+// value record has as payload the value, as encoded by detail::ValueCodec.
+namespace {
+constexpr char LogMagic[8] = {'F', 'B', 'F', 'E', 'E', 'D', 'L', 'G'};
+constexpr std::uint32_t LogVersion = 1;
+constexpr std::size_t HeaderSize = sizeof(LogMagic) + 2 * sizeof(std::uint32_t);
+constexpr std::size_t RecordHeaderSize = 1 + sizeof(std::uint32_t) + sizeof(std::int64_t) + sizeof(std::uint32_t);
+
+enum class RecordKind : std::uint8_t { Stream = 1, Value = 2 };
+
+struct LogRecord {
+    RecordKind Kind;
+    std::uint32_t Stream;
+    std::int64_t Nanoseconds;
+    std::string Payload;
+};
+
+std::error_code LastSystemError() { return std::error_code(errno, std::system_category()); }
+
+std::error_code CorruptLog() { return std::make_error_code(std::errc::illegal_byte_sequence); }
+}  // namespace
+
+class FeedRecorder::Log final {
+   public:
+    Log(std::FILE* file, std::size_t capacity) : _queue(capacity), _file(file), _start(Clock::now()) {
+        _writer = std::thread([this]() { Run(); });
+    }
+
+    ~Log() { Close(); }
+
+    rt::expected<std::uint32_t> AddStream(std::string const& name, detail::CodecItem item,
+                                          detail::CodecContainer container) {
+        if (_closing.load(std::memory_order_acquire)) return make_feature_unexpected(feature_errc::invalid_operation);
+        auto stream = _nextStream.fetch_add(1, std::memory_order_relaxed);
+        LogRecord record{RecordKind::Stream, stream, 0, std::string()};
+        record.Payload.push_back(static_cast<char>(item));
+        record.Payload.push_back(static_cast<char>(container));
+        record.Payload.append(name);
+        // Unlike values this cannot be dropped, since every value recorded for the stream would be lost with it. This
+        // is not on the hot path, so simply wait for the writer to make room.
+        while (!_queue.TryPush(std::move(record))) {
+            if (_closing.load(std::memory_order_acquire))
+                return make_feature_unexpected(feature_errc::invalid_operation);
+            std::this_thread::yield();
+        }
+        Wake();
+        return stream;
+    }
+
+    void Append(std::uint32_t stream, Clock::time_point time, std::string payload) {
+        if (_closing.load(std::memory_order_relaxed)) return;
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time - _start).count();
+        LogRecord record{RecordKind::Value, stream, static_cast<std::int64_t>(nanoseconds), std::move(payload)};
+        if (!_queue.TryPush(std::move(record))) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Wake();
+    }
+
+    std::uint64_t Dropped() const noexcept { return _dropped.load(std::memory_order_relaxed); }
+
+    rt::expected<void> Close() {
+        std::call_once(_closeOnce, [this]() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closing.store(true, std::memory_order_release);
+            }
+            _cv.notify_one();
+            _writer.join();
+            if (std::fclose(_file) != 0 && !_error) _error = LastSystemError();
+        });
+        if (_error) return tl::make_unexpected(_error);
+        return {};
+    }
+
+   private:
+    // Producers only take the lock to wake the writer when it has gone to sleep for want of anything to write.
+    void Wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_idle.load(std::memory_order_relaxed)) return;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _idle.store(false, std::memory_order_relaxed);
+        }
+        _cv.notify_one();
+    }
+
+    void Run() {
+        LogRecord record;
+        for (;;) {
+            bool wrote = false;
+            while (_queue.TryPop(record)) {
+                Write(record);
+                wrote = true;
+            }
+            if (wrote) continue;
+            // Whatever was written is made visible to readers of the file whenever the queue runs dry.
+            if (!_error && std::fflush(_file) != 0) _error = LastSystemError();
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_closing.load(std::memory_order_acquire)) break;
+            _idle.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_queue.TryPop(record)) {
+                _idle.store(false, std::memory_order_relaxed);
+                lock.unlock();
+                Write(record);
+                continue;
+            }
+            // The timeout is only a backstop, since a producer seeing the writer idle wakes it.
+            auto& idle = _idle;
+            auto& closing = _closing;
+            _cv.wait_for(lock, std::chrono::milliseconds(100),
+                         [&idle, &closing]() { return !idle.load(std::memory_order_relaxed) || closing.load(); });
+            _idle.store(false, std::memory_order_relaxed);
+        }
+        // Anything queued before closing is still written.
+        while (_queue.TryPop(record)) Write(record);
+        if (!_error && std::fflush(_file) != 0) _error = LastSystemError();
+    }
+
+    void Write(LogRecord const& record) {
+        // After an error the log is cut short, but the queue is still drained so that producers are not held up.
+        if (_error) return;
+        char header[RecordHeaderSize];
+        char* cursor = header;
+        auto put = [&cursor](void const* data, std::size_t size) {
+            std::memcpy(cursor, data, size);
+            cursor += size;
+        };
+        auto length = static_cast<std::uint32_t>(record.Payload.size());
+        put(&record.Kind, 1);
+        put(&record.Stream, sizeof(record.Stream));
+        put(&record.Nanoseconds, sizeof(record.Nanoseconds));
+        put(&length, sizeof(length));
+        if (std::fwrite(header, 1, sizeof(header), _file) != sizeof(header) ||
+            std::fwrite(record.Payload.data(), 1, length, _file) != length)
+            _error = LastSystemError();
+    }
+
+    detail::BoundedQueue<LogRecord> _queue;
+    std::FILE* const _file;
+    const Clock::time_point _start;
+    std::atomic<std::uint32_t> _nextStream{0};
+    std::atomic<std::uint64_t> _dropped{0};
+    std::atomic<bool> _closing{false};
+    std::atomic<bool> _idle{false};
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::once_flag _closeOnce;
+    // Only touched by the writer thread, until it is joined.
+    std::error_code _error;
+    std::thread _writer;
+};
+
+FeedRecorder::FeedRecorder(std::unique_ptr<Log> log) : _log(std::move(log)) {}
+
+FeedRecorder::~FeedRecorder() = default;
+
+rt::expected<std::shared_ptr<FeedRecorder>> FeedRecorder::Create(std::string const& path, std::size_t capacity) {
+    auto file = std::fopen(path.c_str(), "wb");
+    if (!file) return tl::make_unexpected(LastSystemError());
+    char header[HeaderSize];
+    std::uint32_t reserved = 0;
+    std::memcpy(header, LogMagic, sizeof(LogMagic));
+    std::memcpy(header + sizeof(LogMagic), &LogVersion, sizeof(LogVersion));
+    std::memcpy(header + sizeof(LogMagic) + sizeof(LogVersion), &reserved, sizeof(reserved));
+    if (std::fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        auto error = LastSystemError();
+        std::fclose(file);
+        return tl::make_unexpected(error);
+    }
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<FeedRecorder>(new FeedRecorder(std::make_unique<Log>(file, capacity)));
+}
+
+rt::expected<std::uint32_t> FeedRecorder::AddStream(std::string const& name, detail::CodecItem item,
+                                                     detail::CodecContainer container) {
+    return _log->AddStream(name, item, container);
+}
+
+void FeedRecorder::Append(std::uint32_t stream, Clock::time_point time, std::string payload) {
+    _log->Append(stream, time, std::move(payload));
+}
+
+std::uint64_t FeedRecorder::Dropped() const noexcept { return _log->Dropped(); }
+
+rt::expected<void> FeedRecorder::Close() { return _log->Close(); }
+
+namespace {
+// A stream of the log as it is replayed, knowing the type of its values.
+class ReplayStream {
+   public:
+    virtual ~ReplayStream() = default;
+    virtual rt::expected<void> Feed(char const* payload, std::size_t length) = 0;
+};
+
+template <typename T>
+class TypedReplayStream final : public ReplayStream {
+   public:
+    explicit TypedReplayStream(std::shared_ptr<DirectInputPipe<T>> pipe) : _pipe(std::move(pipe)) {}
+
+    rt::expected<void> Feed(char const* payload, std::size_t length) override {
+        T value;
+        char const* cursor = payload;
+        if (!detail::ValueCodec<T>::Decode(cursor, payload + length, value)) return tl::make_unexpected(CorruptLog());
+        _pipe->Feed(std::move(value));
+        return {};
+    }
+
+   private:
+    const std::shared_ptr<DirectInputPipe<T>> _pipe;
+};
+
+template <typename T>
+rt::expected<std::unique_ptr<ReplayStream>> BindStream(FeatureBroker& broker, std::string const& name,
+                                                       detail::CodecContainer container) {
+    if (container == detail::CodecContainer::Tensor) {
+        auto pipeExpected = broker.BindInput<Tensor<T>>(name);
+        if (!pipeExpected) return tl::make_unexpected(pipeExpected.error());
+        return std::unique_ptr<ReplayStream>(new TypedReplayStream<Tensor<T>>(std::move(pipeExpected).value()));
+    }
+    auto pipeExpected = broker.BindInput<T>(name);
+    if (!pipeExpected) return tl::make_unexpected(pipeExpected.error());
+    return std::unique_ptr<ReplayStream>(new TypedReplayStream<T>(std::move(pipeExpected).value()));
+}
+
+rt::expected<std::unique_ptr<ReplayStream>> BindStream(FeatureBroker& broker, char const* payload,
+                                                       std::size_t length) {
+    if (length < 2) return tl::make_unexpected(CorruptLog());
+    auto item = static_cast<detail::CodecItem>(payload[0]);
+    auto container = static_cast<detail::CodecContainer>(payload[1]);
+    if (container != detail::CodecContainer::Scalar && container != detail::CodecContainer::Tensor)
+        return tl::make_unexpected(CorruptLog());
+    std::string name(payload + 2, length - 2);
+    switch (item) {
+        case detail::CodecItem::Single:
+            return BindStream<float>(broker, name, container);
+        case detail::CodecItem::Double:
+            return BindStream<double>(broker, name, container);
+        case detail::CodecItem::Int:
+            return BindStream<int32_t>(broker, name, container);
+        case detail::CodecItem::Long:
+            return BindStream<int64_t>(broker, name, container);
+        case detail::CodecItem::String:
+            return BindStream<std::string>(broker, name, container);
+    }
+    return tl::make_unexpected(CorruptLog());
+}
+}  // namespace
+
+FeedReplayer::FeedReplayer(std::shared_ptr<detail::MappedFile> file) : _file(std::move(file)) {}
+
+FeedReplayer::~FeedReplayer() = default;
+
+rt::expected<std::shared_ptr<FeedReplayer>> FeedReplayer::Open(std::string const& path) {
+    auto fileExpected =
+        detail::MappedFile::Open(path, detail::MappedFile::Access::ReadOnly, detail::MappedFile::Pattern::Sequential);
+    if (!fileExpected) return tl::make_unexpected(fileExpected.error());
+    auto& file = *fileExpected;
+    if (file->Size() < HeaderSize || std::memcmp(file->Data(), LogMagic, sizeof(LogMagic)) != 0)
+        return tl::make_unexpected(CorruptLog());
+    std::uint32_t version;
+    std::memcpy(&version, file->Data() + sizeof(LogMagic), sizeof(version));
+    if (version != LogVersion) return tl::make_unexpected(CorruptLog());
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<FeedReplayer>(new FeedReplayer(std::move(file)));
+}
+
+rt::expected<std::size_t> FeedReplayer::Replay(FeatureBroker& broker, ReplaySpeed speed) const {
+    // Keyed by the stream number as read from the log, which cannot be trusted to be small enough to index by.
+    std::unordered_map<std::uint32_t, std::unique_ptr<ReplayStream>> streams;
+    std::size_t fed = 0;
+    bool started = false;
+    std::int64_t firstNanoseconds = 0;
+    auto start = FeedRecorder::Clock::now();
+
+    char const* cursor = _file->Data() + HeaderSize;
+    char const* end = _file->Data() + _file->Size();
+    while (static_cast<std::size_t>(end - cursor) >= RecordHeaderSize) {
+        RecordKind kind;
+        std::uint32_t stream, length;
+        std::int64_t nanoseconds;
+        std::memcpy(&kind, cursor, 1);
+        std::memcpy(&stream, cursor + 1, sizeof(stream));
+        std::memcpy(&nanoseconds, cursor + 1 + sizeof(stream), sizeof(nanoseconds));
+        std::memcpy(&length, cursor + 1 + sizeof(stream) + sizeof(nanoseconds), sizeof(length));
+        char const* payload = cursor + RecordHeaderSize;
+        // A record cut short is where the recording stopped.
+        if (static_cast<std::size_t>(end - payload) < length) break;
+        cursor = payload + length;
+
+        if (kind == RecordKind::Stream) {
+            // Streams are numbered in the order they were added, but may be written in a different order.
+            if (streams.count(stream)) return tl::make_unexpected(CorruptLog());
+            auto streamExpected = BindStream(broker, payload, length);
+            if (!streamExpected) return tl::make_unexpected(streamExpected.error());
+            streams.emplace(stream, std::move(streamExpected).value());
+        } else if (kind == RecordKind::Value) {
+            auto found = streams.find(stream);
+            if (found == streams.end()) return tl::make_unexpected(CorruptLog());
+            if (speed == ReplaySpeed::Original) {
+                if (!started) {
+                    started = true;
+                    firstNanoseconds = nanoseconds;
+                }
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(nanoseconds - firstNanoseconds));
+            }
+            auto feedExpected = found->second->Feed(payload, length);
+            if (!feedExpected) return tl::make_unexpected(feedExpected.error());
+            ++fed;
+        } else {
+            return tl::make_unexpected(CorruptLog());
+        }
+    }
+    return fed;
+}
+
+}  // namespace inference
@@ -0,0 +1,207 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <inference/feature_error.hpp>
+#include <inference/inference_executor.hpp>
+#include <inference/priority_scheduler.hpp>
+
+namespace {
+// The executor the thread is a worker of, if any.
+thread_local inference::InferenceExecutor const* currentExecutor = nullptr;
+
+std::mutex globalMutex;
+std::size_t globalWorkers = 0;
+inference::InferenceExecutor* globalExecutor = nullptr;
+}  // namespace
+
+namespace inference {
+
+InferenceExecutor::Tenant::Tenant(InferenceExecutor* executor, std::string name, double weight)
+    : _executor(executor), _name(std::move(name)), _weight(weight) {}
+
+double InferenceExecutor::Tenant::Weight() const {
+    std::lock_guard<std::mutex> lock(_executor->_mutex);
+    return _weight;
+}
+
+void InferenceExecutor::Tenant::SetWeight(double weight) {
+    std::lock_guard<std::mutex> lock(_executor->_mutex);
+    _weight = weight;
+}
+
+void InferenceExecutor::Tenant::Submit(std::function<void()> task) {
+    _executor->Enqueue(shared_from_this(), [this, task = std::move(task)]() {
+        task();
+        _completed.fetch_add(1, std::memory_order_relaxed);
+    });
+}
+
+void InferenceExecutor::Tenant::Run(std::function<void()> const& func) {
+    if (_executor->OnWorker()) {
+        func();
+        _completed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    // Counted before the caller is woken, so that it sees its own run among those completed.
+    _executor->Enqueue(shared_from_this(), [this, &func, &mutex, &cv, &done]() {
+        func();
+        _completed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&done]() { return done; });
+}
+
+bool InferenceExecutor::Tenant::RunUntil(std::function<void()> const& func, Deadline deadline,
+                                         std::function<void()> const& cancel) {
+    if (deadline == NoDeadline || _executor->OnWorker()) {
+        Run(func);
+        return true;
+    }
+    // Shared with the task, which may yet be queued after this has given up on it and returned.
+    struct State {
+        std::mutex Mutex;
+        std::condition_variable Done;
+        bool Started{false};
+        bool Finished{false};
+        bool Withdrawn{false};
+    };
+    auto state = std::make_shared<State>();
+    _executor->Enqueue(shared_from_this(), [this, state, &func]() {
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->Withdrawn) return;
+            state->Started = true;
+        }
+        func();
+        _completed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        state->Finished = true;
+        state->Done.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(state->Mutex);
+    auto finished = [&state]() { return state->Finished; };
+    if (state->Done.wait_until(lock, deadline, finished)) return true;
+    if (!state->Started) {
+        state->Withdrawn = true;
+        return false;
+    }
+    lock.unlock();
+    cancel();
+    lock.lock();
+    state->Done.wait(lock, finished);
+    return true;
+}
+
+std::function<void(std::function<void()>)> InferenceExecutor::Tenant::AsExecutor() {
+    return [tenant = shared_from_this()](std::function<void()> task) {
+        if (tenant->_executor->OnWorker()) {
+            task();
+            tenant->_completed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        tenant->Submit(std::move(task));
+    };
+}
+
+InferenceExecutor::InferenceExecutor(std::size_t workers, std::chrono::nanoseconds starvationLimit)
+    : _starvationLimit(starvationLimit) {
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    _workers.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) _workers.emplace_back([this]() { Work(); });
+}
+
+InferenceExecutor::~InferenceExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _available.notify_all();
+    for (auto& worker : _workers) worker.join();
+}
+
+std::shared_ptr<InferenceExecutor::Tenant> InferenceExecutor::CreateTenant(std::string name, double weight) {
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<Tenant>(new Tenant(this, std::move(name), weight));
+}
+
+std::size_t InferenceExecutor::Queued() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queued;
+}
+
+void InferenceExecutor::Enqueue(std::shared_ptr<Tenant> tenant, std::function<void()> task) {
+    // The task runs with the priority and deadline of whatever submitted it, as it would had it run on the submitting
+    // thread.
+    auto priority = CurrentPriority();
+    auto deadline = CurrentDeadline();
+    auto func = [priority, deadline, task = std::move(task)]() {
+        detail::PriorityScope priorityScope(priority);
+        detail::DeadlineScope deadlineScope(deadline);
+        task();
+    };
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // A tenant's task starts once its previous task would finish, or now in virtual time if the tenant has nothing
+        // queued, so that being idle earns nothing. Each takes virtual time in inverse proportion to the weight.
+        auto start = std::max(_virtualTime, tenant->_finish);
+        tenant->_finish = start + 1 / tenant->_weight;
+        _queues[static_cast<std::size_t>(priority)].push(
+            Task{start, _sequence++, std::chrono::steady_clock::now(), std::move(tenant), std::move(func)});
+        ++_queued;
+    }
+    _available.notify_one();
+}
+
+void InferenceExecutor::Work() {
+    currentExecutor = this;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _available.wait(lock, [this]() { return _stopping || _queued > 0; });
+        if (_queued == 0) return;
+        // The most urgent class with anything queued, unless something has waited past the limit.
+        auto now = std::chrono::steady_clock::now();
+        std::size_t next = PriorityClassCount;
+        for (std::size_t i = 0; i < PriorityClassCount; ++i) {
+            if (_queues[i].empty()) continue;
+            if (next == PriorityClassCount) next = i;
+            auto since = _queues[i].top().Since;
+            if (now - since >= _starvationLimit && since < _queues[next].top().Since) next = i;
+        }
+        auto& queue = _queues[next];
+        // Moving from the top leaves its tags, which are all that popping it compares.
+        auto task = std::move(const_cast<Task&>(queue.top()));
+        queue.pop();
+        --_queued;
+        // A more urgent task may have a later tag than one it went ahead of, and virtual time never goes back.
+        _virtualTime = std::max(_virtualTime, task.Start);
+        lock.unlock();
+
+        task.Func();
+        task = Task{};
+        lock.lock();
+    }
+}
+
+bool InferenceExecutor::OnWorker() const noexcept { return currentExecutor == this; }
+
+InferenceExecutor& InferenceExecutor::Global() {
+    std::lock_guard<std::mutex> lock(globalMutex);
+    if (!globalExecutor) globalExecutor = new InferenceExecutor(globalWorkers);
+    return *globalExecutor;
+}
+
+std::error_code InferenceExecutor::ConfigureGlobal(std::size_t workers) {
+    std::lock_guard<std::mutex> lock(globalMutex);
+    if (globalExecutor) return make_feature_error(feature_errc::invalid_operation);
+    globalWorkers = workers;
+    return err_feature_ok();
+}
+
+}  // namespace inference
@@ -9,20 +9,32 @@ namespace inference {
 InputPipe::OutputWaiter::OutputWaiter(size_t waiters) : _waiters(waiters), _ready(waiters == 0) {}
 
 void InputPipe::OutputWaiter::Ping(bool subsequentCall) {
-    std::unique_lock<std::mutex> lock(_mutex);
-    if (subsequentCall) {
-        if (_waiters == 0) {
+    std::function<void()> callback;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (subsequentCall) {
+            // If we still have some waiters, then this subsequent call should have no effect, yet.
+            if (_waiters != 0) return;
+        } else if (--_waiters != 0) {
+            return;
+        }
+        if (_callback) {
+            // The callback consumes the readiness, just as a return from Wait would.
+            callback = std::move(_callback);
+            _callback = nullptr;
+            _waiting = false;
+        } else {
             _ready = true;
             _cv.notify_one();
         }
-        // If we still have some waiters, then this subsequent call should have no effect, yet.
-    } else if (--_waiters == 0) {
-        _ready = true;
-        _cv.notify_one();
     }
+    // Called outside the lock, since it may well turn around and register itself again.
+    if (callback) callback();
 }
 
-std::error_code InputPipe::OutputWaiter::Wait() {
+std::error_code InputPipe::OutputWaiter::Wait() { return WaitUntil(NoDeadline); }
+
+std::error_code InputPipe::OutputWaiter::WaitUntil(Deadline deadline) {
     std::unique_lock<std::mutex> lock(_mutex);
     if (!_ready) {
         // The thing that calls this method are the output pipe implementations, and part of the contract with the
@@ -32,13 +44,41 @@ std::error_code InputPipe::OutputWaiter::Wait() {
         _waiting = true;
         // No need to capture all of this, just the reference to the bool will suffice.
         bool& ready = _ready;
-        _cv.wait(lock, [&ready]() { return ready; });
+        if (deadline == NoDeadline) {
+            _cv.wait(lock, [&ready]() { return ready; });
+        } else if (!_cv.wait_until(lock, deadline, [&ready]() { return ready; })) {
+            _waiting = false;
+            return make_feature_error(feature_errc::deadline_exceeded);
+        }
         _waiting = false;
     }
     _ready = false;
     return {};
 }
 
+std::error_code InputPipe::OutputWaiter::NotifyWhenReady(std::function<void()> callback) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!callback) {
+            // An empty callback withdraws whatever callback was registered, and leaves any readiness as it was.
+            if (_callback) {
+                _callback = nullptr;
+                _waiting = false;
+            }
+            return {};
+        }
+        if (_waiting) return make_feature_error(feature_errc::multiple_waiting);
+        if (!_ready) {
+            _waiting = true;
+            _callback = std::move(callback);
+            return {};
+        }
+        _ready = false;
+    }
+    callback();
+    return {};
+}
+
 bool InputPipe::OutputWaiter::Cleared() {
     std::unique_lock<std::mutex> lock(_mutex);
     return _waiters == 0;
@@ -0,0 +1,67 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "mapped_file.hpp"
+
+#include <system_error>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace inference {
+namespace detail {
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (_data && !_contents) ::munmap(_data, _size);
+#endif
+}
+
+rt::expected<std::shared_ptr<MappedFile>> MappedFile::Open(std::string const& path, Access access, Pattern pattern) {
+    // The constructor is private, so make_shared cannot be used.
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) return tl::make_unexpected(std::make_error_code(std::errc::no_such_file_or_directory));
+    file->_size = static_cast<std::size_t>(stream.tellg());
+    stream.seekg(0);
+    file->_contents.reset(new std::max_align_t[file->_size / sizeof(std::max_align_t) + 1]);
+    file->_data = reinterpret_cast<char*>(file->_contents.get());
+    if (!stream.read(file->_data, file->_size)) return tl::make_unexpected(std::make_error_code(std::errc::io_error));
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return tl::make_unexpected(std::error_code(errno, std::system_category()));
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        std::error_code error(errno, std::system_category());
+        ::close(fd);
+        return tl::make_unexpected(error);
+    }
+    file->_size = static_cast<std::size_t>(status.st_size);
+    // An empty file cannot be mapped, and has no data to point at anyway.
+    if (file->_size > 0) {
+        int protection = access == Access::CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* data = ::mmap(nullptr, file->_size, protection, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            std::error_code error(errno, std::system_category());
+            ::close(fd);
+            return tl::make_unexpected(error);
+        }
+        ::madvise(data, file->_size, pattern == Pattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        file->_data = static_cast<char*>(data);
+    }
+    // The mapping stays valid without the descriptor.
+    ::close(fd);
+#endif
+    return file;
+}
+
+}  // namespace detail
+}  // namespace inference
@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <rt/rt_expected.hpp>
+#include <string>
+
+namespace inference {
+namespace detail {
+
+// A whole file mapped into memory, for the files the broker writes and reads back, such as feed logs and snapshots.
+// Where memory mapping is not available the file is read into memory instead. Either way the data starts at an address
+// aligned at least as well as std::max_align_t.
+class MappedFile final {
+   public:
+    enum class Access {
+        // The mapping cannot be written to.
+        ReadOnly,
+        // The mapping can be written to, but what is written is private to the process and never reaches the file.
+        CopyOnWrite
+    };
+
+    enum class Pattern { Sequential, Random };
+
+    ~MappedFile();
+
+    static rt::expected<std::shared_ptr<MappedFile>> Open(std::string const& path, Access access, Pattern pattern);
+
+    char* Data() const noexcept { return _data; }
+    std::size_t Size() const noexcept { return _size; }
+
+   private:
+    MappedFile() = default;
+    MappedFile(const MappedFile& other) = delete;
+
+    char* _data{nullptr};
+    std::size_t _size{0};
+    // Set when the file was read rather than mapped.
+    std::unique_ptr<std::max_align_t[]> _contents;
+};
+
+}  // namespace detail
+}  // namespace inference
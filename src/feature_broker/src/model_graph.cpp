@@ -0,0 +1,308 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <atomic>
+#include <condition_variable>
+#include <inference/deadline.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/model_graph.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+
+namespace inference {
+
+namespace {
+// Calls the outer notifier once every model in the graph has notified at least once, and on every notification after.
+class GraphNotifier final {
+   public:
+    GraphNotifier(std::size_t models, std::function<void()> outer) : _pending(models), _outer(std::move(outer)) {
+        if (models == 0) _outer();
+    }
+
+    std::function<void()> CreateModelNotifier(std::shared_ptr<GraphNotifier> self) {
+        auto pinged = std::make_shared<std::atomic<bool>>(false);
+        return [self, pinged]() {
+            if (pinged->exchange(true)) {
+                if (self->_pending.load(std::memory_order_acquire) == 0) self->_outer();
+            } else if (self->_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                self->_outer();
+            }
+        };
+    }
+
+   private:
+    std::atomic<std::size_t> _pending;
+    const std::function<void()> _outer;
+};
+}  // namespace
+
+class ModelGraph::Updater final : public ValueUpdater {
+   public:
+    struct Forward {
+        IHandle* Handle;
+        std::shared_ptr<InputPipe> Pipe;
+        TypeDescriptor Type;
+    };
+
+    struct Node {
+        std::shared_ptr<ValueUpdater> Updater;
+        std::vector<IHandle*> InputHandles;
+        // The handles internal to the graph that this model writes, and those of them that must also be forwarded to a
+        // pipe outside the graph.
+        std::vector<IHandle*> OutputHandles;
+        std::vector<Forward> Forwards;
+        bool Ran{false};
+        std::error_code Error;
+    };
+
+    explicit Updater(Executor executor) : _executor(std::move(executor)) {}
+
+    bool Changed() override { return true; }
+
+    std::error_code UpdateOutput() override {
+        std::error_code error;
+        std::vector<Node*> dirty;
+        for (auto& level : _levels) {
+            dirty.clear();
+            for (auto node : level) {
+                bool inputsChanged = !node->Ran;
+                for (auto handle : node->InputHandles) inputsChanged = inputsChanged || handle->Changed();
+                if (inputsChanged && node->Updater->Changed()) dirty.push_back(node);
+            }
+            if (dirty.empty()) continue;
+            for (auto node : dirty) {
+                for (auto handle : node->OutputHandles) handle->Changed(false);
+            }
+            Run(dirty);
+            for (auto node : dirty) {
+                if (node->Error) {
+                    if (!error) error = node->Error;
+                    continue;
+                }
+                node->Ran = true;
+                for (auto& forward : node->Forwards) {
+                    if (forward.Handle->Changed()) forward.Type.FeedFromHandle(*forward.Handle, *forward.Pipe);
+                }
+            }
+            if (error) break;
+        }
+        // Everything downstream has now seen these changes. After a failure the levels past it have not, so the changes
+        // are left for them to see on the next update, when the inputs that led to the failure are tried again.
+        if (!error) {
+            for (auto& handle : _internalHandles) handle->Changed(false);
+        }
+        return error;
+    }
+
+   private:
+    friend class ModelGraph;
+
+    void Run(std::vector<Node*> const& nodes) {
+        if (!_executor || nodes.size() == 1) {
+            for (auto node : nodes) node->Error = node->Updater->UpdateOutput();
+            return;
+        }
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::size_t remaining = nodes.size();
+        // The models run on the executor's threads with the priority and deadline of the update that runs the graph.
+        auto priority = CurrentPriority();
+        auto deadline = CurrentDeadline();
+        for (auto node : nodes) {
+            _executor([node, priority, deadline, &mutex, &cv, &remaining]() {
+                detail::PriorityScope priorityScope(priority);
+                detail::DeadlineScope deadlineScope(deadline);
+                node->Error = node->Updater->UpdateOutput();
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0) cv.notify_all();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&remaining]() { return remaining == 0; });
+    }
+
+    const Executor _executor;
+    std::vector<Node> _nodes;
+    std::vector<std::vector<Node*>> _levels;
+    std::vector<std::shared_ptr<IHandle>> _internalHandles;
+    std::vector<std::shared_ptr<InputPipe>> _internalPipes;
+};
+
+ModelGraph::ModelGraph(std::vector<std::shared_ptr<const Model>> models, Executor executor)
+    : _models(std::move(models)), _executor(std::move(executor)) {}
+
+rt::expected<std::shared_ptr<ModelGraph>> ModelGraph::Create(std::vector<std::shared_ptr<const Model>> models,
+                                                             Executor executor) {
+    std::shared_ptr<ModelGraph> graph(new ModelGraph(std::move(models), std::move(executor)));
+    if (auto error = graph->Build()) return tl::make_unexpected(error);
+    return graph;
+}
+
+std::error_code ModelGraph::Build() {
+    for (std::size_t i = 0; i < _models.size(); ++i) {
+        if (!_models[i]) return make_feature_error(feature_errc::invalid_model);
+        for (auto& output : _models[i]->Outputs()) {
+            if (!_producers.emplace(output.first, i).second) return make_feature_error(feature_errc::already_bound);
+            _outputs.emplace(output.first, output.second);
+        }
+    }
+
+    // Each model's level is one past the highest level of the models it depends upon.
+    std::vector<std::vector<std::size_t>> dependents(_models.size());
+    std::vector<std::size_t> dependencyCount(_models.size());
+    for (std::size_t i = 0; i < _models.size(); ++i) {
+        std::unordered_set<std::size_t> dependencies;
+        for (auto& input : _models[i]->Inputs()) {
+            auto producer = _producers.find(input.first);
+            if (producer == _producers.end()) {
+                auto emplaced = _inputs.emplace(input.first, input.second);
+                if (emplaced.first->second != input.second) return make_feature_error(feature_errc::type_mismatch);
+                continue;
+            }
+            if (_outputs.at(input.first) != input.second) return make_feature_error(feature_errc::type_mismatch);
+            if (dependencies.insert(producer->second).second) dependents[producer->second].push_back(i);
+        }
+        dependencyCount[i] = dependencies.size();
+    }
+
+    std::vector<std::size_t> current;
+    for (std::size_t i = 0; i < _models.size(); ++i) {
+        if (dependencyCount[i] == 0) current.push_back(i);
+    }
+    std::size_t placed = 0;
+    while (!current.empty()) {
+        placed += current.size();
+        std::vector<std::size_t> next;
+        for (auto i : current) {
+            for (auto dependent : dependents[i]) {
+                if (--dependencyCount[dependent] == 0) next.push_back(dependent);
+            }
+        }
+        _levels.push_back(std::move(current));
+        current = std::move(next);
+    }
+    // Anything not placed is on or downstream of a cycle.
+    if (placed != _models.size()) return make_feature_error(feature_errc::circular_structure);
+    return err_feature_ok();
+}
+
+std::vector<std::string> ModelGraph::GetRequirements(std::string const& outputName) const {
+    std::vector<std::string> requirements;
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> pending = {outputName};
+    while (!pending.empty()) {
+        auto name = std::move(pending.back());
+        pending.pop_back();
+        auto producer = _producers.find(name);
+        if (producer == _producers.end()) continue;
+        for (auto& requirement : _models[producer->second]->GetRequirements(name)) {
+            if (!seen.insert(requirement).second) continue;
+            if (_producers.count(requirement))
+                pending.push_back(requirement);
+            else
+                requirements.push_back(requirement);
+        }
+    }
+    return requirements;
+}
+
+rt::expected<std::shared_ptr<ValueUpdater>> ModelGraph::CreateValueUpdater(
+    std::map<std::string, std::shared_ptr<IHandle>> const& inputToHandle,
+    std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+    std::function<void()> outOfBandNotifier) const {
+    // Work back from the requested outputs to everything they need. Outputs needed by other models are internal, and
+    // get their own handle that those models read from directly.
+    std::vector<std::vector<std::string>> neededOutputs(_models.size());
+    std::unordered_set<std::string> needed;
+    std::unordered_set<std::string> internal;
+    std::vector<std::string> pending;
+    for (auto& pair : outputToPipe) {
+        if (!_producers.count(pair.first)) return make_feature_unexpected(feature_errc::name_not_found);
+        pending.push_back(pair.first);
+    }
+    while (!pending.empty()) {
+        auto name = std::move(pending.back());
+        pending.pop_back();
+        if (!needed.insert(name).second) continue;
+        auto model = _producers.at(name);
+        neededOutputs[model].push_back(name);
+        for (auto& requirement : _models[model]->GetRequirements(name)) {
+            if (!_producers.count(requirement)) continue;
+            internal.insert(requirement);
+            pending.push_back(requirement);
+        }
+    }
+
+    auto updater = std::make_shared<Updater>(_executor);
+    std::unordered_map<std::string, std::shared_ptr<InputPipe>> internalPipes;
+    std::unordered_map<std::string, std::shared_ptr<IHandle>> internalHandles;
+    for (auto& name : internal) {
+        auto pipe = _outputs.at(name).CreateDirectInputPipeSyncSingleConsumer();
+        auto handle = pipe->CreateHandleAndUpdater(nullptr).first;
+        internalPipes.emplace(name, pipe);
+        internalHandles.emplace(name, handle);
+        updater->_internalPipes.push_back(pipe);
+        updater->_internalHandles.push_back(handle);
+    }
+
+    std::size_t modelCount = 0;
+    for (auto& outputs : neededOutputs) {
+        if (!outputs.empty()) ++modelCount;
+    }
+    auto notifier = std::make_shared<GraphNotifier>(modelCount, std::move(outOfBandNotifier));
+
+    // Reserve up front so that the node pointers in the levels remain valid.
+    updater->_nodes.reserve(modelCount);
+    for (auto& level : _levels) {
+        std::vector<Updater::Node*> levelNodes;
+        for (auto index : level) {
+            if (neededOutputs[index].empty()) continue;
+            auto& model = _models[index];
+            updater->_nodes.emplace_back();
+            auto& node = updater->_nodes.back();
+
+            std::map<std::string, std::shared_ptr<IHandle>> modelInputs;
+            std::map<std::string, std::shared_ptr<InputPipe>> modelOutputs;
+            for (auto& output : neededOutputs[index]) {
+                for (auto& requirement : model->GetRequirements(output)) {
+                    if (modelInputs.count(requirement)) continue;
+                    auto found = internalHandles.find(requirement);
+                    if (found == internalHandles.end()) {
+                        auto external = inputToHandle.find(requirement);
+                        if (external == inputToHandle.end()) return make_feature_unexpected(feature_errc::not_bound);
+                        modelInputs.emplace(requirement, external->second);
+                        node.InputHandles.push_back(external->second.get());
+                    } else {
+                        modelInputs.emplace(requirement, found->second);
+                        node.InputHandles.push_back(found->second.get());
+                    }
+                }
+
+                auto externalPipe = outputToPipe.find(output);
+                auto internalPipe = internalPipes.find(output);
+                if (internalPipe == internalPipes.end()) {
+                    // Only needed outside, so the model can feed the pipe outside directly.
+                    modelOutputs.emplace(output, externalPipe->second);
+                    continue;
+                }
+                modelOutputs.emplace(output, internalPipe->second);
+                auto handle = internalHandles.at(output).get();
+                node.OutputHandles.push_back(handle);
+                if (externalPipe != outputToPipe.end())
+                    node.Forwards.push_back({handle, externalPipe->second, _outputs.at(output)});
+            }
+
+            auto updaterExpected =
+                model->CreateValueUpdater(modelInputs, modelOutputs, notifier->CreateModelNotifier(notifier));
+            if (!updaterExpected) return tl::make_unexpected(updaterExpected.error());
+            node.Updater = std::move(updaterExpected.value());
+            levelNodes.push_back(&node);
+        }
+        if (!levelNodes.empty()) updater->_levels.push_back(std::move(levelNodes));
+    }
+    return std::static_pointer_cast<ValueUpdater>(updater);
+}
+
+}  // namespace inference
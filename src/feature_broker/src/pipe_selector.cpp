@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <condition_variable>
+#include <inference/feature_error.hpp>
+#include <inference/pipe_selector.hpp>
+#include <mutex>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace inference {
+
+class PipeSelector::Signals final {
+   public:
+    ~Signals() {
+#ifdef __linux__
+        if (_eventFd >= 0) ::close(_eventFd);
+#endif
+    }
+
+    // Called from whatever thread changed the pipe, so this does as little as it can.
+    void Signal(std::size_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _fired.push_back(id);
+        _cv.notify_one();
+#ifdef __linux__
+        if (_eventFd >= 0 && _fired.size() == 1) {
+            uint64_t one = 1;
+            (void)::write(_eventFd, &one, sizeof(one));
+        }
+#endif
+    }
+
+    std::vector<std::size_t> Collect(bool forever, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto& fired = _fired;
+        auto anyFired = [&fired]() { return !fired.empty(); };
+        if (forever)
+            _cv.wait(lock, anyFired);
+        else
+            _cv.wait_until(lock, deadline, anyFired);
+        std::vector<std::size_t> result;
+        result.swap(_fired);
+#ifdef __linux__
+        if (_eventFd >= 0 && !result.empty()) {
+            uint64_t count;
+            (void)::read(_eventFd, &count, sizeof(count));
+        }
+#endif
+        return result;
+    }
+
+#ifdef __linux__
+    rt::expected<int> EventFd() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_eventFd >= 0) return _eventFd;
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) return tl::make_unexpected(std::error_code(errno, std::system_category()));
+        _eventFd = fd;
+        if (!_fired.empty()) {
+            uint64_t one = 1;
+            (void)::write(_eventFd, &one, sizeof(one));
+        }
+        return _eventFd;
+    }
+#endif
+
+   private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<std::size_t> _fired;
+#ifdef __linux__
+    int _eventFd{-1};
+#endif
+};
+
+PipeSelector::PipeSelector() : _signals(std::make_shared<Signals>()) {}
+
+PipeSelector::~PipeSelector() {
+    // Withdraw from the pipes, so that they can be waited upon by something else.
+    for (auto& pair : _entries) {
+        if (pair.second.Armed) pair.second.ArmPipe(nullptr);
+    }
+}
+
+rt::expected<std::size_t> PipeSelector::AddCore(Arm arm) {
+    auto id = _nextId++;
+    auto& entry = _entries[id];
+    entry.ArmPipe = std::move(arm);
+    auto armed = ArmEntry(id, entry);
+    if (!armed) {
+        _entries.erase(id);
+        return tl::make_unexpected(armed.error());
+    }
+    return id;
+}
+
+void PipeSelector::Remove(std::size_t id) {
+    auto found = _entries.find(id);
+    if (found == _entries.end()) return;
+    if (found->second.Armed) found->second.ArmPipe(nullptr);
+    // Should it have fired already, the identifier is dropped when collected since it is no longer an entry.
+    _entries.erase(found);
+}
+
+rt::expected<void> PipeSelector::ArmEntry(std::size_t id, Entry& entry) {
+    std::weak_ptr<Signals> weakSignals = _signals;
+    // If the pipe is already changed, this calls back immediately.
+    auto armed = entry.ArmPipe([weakSignals, id]() {
+        if (auto signals = weakSignals.lock()) signals->Signal(id);
+    });
+    if (armed) entry.Armed = true;
+    return armed;
+}
+
+rt::expected<std::vector<std::size_t>> PipeSelector::Wait() { return WaitCore(true, Clock::time_point()); }
+
+rt::expected<std::vector<std::size_t>> PipeSelector::WaitUntil(Clock::time_point deadline) {
+    return WaitCore(false, deadline);
+}
+
+rt::expected<std::vector<std::size_t>> PipeSelector::WaitCore(bool forever, Clock::time_point deadline) {
+    // Pipes reported by the last wait are only waited on again now, after the consumer has had a chance to update them.
+    // Any change since then is caught, since the pipe is left ready and so calls back as soon as it is armed.
+    for (auto& pair : _entries) {
+        if (pair.second.Armed) continue;
+        auto armed = ArmEntry(pair.first, pair.second);
+        if (!armed) return tl::make_unexpected(armed.error());
+    }
+    // With nothing to wait upon, waiting forever would be forever indeed.
+    if (forever && _entries.empty()) return make_feature_unexpected(feature_errc::invalid_operation);
+
+    auto fired = _signals->Collect(forever, deadline);
+    std::vector<std::size_t> result;
+    result.reserve(fired.size());
+    for (auto id : fired) {
+        auto found = _entries.find(id);
+        if (found == _entries.end() || !found->second.Armed) continue;
+        found->second.Armed = false;
+        result.push_back(id);
+    }
+    // Everything collected may have been removed in the meantime, in which case wait on.
+    if (forever && result.empty()) return WaitCore(forever, deadline);
+    return result;
+}
+
+#ifdef __linux__
+rt::expected<int> PipeSelector::EventFd() { return _signals->EventFd(); }
+#endif
+
+}  // namespace inference
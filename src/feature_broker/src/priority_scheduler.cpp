@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <inference/priority_scheduler.hpp>
+
+namespace {
+thread_local inference::PriorityClass currentPriority = inference::PriorityClass::Normal;
+}  // namespace
+
+namespace inference {
+
+PriorityClass CurrentPriority() noexcept { return currentPriority; }
+
+detail::PriorityScope::PriorityScope(PriorityClass priority) noexcept : _previous(currentPriority) {
+    currentPriority = priority;
+}
+
+detail::PriorityScope::~PriorityScope() { currentPriority = _previous; }
+
+PriorityScheduler::PriorityScheduler(std::chrono::nanoseconds starvationLimit) : _starvationLimit(starvationLimit) {}
+
+PriorityScheduler::Lease PriorityScheduler::Acquire(PriorityClass priority) {
+    return std::move(*TryAcquireUntil(priority, NoDeadline));
+}
+
+std::optional<PriorityScheduler::Lease> PriorityScheduler::TryAcquireUntil(PriorityClass priority, Deadline deadline) {
+    auto index = static_cast<std::size_t>(priority);
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto& stats = _stats[index];
+    // Release hands the scheduler straight on to a waiter, so when it is free nothing is waiting.
+    if (!_busy) {
+        _busy = true;
+        ++stats.Acquired;
+        return Lease(this);
+    }
+
+    Waiter waiter;
+    waiter.Since = std::chrono::steady_clock::now();
+    _waiting[index].push_back(&waiter);
+    auto granted = [&waiter]() { return waiter.IsGranted; };
+    if (deadline == NoDeadline) {
+        waiter.Granted.wait(lock, granted);
+    } else if (!waiter.Granted.wait_until(lock, deadline, granted)) {
+        // Not yet granted, so still in the queue, from which it is withdrawn.
+        auto& queue = _waiting[index];
+        queue.erase(std::find(queue.begin(), queue.end(), &waiter));
+        ++stats.TimedOut;
+        return std::nullopt;
+    }
+
+    auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - waiter.Since);
+    ++stats.Acquired;
+    if (waiter.Promoted) ++stats.Promoted;
+    stats.TotalWait += waited;
+    stats.MaxWait = std::max(stats.MaxWait, waited);
+    return Lease(this);
+}
+
+void PriorityScheduler::Release() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::size_t next = PriorityClassCount;
+    // The most urgent class with anything waiting, unless something has waited past the limit.
+    for (std::size_t i = 0; i < PriorityClassCount; ++i) {
+        if (_waiting[i].empty()) continue;
+        if (next == PriorityClassCount) next = i;
+        auto since = _waiting[i].front()->Since;
+        if (now - since >= _starvationLimit && since < _waiting[next].front()->Since) next = i;
+    }
+    if (next == PriorityClassCount) {
+        _busy = false;
+        return;
+    }
+
+    auto waiter = _waiting[next].front();
+    _waiting[next].pop_front();
+    waiter->Promoted = std::any_of(_waiting.begin(), _waiting.begin() + next, [](auto& q) { return !q.empty(); });
+    waiter->IsGranted = true;
+    waiter->Granted.notify_one();
+}
+
+PriorityScheduler::ClassStats PriorityScheduler::Stats(PriorityClass priority) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats[static_cast<std::size_t>(priority)];
+}
+
+std::size_t PriorityScheduler::Waiting(PriorityClass priority) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _waiting[static_cast<std::size_t>(priority)].size();
+}
+
+}  // namespace inference
@@ -0,0 +1,443 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef _WIN32
+
+#include <inference/shared_memory.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <system_error>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace inference {
+namespace detail {
+
+// The region is its header, then the headers of its slots, then the data of each slot in turn. Everything is in the
+// byte order of the host, which the processes sharing a region have in common. The data of each slot starts at an
+// offset that is a multiple of RegionAlignment, so that tensor data is aligned in the region as well as out of it.
+namespace {
+constexpr char RegionMagic[8] = {'F', 'B', 'S', 'H', 'A', 'R', 'E', 'D'};
+constexpr std::uint32_t RegionVersion = 1;
+constexpr std::size_t RegionAlignment = 64;
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free && std::atomic<std::uint64_t>::is_always_lock_free,
+              "The atomics in the region are shared between processes, which only works if they are lock free.");
+
+std::size_t AlignUp(std::size_t offset) { return (offset + RegionAlignment - 1) / RegionAlignment * RegionAlignment; }
+
+std::error_code LastSystemError() { return std::error_code(errno, std::system_category()); }
+
+std::error_code CorruptRegion() { return std::make_error_code(std::errc::illegal_byte_sequence); }
+
+// POSIX shared memory names are a single leading slash and a name.
+std::string RegionName(std::string const& name) { return name.size() > 0 && name[0] == '/' ? name : "/" + name; }
+}  // namespace
+
+struct RegionHeader {
+    char Magic[8];
+    std::uint32_t Version;
+    std::uint32_t SlotCount;
+    std::uint64_t Size;
+    // Set once the publisher has laid out the region.
+    std::atomic<std::uint32_t> Ready;
+    // Bumped on every write to any slot. This is the futex observers sleep on.
+    std::atomic<std::uint32_t> Changes;
+    // The number of observers asleep, or about to be, so that writers only make the system call to wake them if needed.
+    std::atomic<std::uint32_t> Sleepers;
+    std::uint32_t Reserved;
+};
+
+struct SlotHeader {
+    char Name[SharedMemoryPublisher::MaxNameLength + 1];
+    CodecItem Item;
+    CodecContainer Container;
+    std::uint8_t Reserved[6];
+    std::uint64_t Capacity;
+    std::uint64_t Offset;
+    // The seqlock sequence, which is odd while the slot is being written, and zero until it first is.
+    std::atomic<std::uint64_t> Sequence;
+    std::atomic<std::uint64_t> Length;
+};
+
+class SharedRegion final {
+   public:
+    ~SharedRegion() {
+        if (_base) ::munmap(_base, _size);
+        if (_owner) ::shm_unlink(_name.c_str());
+    }
+
+    static rt::expected<std::unique_ptr<SharedRegion>> Create(std::string const& name, std::size_t size) {
+        auto regionName = RegionName(name);
+        // The publisher owns the name, so whatever was left there, say by a publisher that died, is replaced.
+        ::shm_unlink(regionName.c_str());
+        int fd = ::shm_open(regionName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) return tl::make_unexpected(LastSystemError());
+        std::unique_ptr<SharedRegion> region(new SharedRegion(regionName, true));
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto error = LastSystemError();
+            ::close(fd);
+            return tl::make_unexpected(error);
+        }
+        auto mapped = region->Map(fd, size);
+        ::close(fd);
+        if (!mapped) return tl::make_unexpected(mapped.error());
+        return region;
+    }
+
+    static rt::expected<std::unique_ptr<SharedRegion>> Open(std::string const& name) {
+        auto regionName = RegionName(name);
+        int fd = ::shm_open(regionName.c_str(), O_RDWR, 0);
+        if (fd < 0) return tl::make_unexpected(LastSystemError());
+        std::unique_ptr<SharedRegion> region(new SharedRegion(regionName, false));
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            auto error = LastSystemError();
+            ::close(fd);
+            return tl::make_unexpected(error);
+        }
+        auto size = static_cast<std::size_t>(status.st_size);
+        if (size < sizeof(RegionHeader)) {
+            ::close(fd);
+            return tl::make_unexpected(CorruptRegion());
+        }
+        auto mapped = region->Map(fd, size);
+        ::close(fd);
+        if (!mapped) return tl::make_unexpected(mapped.error());
+
+        auto& header = region->Header();
+        if (std::memcmp(header.Magic, RegionMagic, sizeof(RegionMagic)) != 0 || header.Version != RegionVersion ||
+            header.Ready.load(std::memory_order_acquire) != 1 || header.Size != size ||
+            sizeof(RegionHeader) + header.SlotCount * sizeof(SlotHeader) > size)
+            return tl::make_unexpected(CorruptRegion());
+        for (std::uint32_t i = 0; i < header.SlotCount; ++i) {
+            auto& slot = region->Slot(i);
+            if (slot.Offset > size || slot.Capacity > size - slot.Offset ||
+                std::memchr(slot.Name, '\0', sizeof(slot.Name)) == nullptr)
+                return tl::make_unexpected(CorruptRegion());
+        }
+        return region;
+    }
+
+    RegionHeader& Header() const noexcept { return *reinterpret_cast<RegionHeader*>(_base); }
+
+    SlotHeader& Slot(std::size_t index) const noexcept {
+        return reinterpret_cast<SlotHeader*>(static_cast<char*>(_base) + sizeof(RegionHeader))[index];
+    }
+
+    char* Data(SlotHeader const& slot) const noexcept { return static_cast<char*>(_base) + slot.Offset; }
+
+    std::uint64_t Sequence(std::size_t index) const noexcept {
+        return Slot(index).Sequence.load(std::memory_order_acquire);
+    }
+
+    // Only one thread may write a slot at a time.
+    void Write(std::size_t index, char const* data, std::size_t length) {
+        auto& slot = Slot(index);
+        auto sequence = slot.Sequence.load(std::memory_order_relaxed);
+        slot.Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(Data(slot), data, length);
+        slot.Length.store(length, std::memory_order_relaxed);
+        slot.Sequence.store(sequence + 2, std::memory_order_release);
+
+        auto& header = Header();
+        header.Changes.fetch_add(1, std::memory_order_seq_cst);
+        if (header.Sleepers.load(std::memory_order_seq_cst) > 0) Wake();
+    }
+
+    // Copies the value of the slot out, and returns the sequence of the value copied, which is zero if there is none.
+    std::uint64_t Read(std::size_t index, std::string& value) const {
+        auto& slot = Slot(index);
+        for (;;) {
+            auto sequence = slot.Sequence.load(std::memory_order_acquire);
+            if (sequence == 0) return 0;
+            if (sequence & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto length = slot.Length.load(std::memory_order_relaxed);
+            // A length past the capacity can only have been read mid-write, which the check below would catch, but it
+            // must not be used to copy.
+            if (length <= slot.Capacity) {
+                value.resize(static_cast<std::size_t>(length));
+                std::memcpy(&value[0], Data(slot), static_cast<std::size_t>(length));
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.Sequence.load(std::memory_order_relaxed) == sequence && length <= slot.Capacity) return sequence;
+        }
+    }
+
+    // Sleeps until the change count is no longer the one seen, or the timeout passes, or for no reason at all.
+    void WaitForChange(std::uint32_t seen, std::chrono::milliseconds timeout) {
+        auto& header = Header();
+#ifdef __linux__
+        header.Sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (header.Changes.load(std::memory_order_seq_cst) == seen) {
+            struct timespec relative;
+            relative.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+            relative.tv_nsec = static_cast<long>(timeout.count() % 1000) * 1000000;
+            // Not FUTEX_PRIVATE_FLAG, since the waking is done by other processes.
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&header.Changes), FUTEX_WAIT, seen, &relative,
+                      nullptr, 0);
+        }
+        header.Sleepers.fetch_sub(1, std::memory_order_seq_cst);
+#else
+        (void)timeout;
+        if (header.Changes.load(std::memory_order_acquire) == seen)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+
+    void Wake() {
+#ifdef __linux__
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&Header().Changes), FUTEX_WAKE, INT_MAX, nullptr,
+                  nullptr, 0);
+#endif
+    }
+
+   private:
+    SharedRegion(std::string name, bool owner) : _name(std::move(name)), _owner(owner) {}
+
+    rt::expected<void> Map(int fd, std::size_t size) {
+        void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) return tl::make_unexpected(LastSystemError());
+        _base = base;
+        _size = size;
+        return {};
+    }
+
+    const std::string _name;
+    const bool _owner;
+    void* _base{nullptr};
+    std::size_t _size{0};
+};
+
+}  // namespace detail
+
+namespace {
+template <typename T>
+bool FeedDecoded(char const* begin, char const* end, InputPipe& pipe) {
+    T value;
+    if (!detail::ValueCodec<T>::Decode(begin, end, value) || begin != end) return false;
+    static_cast<DirectInputPipe<T>&>(pipe).Feed(std::move(value));
+    return true;
+}
+}  // namespace
+
+SharedMemoryPublisher::SharedMemoryPublisher(std::unique_ptr<detail::SharedRegion> region)
+    : _region(std::move(region)), _bound(_region->Header().SlotCount, false) {}
+
+SharedMemoryPublisher::~SharedMemoryPublisher() = default;
+
+rt::expected<std::shared_ptr<SharedMemoryPublisher>> SharedMemoryPublisher::Create(std::string const& name,
+                                                                                     Layout const& layout) {
+    auto const& slots = layout._slots;
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].Capacity == 0 || slots[i].Name.size() > MaxNameLength)
+            return make_feature_unexpected(feature_errc::invalid_operation);
+        for (std::size_t j = 0; j < i; ++j) {
+            if (slots[j].Name == slots[i].Name) return make_feature_unexpected(feature_errc::invalid_operation);
+        }
+    }
+
+    std::vector<std::size_t> offsets(slots.size());
+    std::size_t size = detail::AlignUp(sizeof(detail::RegionHeader) + slots.size() * sizeof(detail::SlotHeader));
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        offsets[i] = size;
+        size = detail::AlignUp(size + slots[i].Capacity);
+    }
+
+    auto regionExpected = detail::SharedRegion::Create(name, size);
+    if (!regionExpected) return tl::make_unexpected(regionExpected.error());
+    auto& region = *regionExpected;
+
+    // The region is zeroed when created, but the atomics are constructed in place all the same.
+    auto& header = *new (&region->Header()) detail::RegionHeader();
+    std::memcpy(header.Magic, detail::RegionMagic, sizeof(detail::RegionMagic));
+    header.Version = detail::RegionVersion;
+    header.SlotCount = static_cast<std::uint32_t>(slots.size());
+    header.Size = size;
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        auto& slot = *new (&region->Slot(i)) detail::SlotHeader();
+        std::memcpy(slot.Name, slots[i].Name.c_str(), slots[i].Name.size() + 1);
+        slot.Item = slots[i].Item;
+        slot.Container = slots[i].Container;
+        slot.Capacity = slots[i].Capacity;
+        slot.Offset = offsets[i];
+    }
+    header.Ready.store(1, std::memory_order_release);
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<SharedMemoryPublisher>(new SharedMemoryPublisher(std::move(region)));
+}
+
+rt::expected<std::size_t> SharedMemoryPublisher::BindSlot(std::string const& name, detail::CodecItem item,
+                                                          detail::CodecContainer container) {
+    for (std::size_t i = 0; i < _bound.size(); ++i) {
+        auto& slot = _region->Slot(i);
+        if (name != slot.Name) continue;
+        if (slot.Item != item || slot.Container != container)
+            return make_feature_unexpected(feature_errc::type_mismatch);
+        std::lock_guard<std::mutex> lock(_bindMutex);
+        if (_bound[i]) return make_feature_unexpected(feature_errc::already_bound);
+        _bound[i] = true;
+        return i;
+    }
+    return make_feature_unexpected(feature_errc::name_not_found);
+}
+
+void SharedMemoryPublisher::Write(std::size_t slot, std::string const& encoded) {
+    if (encoded.size() > _region->Slot(slot).Capacity) {
+        _oversized.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _region->Write(slot, encoded.data(), encoded.size());
+}
+
+class SharedMemoryProvider::Updater final : public ValueUpdater {
+   public:
+    struct Output {
+        std::size_t Index;
+        Feeder Feed;
+        std::shared_ptr<InputPipe> Pipe;
+    };
+
+    Updater(std::shared_ptr<detail::SharedRegion> region, std::vector<Output> outputs, std::function<void()> notifier)
+        : _region(std::move(region)),
+          _outputs(std::move(outputs)),
+          _seen(new std::atomic<std::uint64_t>[_outputs.size()]),
+          _notifier(std::move(notifier)) {
+        for (std::size_t i = 0; i < _outputs.size(); ++i) _seen[i].store(0, std::memory_order_relaxed);
+    }
+
+    // This is also called from the provider's watcher thread, which is why the sequences seen are atomic.
+    bool Changed() override {
+        for (std::size_t i = 0; i < _outputs.size(); ++i) {
+            if (_region->Sequence(_outputs[i].Index) != _seen[i].load(std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    std::error_code UpdateOutput() override {
+        for (std::size_t i = 0; i < _outputs.size(); ++i) {
+            auto& output = _outputs[i];
+            auto sequence = _region->Read(output.Index, _value);
+            if (sequence == _seen[i].load(std::memory_order_relaxed)) continue;
+            if (!output.Feed(_value.data(), _value.data() + _value.size(), *output.Pipe))
+                return make_feature_error(feature_errc::value_update_failure);
+            _seen[i].store(sequence, std::memory_order_relaxed);
+        }
+        return err_feature_ok();
+    }
+
+    void Notify() { _notifier(); }
+
+   private:
+    // The region rather than the provider, since the watcher holds updaters while it notifies them. Were the last
+    // reference to the provider among those, the watcher would be left to join itself.
+    const std::shared_ptr<detail::SharedRegion> _region;
+    const std::vector<Output> _outputs;
+    const std::unique_ptr<std::atomic<std::uint64_t>[]> _seen;
+    const std::function<void()> _notifier;
+    // Kept so that reading does not allocate once it has grown large enough.
+    std::string _value;
+};
+
+SharedMemoryProvider::SharedMemoryProvider(std::unique_ptr<detail::SharedRegion> region) : _region(std::move(region)) {
+    auto count = _region->Header().SlotCount;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        auto& slot = _region->Slot(i);
+        std::string name(slot.Name);
+        // Slots of types this does not know, say from a newer publisher, are left out.
+        auto add = [this, &name, i](auto tag) {
+            using T = typename decltype(tag)::Type;
+            _outputs.emplace(name, TypeDescriptor::Create<T>());
+            _slots.emplace(name, Slot{i, &FeedDecoded<T>});
+        };
+        detail::VisitCodecType(slot.Item, slot.Container, add);
+    }
+    // The changes are counted from here rather than from when the thread gets going, so that none made in between are
+    // missed.
+    auto seen = _region->Header().Changes.load(std::memory_order_acquire);
+    _watcher = std::thread([this, seen]() { Watch(seen); });
+}
+
+SharedMemoryProvider::~SharedMemoryProvider() {
+    _stopping.store(true, std::memory_order_release);
+    // This wakes observers in other processes too, but they take it as the spurious wake it is.
+    _region->Wake();
+    _watcher.join();
+}
+
+rt::expected<std::shared_ptr<SharedMemoryProvider>> SharedMemoryProvider::Open(std::string const& name) {
+    auto regionExpected = detail::SharedRegion::Open(name);
+    if (!regionExpected) return tl::make_unexpected(regionExpected.error());
+    // The constructor is private, so make_shared cannot be used.
+    return std::shared_ptr<SharedMemoryProvider>(new SharedMemoryProvider(std::move(regionExpected).value()));
+}
+
+std::unordered_map<std::string, TypeDescriptor> const& SharedMemoryProvider::Outputs() const { return _outputs; }
+
+rt::expected<std::shared_ptr<ValueUpdater>> SharedMemoryProvider::CreateValueUpdater(
+    std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+    std::function<void()> valuesChangedNotifier) const {
+    std::vector<Updater::Output> outputs;
+    outputs.reserve(outputToPipe.size());
+    for (auto const& pair : outputToPipe) {
+        auto found = _slots.find(pair.first);
+        if (found == _slots.end()) return make_feature_unexpected(feature_errc::name_not_found);
+        outputs.push_back({found->second.Index, found->second.Feed, pair.second});
+    }
+    auto updater = std::make_shared<Updater>(_region, std::move(outputs), std::move(valuesChangedNotifier));
+    {
+        std::lock_guard<std::mutex> lock(_updatersMutex);
+        _updaters.erase(std::remove_if(_updaters.begin(), _updaters.end(),
+                                       [](std::weak_ptr<Updater> const& weak) { return weak.expired(); }),
+                        _updaters.end());
+        _updaters.push_back(updater);
+    }
+    // Values already published are available from the start.
+    if (updater->Changed()) updater->Notify();
+    return std::static_pointer_cast<ValueUpdater>(updater);
+}
+
+void SharedMemoryProvider::Watch(std::uint32_t seen) {
+    auto& changes = _region->Header().Changes;
+    std::vector<std::shared_ptr<Updater>> updaters;
+    while (!_stopping.load(std::memory_order_acquire)) {
+        _region->WaitForChange(seen, std::chrono::milliseconds(100));
+        auto now = changes.load(std::memory_order_acquire);
+        if (now == seen) continue;
+        seen = now;
+        {
+            std::lock_guard<std::mutex> lock(_updatersMutex);
+            for (auto const& weak : _updaters) {
+                if (auto updater = weak.lock()) updaters.push_back(std::move(updater));
+            }
+        }
+        // The notifiers are called without the lock, since they may well take locks of their own.
+        for (auto& updater : updaters) {
+            if (updater->Changed()) updater->Notify();
+        }
+        updaters.clear();
+    }
+}
+
+}  // namespace inference
+
+#endif
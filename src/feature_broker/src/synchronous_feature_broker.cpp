@@ -5,6 +5,7 @@
 
 namespace inference {
 
-SynchronousFeatureBroker::SynchronousFeatureBroker(std::shared_ptr<const Model> model) : FeatureBrokerBase(model) {}
+SynchronousFeatureBroker::SynchronousFeatureBroker(std::shared_ptr<const Model> model)
+    : FeatureBrokerBase(model, true) {}
 
 }  // namespace inference
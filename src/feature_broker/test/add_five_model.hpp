@@ -9,6 +9,7 @@
 #include <inference/type_descriptor.hpp>
 #include <inference/value_updater.hpp>
 #include <map>
+#include <string>
 #include <unordered_map>
 
 using namespace ::inference;
@@ -35,13 +36,14 @@ class AddFiveValueUpdater : public inference::ValueUpdater {
 };
 
 /// <summary>
-/// Given a single input 'A' adds five to it and publishes it as the output 'X'.
+/// Given a single input 'A' adds five to it and publishes it as the output 'X'. The names can be changed, so that
+/// several of these can be chained together.
 /// </summary>
 class AddFiveModel : public Model {
    public:
-    AddFiveModel() {
-        _inputs.emplace("A", TypeDescriptor::Create<float>());
-        _outputs.emplace("X", TypeDescriptor::Create<float>());
+    explicit AddFiveModel(std::string input = "A", std::string output = "X") : _input(input), _output(output) {
+        _inputs.emplace(_input, TypeDescriptor::Create<float>());
+        _outputs.emplace(_output, TypeDescriptor::Create<float>());
     }
 
     ~AddFiveModel() {}
@@ -51,7 +53,7 @@ class AddFiveModel : public Model {
     std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
 
     std::vector<std::string> GetRequirements(std::string const& outputName) const override {
-        std::vector<std::string> requirements = {"A"};
+        std::vector<std::string> requirements = {_input};
         return requirements;
     }
 
@@ -60,12 +62,12 @@ class AddFiveModel : public Model {
         std::map<std::string, std::shared_ptr<inference::InputPipe>> const& outputToPipe,
         std::function<void()> outOfBandNotifier) const override {
         outOfBandNotifier(); // No out of band information, so call and ignore henceforth.
-        auto iterPipe = outputToPipe.find("X");
+        auto iterPipe = outputToPipe.find(_output);
         if (iterPipe == outputToPipe.end()) {
             return make_feature_unexpected(feature_errc::name_not_found);
         }
 
-        auto iterHandle = inputToHandle.find("A");
+        auto iterHandle = inputToHandle.find(_input);
         if (iterHandle == inputToHandle.end()) {
             return make_feature_unexpected(feature_errc::name_not_found);
         }
@@ -77,6 +79,8 @@ class AddFiveModel : public Model {
     }
 
    private:
+    const std::string _input;
+    const std::string _output;
     std::unordered_map<std::string, TypeDescriptor> _inputs;
     std::unordered_map<std::string, TypeDescriptor> _outputs;
 };
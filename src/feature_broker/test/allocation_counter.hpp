@@ -0,0 +1,23 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+
+namespace inference_test {
+/// <summary>
+/// Counts the heap allocations made through the global operator new on the calling thread while it is alive. The test
+/// executable replaces the global operator new to make the count, which is why this lives with the tests rather than
+/// the library.
+/// </summary>
+class AllocationCounter final {
+   public:
+    AllocationCounter();
+
+    std::size_t Count() const;
+
+   private:
+    const std::size_t _start;
+};
+}  // namespace inference_test
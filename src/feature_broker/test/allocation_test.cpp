@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <cstddef>
+#include <functional>
+#include <inference/feature_broker.hpp>
+#include <inference/synchronous_feature_broker.hpp>
+#include <memory>
+#include <string>
+
+#include "add_five_model.hpp"
+#include "allocation_counter.hpp"
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+// The allocations made by each stage of a feed and update cycle, once the cycle has been run often enough to warm up.
+struct CycleAllocations {
+    std::size_t Feed = 0;
+    std::size_t Update = 0;
+};
+
+CycleAllocations CountCycle(std::function<void(int)> const& feed, std::function<bool()> const& update) {
+    const int warmup = 3;
+    const int cycles = 100;
+    CycleAllocations counts;
+    for (int i = 0; i < warmup + cycles; ++i) {
+        std::size_t feedCount, updateCount;
+        bool updated;
+        {
+            inference_test::AllocationCounter counter;
+            feed(i);
+            feedCount = counter.Count();
+        }
+        {
+            inference_test::AllocationCounter counter;
+            updated = update();
+            updateCount = counter.Count();
+        }
+        EXPECT_TRUE(updated);
+        if (i < warmup) continue;
+        counts.Feed += feedCount;
+        counts.Update += updateCount;
+    }
+    return counts;
+}
+}  // namespace
+
+TEST(InferenceTestSuite, SteadyStateScalarCycleDoesNotAllocate) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddFiveModel>());
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    float value;
+    auto counts = CountCycle([&a](int i) { a->Feed(static_cast<float>(i)); },
+                             [&x, &value]() { return x->UpdateIfChanged(value).value(); });
+    EXPECT_EQ(0, counts.Feed) << "Allocations feeding the root broker.";
+    EXPECT_EQ(0, counts.Update) << "Allocations updating the root broker.";
+
+    // The same through a fork, with the input bound on the parent.
+    auto parent = std::make_shared<FeatureBroker>();
+    auto pa = parent->BindInput<float>("A").value();
+    auto fx = parent->Fork(std::make_shared<inference_test::AddFiveModel>()).value()->BindOutput<float>("X").value();
+    counts = CountCycle([&pa](int i) { pa->Feed(static_cast<float>(i)); },
+                        [&fx, &value]() { return fx->UpdateIfChanged(value).value(); });
+    EXPECT_EQ(0, counts.Feed) << "Allocations feeding the forked broker.";
+    EXPECT_EQ(0, counts.Update) << "Allocations updating the forked broker.";
+
+    auto sfb = std::make_shared<SynchronousFeatureBroker>(std::make_shared<inference_test::AddFiveModel>());
+    auto sa = sfb->BindInput<float>("A").value();
+    auto sx = sfb->BindOutput<float>("X").value();
+    counts = CountCycle([&sa](int i) { sa->Feed(static_cast<float>(i)); },
+                        [&sx, &value]() { return sx->UpdateIfChanged(value).value(); });
+    EXPECT_EQ(0, counts.Feed) << "Allocations feeding the synchronous broker.";
+    EXPECT_EQ(0, counts.Update) << "Allocations updating the synchronous broker.";
+}
+
+TEST(InferenceTestSuite, SteadyStateTensorCycleDoesNotAllocate) {
+    {
+        // Type descriptors are created and compared all over, including by models as they run.
+        inference_test::AllocationCounter counter;
+        auto type = TypeDescriptor::Create<Tensor<float>>();
+        EXPECT_EQ(0, counter.Count()) << "Allocations creating a type descriptor.";
+        // Checked once the count is taken, so that the descriptor is used without the check being counted.
+        EXPECT_EQ(TypeDescriptor::Create<Tensor<float>>(), type);
+    }
+
+    auto model = std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("T", "O");
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto t = fb->BindInput<Tensor<float>>("T").value();
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+    // Fixed shape, with the producer holding on to its tensor.
+    std::shared_ptr<float> data(new float[6]{}, std::default_delete<float[]>());
+    Tensor<float> tensor(data, {2, 3});
+    Tensor<float> value;
+    auto counts = CountCycle([&t, &tensor](int i) {
+        tensor.Data()[0] = static_cast<float>(i);
+        t->Feed(tensor);
+    }, [&o, &value]() { return o->UpdateIfChanged(value).value(); });
+    EXPECT_EQ(0, counts.Feed) << "Allocations feeding a fixed shape tensor.";
+    EXPECT_EQ(0, counts.Update) << "Allocations updating a fixed shape tensor.";
+}
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/feature_provider.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace ::inference;
+
+namespace inference_test {
+// A provider of a single float output, standing in for something like a remote lookup: each fetch of the value takes
+// a fixed delay, and happens asynchronously.
+class DelayedAsyncProvider : public FeatureProvider {
+   public:
+    DelayedAsyncProvider(std::string const &name, std::chrono::milliseconds delay) : _name(name), _delay(delay) {
+        _outputs.emplace(name, TypeDescriptor::Create<float>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const &Outputs() const override { return _outputs; }
+
+    void Set(float value) {
+        std::vector<std::shared_ptr<Updater>> toNotify;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _value = value;
+            _set = true;
+            _error = std::error_code();
+            for (auto &weak : _updaters) {
+                if (auto updater = weak.lock()) toNotify.push_back(updater);
+            }
+        }
+        for (auto &updater : toNotify) updater->MarkChanged();
+    }
+
+    // Subsequent fetches fail with this error, until the next Set.
+    void Fail(std::error_code error) {
+        Set(0);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = error;
+    }
+
+    int Fetches() const { return _fetches; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<InputPipe>> const &outputToPipe,
+        std::function<void()> valuesChangedNotifier) const override {
+        auto pipe = std::static_pointer_cast<DirectInputPipe<float>>(outputToPipe.at(_name));
+        auto updater = std::make_shared<Updater>(
+            std::static_pointer_cast<const DelayedAsyncProvider>(shared_from_this()), pipe, valuesChangedNotifier);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _updaters.push_back(updater);
+        if (_set) updater->MarkChanged();
+        return std::static_pointer_cast<ValueUpdater>(updater);
+    }
+
+   private:
+    class Updater : public AsyncValueUpdater {
+       public:
+        Updater(std::shared_ptr<const DelayedAsyncProvider> parent, std::shared_ptr<DirectInputPipe<float>> pipe,
+                std::function<void()> notifier)
+            : _parent(std::move(parent)), _pipe(std::move(pipe)), _notifier(std::move(notifier)) {}
+
+        void MarkChanged() {
+            _changed = true;
+            _notifier();
+        }
+
+        bool Changed() override { return _changed; }
+
+        std::future<std::error_code> UpdateOutputAsync() override {
+            _changed = false;
+            ++_parent->_fetches;
+            auto parent = _parent;
+            auto pipe = _pipe;
+            return std::async(std::launch::async, [parent, pipe]() {
+                std::this_thread::sleep_for(parent->_delay);
+                std::lock_guard<std::mutex> lock(parent->_mutex);
+                if (parent->_error) return parent->_error;
+                pipe->Feed(parent->_value);
+                return err_feature_ok();
+            });
+        }
+
+       private:
+        const std::shared_ptr<const DelayedAsyncProvider> _parent;
+        const std::shared_ptr<DirectInputPipe<float>> _pipe;
+        const std::function<void()> _notifier;
+        std::atomic<bool> _changed{false};
+    };
+
+    const std::string _name;
+    const std::chrono::milliseconds _delay;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+
+    mutable std::mutex _mutex;
+    float _value{0};
+    bool _set{false};
+    std::error_code _error;
+    mutable std::atomic<int> _fetches{0};
+    mutable std::vector<std::weak_ptr<Updater>> _updaters;
+};
+
+}  // namespace inference_test
@@ -0,0 +1,106 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <inference/feature_broker.hpp>
+#include <inference/synchronous_feature_broker.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_feature_provider.hpp"
+#include "gtest/gtest.h"
+#include "sum_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+const std::vector<std::string> names = {"A", "B", "C", "D", "E"};
+
+std::vector<std::shared_ptr<inference_test::DelayedAsyncProvider>> BindProviders(FeatureBroker& fb,
+                                                                                  std::chrono::milliseconds delay) {
+    std::vector<std::shared_ptr<inference_test::DelayedAsyncProvider>> providers;
+    for (auto& name : names) {
+        auto provider = std::make_shared<inference_test::DelayedAsyncProvider>(name, delay);
+        EXPECT_TRUE((bool)fb.BindInputs(provider));
+        providers.push_back(provider);
+    }
+    return providers;
+}
+}  // namespace
+
+TEST(InferenceTestSuite, AsyncProvidersFetchConcurrently) {
+    const auto delay = std::chrono::milliseconds(50);
+    auto model = std::make_shared<inference_test::SumModel>(names);
+    FeatureBroker fb(model);
+    auto providers = BindProviders(fb, delay);
+
+    auto outputExpected = fb.BindOutput<float>("X");
+    ASSERT_TRUE(outputExpected && outputExpected.value());
+    auto output = outputExpected.value();
+
+    for (std::size_t i = 0; i < providers.size(); ++i) providers[i]->Set(static_cast<float>(i + 1));
+
+    float value = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto updateExpected = output->UpdateIfChanged(value);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(15.0f, value);
+
+    // Had the fetches happened one after the other, this would have taken five times the delay. Be generous, since
+    // this is a timing based test.
+    ASSERT_LT(elapsed, delay * 3);
+    for (auto& provider : providers) ASSERT_EQ(1, provider->Fetches());
+}
+
+TEST(InferenceTestSuite, AsyncProvidersPrefetchOnBind) {
+    auto model = std::make_shared<inference_test::SumModel>(names);
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto providers = BindProviders(*fb, std::chrono::milliseconds(5));
+    for (std::size_t i = 0; i < providers.size(); ++i) providers[i]->Set(static_cast<float>(i + 1));
+
+    // Since the values are already available, binding the output on a fork should start fetching them.
+    auto fork = fb->Fork().value();
+    auto outputExpected = fork->BindOutput<float>("X");
+    ASSERT_TRUE(outputExpected && outputExpected.value());
+    auto output = outputExpected.value();
+    for (auto& provider : providers) ASSERT_EQ(1, provider->Fetches());
+
+    float value = 0;
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(15.0f, value);
+    // The prefetched values were used, rather than fetched again.
+    for (auto& provider : providers) ASSERT_EQ(1, provider->Fetches());
+
+    providers[0]->Set(10);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(24.0f, value);
+    ASSERT_EQ(2, providers[0]->Fetches());
+    ASSERT_EQ(1, providers[1]->Fetches());
+}
+
+TEST(InferenceTestSuite, AsyncProviderError) {
+    auto model = std::make_shared<inference_test::SumModel>(names);
+    SynchronousFeatureBroker fb(model);
+    std::vector<std::shared_ptr<inference_test::DelayedAsyncProvider>> providers;
+    for (auto& name : names) {
+        providers.push_back(std::make_shared<inference_test::DelayedAsyncProvider>(name, std::chrono::milliseconds(1)));
+        ASSERT_TRUE((bool)fb.BindInputs(providers.back()));
+        providers.back()->Set(1);
+    }
+    auto output = fb.BindOutput<float>("X").value();
+
+    float value = 0;
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(5.0f, value);
+
+    auto error = make_feature_error(feature_errc::value_update_failure);
+    providers[2]->Fail(error);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_FALSE(updateExpected);
+    ASSERT_EQ(error, updateExpected.error());
+}
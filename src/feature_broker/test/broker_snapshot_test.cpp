@@ -0,0 +1,164 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <inference/broker_snapshot.hpp>
+#include <inference/feature_broker.hpp>
+#include <inference/tensor.hpp>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+#include "tuple_feature_providers.hpp"
+
+using namespace ::inference;
+
+namespace {
+std::string SnapshotPath(char const* name) { return testing::TempDir() + name; }
+}  // namespace
+
+TEST(InferenceTestSuite, BrokerSnapshotSaveAndRestore) {
+    auto path = SnapshotPath("broker_snapshot_test.snap");
+    {
+        auto fb = std::make_shared<FeatureBroker>();
+        fb->BindInput<float>("A").value()->Feed(1);
+        fb->BindBroadcastInput<std::string>("S").value()->Feed("context");
+        std::shared_ptr<double> data(new double[3]{0.5, 1.5, 2.5}, std::default_delete<double[]>());
+        fb->BindInput<Tensor<double>>("T").value()->Feed(Tensor<double>(data, {3}));
+        // Never fed, so left out.
+        fb->BindInput<int32_t>("N").value();
+        auto fp = inference_test::TupleProviderFactory::Create<int64_t>("P");
+        fp->Set<0>(int64_t(42));
+        ASSERT_TRUE(fb->BindInputs(fp));
+
+        auto savedExpected = BrokerSnapshot::Save(*fb, path);
+        ASSERT_TRUE(savedExpected);
+        ASSERT_EQ(4, savedExpected.value());
+    }
+
+    auto snapshot = BrokerSnapshot::Open(path).value();
+    auto fb = std::make_shared<FeatureBroker>();
+    // An input bound before restoring is fed the value, and stays the way to feed live updates.
+    auto a = fb->BindInput<float>("A").value();
+    auto restoredExpected = snapshot->Restore(*fb);
+    ASSERT_TRUE(restoredExpected);
+    ASSERT_EQ(4, restoredExpected.value());
+    // The snapshot can go away, since anything referring to its mapping keeps it open.
+    snapshot.reset();
+
+    auto x = fb->Fork(std::make_shared<inference_test::AddFiveModel>()).value()->BindOutput<float>("X").value();
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(6, value);
+    a->Feed(2);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(7, value);
+
+    auto sModel = std::make_shared<inference_test::PassThroughModel<std::string>>("S", "SO");
+    std::string stringValue;
+    ASSERT_TRUE(fb->Fork(sModel).value()->BindOutput<std::string>("SO").value()->UpdateIfChanged(stringValue).value());
+    ASSERT_EQ("context", stringValue);
+
+    auto tModel = std::make_shared<inference_test::PassThroughModel<Tensor<double>>>("T", "TO");
+    Tensor<double> tensor;
+    ASSERT_TRUE(fb->Fork(tModel).value()->BindOutput<Tensor<double>>("TO").value()->UpdateIfChanged(tensor).value());
+    ASSERT_EQ(std::vector<size_t>{3}, tensor.Dimensions());
+    ASSERT_EQ(0, reinterpret_cast<std::uintptr_t>(tensor.Data()) % alignof(double));
+    ASSERT_EQ(1.5, tensor.Data()[1]);
+    // Writes to the tensor are the process's own.
+    tensor.Data()[1] = 3;
+
+    // The provider output comes back as an input.
+    auto pModel = std::make_shared<inference_test::PassThroughModel<int64_t>>("P", "PO");
+    int64_t longValue;
+    ASSERT_TRUE(fb->Fork(pModel).value()->BindOutput<int64_t>("PO").value()->UpdateIfChanged(longValue).value());
+    ASSERT_EQ(42, longValue);
+
+    // Restoring again goes through the inputs now bound.
+    auto again = BrokerSnapshot::Open(path).value();
+    ASSERT_EQ(4, again->Restore(*fb).value());
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(6, value);
+    std::remove(path.c_str());
+}
+
+TEST(InferenceTestSuite, BrokerSnapshotErrors) {
+    auto path = SnapshotPath("broker_snapshot_test_errors.snap");
+    {
+        auto fb = std::make_shared<FeatureBroker>();
+        fb->BindInput<float>("A").value()->Feed(1);
+        std::shared_ptr<float> data(new float[2]{1, 2}, std::default_delete<float[]>());
+        fb->BindInput<Tensor<float>>("E").value()->Feed(Tensor<float>(data, {2}));
+        // A stream input holds a queue of events rather than a value, so it is left out.
+        auto stream = fb->BindStreamInput<float>("S").value();
+        stream->Feed(1);
+        stream->Feed(2);
+        ASSERT_EQ(2, BrokerSnapshot::Save(*fb, path).value());
+    }
+    auto snapshot = BrokerSnapshot::Open(path).value();
+
+    auto fb = std::make_shared<FeatureBroker>();
+    fb->BindInput<int32_t>("A").value();
+    auto restoredExpected = snapshot->Restore(*fb);
+    ASSERT_FALSE(restoredExpected);
+    ASSERT_EQ(feature_errc::type_mismatch, restoredExpected.error());
+
+    // A live provider is left to supply its own value.
+    auto fb2 = std::make_shared<FeatureBroker>();
+    ASSERT_TRUE(fb2->BindInputs(inference_test::TupleProviderFactory::Create<float>("A")));
+    ASSERT_EQ(1, snapshot->Restore(*fb2).value());
+
+    // A stream input has the type of the tensors it batches into, but no value to restore into it.
+    auto fb3 = std::make_shared<FeatureBroker>();
+    fb3->BindStreamInput<float>("E").value();
+    restoredExpected = snapshot->Restore(*fb3);
+    ASSERT_FALSE(restoredExpected);
+    ASSERT_EQ(feature_errc::type_mismatch, restoredExpected.error());
+
+    auto file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(nullptr, file);
+    std::fputs("Not a snapshot.", file);
+    std::fclose(file);
+    auto openExpected = BrokerSnapshot::Open(path);
+    ASSERT_FALSE(openExpected);
+    ASSERT_EQ(std::errc::illegal_byte_sequence, openExpected.error());
+    std::remove(path.c_str());
+}
+
+TEST(InferenceTestSuite, BrokerSnapshotOverflowingDimensions) {
+    auto path = SnapshotPath("broker_snapshot_test_dims.snap");
+    {
+        auto fb = std::make_shared<FeatureBroker>();
+        std::shared_ptr<float> data(new float[4]{1, 2, 3, 4}, std::default_delete<float[]>());
+        fb->BindInput<Tensor<float>>("T").value()->Feed(Tensor<float>(data, {1, 4}));
+        ASSERT_EQ(1, BrokerSnapshot::Save(*fb, path).value());
+    }
+    // Change the dimensions to ones whose product wraps around to the four items there are.
+    std::string contents;
+    {
+        std::ifstream in(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::uint64_t dims[2] = {1, 4};
+    auto found = contents.find(std::string(reinterpret_cast<char const*>(dims), sizeof(dims)));
+    ASSERT_NE(std::string::npos, found);
+    dims[0] = static_cast<std::uint64_t>(std::numeric_limits<std::size_t>::max() / 4 + 2);
+    contents.replace(found, sizeof(dims), reinterpret_cast<char const*>(dims), sizeof(dims));
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+
+    auto fb = std::make_shared<FeatureBroker>();
+    auto restoredExpected = BrokerSnapshot::Open(path).value()->Restore(*fb);
+    ASSERT_FALSE(restoredExpected);
+    ASSERT_EQ(std::errc::illegal_byte_sequence, restoredExpected.error());
+    std::remove(path.c_str());
+}
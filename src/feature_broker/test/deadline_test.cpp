@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <inference/deadline.hpp>
+#include <inference/feature_broker.hpp>
+#include <inference/inference_executor.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "add_model.hpp"
+#include "async_feature_provider.hpp"
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+Deadline In(std::chrono::milliseconds duration) { return std::chrono::steady_clock::now() + duration; }
+
+// Passes its input through, but like a model that shares a runtime with others, must first acquire a scheduler. It
+// gives up on it once the deadline of the update passes.
+class ScheduledModel final : public Model {
+   public:
+    explicit ScheduledModel(std::shared_ptr<PriorityScheduler> scheduler) : _scheduler(std::move(scheduler)) {
+        _inputs.emplace("A", TypeDescriptor::Create<float>());
+        _outputs.emplace("X", TypeDescriptor::Create<float>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+    std::vector<std::string> GetRequirements(std::string const&) const override { return {"A"}; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();
+        return std::static_pointer_cast<ValueUpdater>(
+            std::make_shared<Updater>(_scheduler, inputToHandle.at("A"), outputToPipe.at("X")));
+    }
+
+   private:
+    class Updater final : public ValueUpdater {
+       public:
+        Updater(std::shared_ptr<PriorityScheduler> scheduler, std::shared_ptr<IHandle> handle,
+                std::shared_ptr<InputPipe> pipe)
+            : _scheduler(std::move(scheduler)),
+              _handle(std::static_pointer_cast<Handle<float>>(handle)),
+              _pipe(std::static_pointer_cast<DirectInputPipe<float>>(pipe)) {}
+
+        std::error_code UpdateOutput() override {
+            auto lease = _scheduler->TryAcquireUntil(CurrentPriority(), CurrentDeadline());
+            if (!lease) return make_feature_error(feature_errc::deadline_exceeded);
+            _pipe->Feed(_handle->Value());
+            return err_feature_ok();
+        }
+
+       private:
+        const std::shared_ptr<PriorityScheduler> _scheduler;
+        const std::shared_ptr<Handle<float>> _handle;
+        const std::shared_ptr<DirectInputPipe<float>> _pipe;
+    };
+
+    const std::shared_ptr<PriorityScheduler> _scheduler;
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+}  // namespace
+
+TEST(InferenceTestSuite, DeadlineTryAcquireUntil) {
+    PriorityScheduler scheduler;
+    {
+        auto lease = scheduler.Acquire(PriorityClass::Normal);
+        ASSERT_FALSE(scheduler.TryAcquireUntil(PriorityClass::Interactive, In(std::chrono::milliseconds(10))));
+        // The acquisition that gave up is no longer waiting.
+        ASSERT_EQ(0, scheduler.Waiting(PriorityClass::Interactive));
+        ASSERT_EQ(1, scheduler.Stats(PriorityClass::Interactive).TimedOut);
+    }
+    ASSERT_TRUE(scheduler.TryAcquireUntil(PriorityClass::Interactive, In(std::chrono::milliseconds(10))));
+    ASSERT_EQ(1, scheduler.Stats(PriorityClass::Interactive).Acquired);
+}
+
+TEST(InferenceTestSuite, DeadlineSlowProvider) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::PassThroughModel<float>>("A", "X"));
+    auto provider = std::make_shared<inference_test::DelayedAsyncProvider>("A", std::chrono::milliseconds(100));
+    ASSERT_TRUE((bool)fb->BindInputs(provider));
+    auto x = fb->BindOutput<float>("X").value();
+    float value = 0;
+
+    // With no value to fall back on, running out of time is an error.
+    provider->Set(1);
+    auto status = x->UpdateIfChanged(value, In(std::chrono::milliseconds(10)));
+    ASSERT_FALSE(status);
+    ASSERT_EQ(make_feature_error(feature_errc::deadline_exceeded), status.error());
+    // The fetch was left in flight rather than abandoned, so given the time it is collected rather than started again.
+    ASSERT_EQ(UpdateStatus::Updated, x->UpdateIfChanged(value, In(std::chrono::seconds(5))).value());
+    ASSERT_EQ(1, value);
+    ASSERT_EQ(1, provider->Fetches());
+
+    // Once there is a value, running out of time leaves it as it was.
+    provider->Set(2);
+    ASSERT_EQ(UpdateStatus::Stale, x->UpdateIfChanged(value, In(std::chrono::milliseconds(10))).value());
+    ASSERT_EQ(1, value);
+    ASSERT_EQ(UpdateStatus::Updated, x->UpdateIfChanged(value, In(std::chrono::seconds(5))).value());
+    ASSERT_EQ(2, value);
+    ASSERT_EQ(2, provider->Fetches());
+    ASSERT_EQ(UpdateStatus::Unchanged, x->UpdateIfChanged(value, In(std::chrono::milliseconds(10))).value());
+}
+
+TEST(InferenceTestSuite, DeadlineSlowProviderFirstUpdate) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddModel>());
+    auto a = fb->BindInput<float>("A").value();
+    auto provider = std::make_shared<inference_test::DelayedAsyncProvider>("B", std::chrono::milliseconds(50));
+    ASSERT_TRUE((bool)fb->BindInputs(provider));
+    auto x = fb->BindOutput<float>("X").value();
+    float value = 0;
+
+    a->Feed(1);
+    provider->Set(2);
+    auto status = x->UpdateIfChanged(value, In(std::chrono::milliseconds(5)));
+    ASSERT_FALSE(status);
+    ASSERT_EQ(make_feature_error(feature_errc::deadline_exceeded), status.error());
+    // The input that was in time was consumed by that update, but is still there to go with the fetch once it lands,
+    // without having to be fed again.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(x->Changed());
+    ASSERT_EQ(UpdateStatus::Updated, x->UpdateIfChanged(value, In(std::chrono::seconds(5))).value());
+    ASSERT_EQ(3, value);
+    ASSERT_EQ(1, provider->Fetches());
+}
+
+TEST(InferenceTestSuite, DeadlineBusyModel) {
+    auto scheduler = std::make_shared<PriorityScheduler>();
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<ScheduledModel>(scheduler));
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    float value = 0;
+
+    a->Feed(1);
+    ASSERT_EQ(UpdateStatus::Updated, x->UpdateIfChanged(value, In(std::chrono::milliseconds(10))).value());
+    ASSERT_EQ(1, value);
+
+    a->Feed(2);
+    {
+        // Something else holds the model, so the update runs out of time waiting for it.
+        auto lease = scheduler->Acquire(PriorityClass::Normal);
+        ASSERT_EQ(UpdateStatus::Stale, x->UpdateIfChanged(value, In(std::chrono::milliseconds(10))).value());
+        ASSERT_EQ(1, value);
+        ASSERT_TRUE(x->Changed());
+    }
+    ASSERT_EQ(UpdateStatus::Updated, x->UpdateIfChanged(value, In(std::chrono::milliseconds(10))).value());
+    ASSERT_EQ(2, value);
+    // Without a deadline the update waits as long as it takes.
+    a->Feed(3);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(3, value);
+    ASSERT_EQ(1, scheduler->Stats(PriorityClass::Normal).TimedOut);
+}
+
+TEST(InferenceTestSuite, DeadlineWaitUntilChanged) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::PassThroughModel<float>>("A", "X"));
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    float value = 0;
+
+    ASSERT_FALSE(x->WaitUntilChanged(In(std::chrono::milliseconds(10))).value());
+    a->Feed(1);
+    ASSERT_TRUE(x->WaitUntilChanged(In(std::chrono::milliseconds(10))).value());
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    // Having given up once, the pipe can still be waited upon.
+    ASSERT_FALSE(x->WaitUntilChanged(In(std::chrono::milliseconds(10))).value());
+    std::thread feeder([&a]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        a->Feed(2);
+    });
+    ASSERT_TRUE(x->WaitUntilChanged(In(std::chrono::seconds(5))).value());
+    feeder.join();
+}
+
+TEST(InferenceTestSuite, DeadlineRunUntil) {
+    InferenceExecutor executor(1);
+    auto gate = executor.CreateTenant("gate");
+    auto tenant = executor.CreateTenant("tenant");
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool open = false;
+    gate->Submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&open]() { return open; });
+    });
+    // The only worker is held, so the function is withdrawn before it starts.
+    bool ran = false, cancelled = false;
+    ASSERT_FALSE(tenant->RunUntil([&ran]() { ran = true; }, In(std::chrono::milliseconds(10)),
+                                  [&cancelled]() { cancelled = true; }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open = true;
+    }
+    cv.notify_one();
+    tenant->Run([]() {});
+    ASSERT_FALSE(ran);
+    ASSERT_FALSE(cancelled);
+    ASSERT_EQ(1, tenant->Completed());
+
+    // Once started, a function runs to completion, but is asked to stop early.
+    std::atomic<bool> stop{false};
+    ASSERT_TRUE(tenant->RunUntil(
+        [&stop]() {
+            while (!stop) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        },
+        In(std::chrono::milliseconds(10)), [&stop]() { stop = true; }));
+    ASSERT_TRUE(stop);
+    ASSERT_EQ(2, tenant->Completed());
+}
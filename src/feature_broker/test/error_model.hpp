@@ -10,14 +10,15 @@
 #include <inference/value_updater.hpp>
 #include <map>
 #include <memory>
+#include <string>
 #include <system_error>
 #include <unordered_map>
 
 using namespace ::inference;
 
 namespace inference_test {
-/// Given a single input 'A' adds five to it and publishes it as the output 'X', unless the input happens to be 3, in
-/// which case it yields an error.
+/// Given a single input, by default 'A', adds five to it and publishes it as the output, by default 'X', unless the
+/// input happens to be 3, in which case it yields an error.
 class ErrorIfThreeModel : public Model {
    private:
     class ValueUpdaterImpl : public inference::ValueUpdater {
@@ -40,15 +41,15 @@ class ErrorIfThreeModel : public Model {
     };
 
    public:
-    ErrorIfThreeModel() {
-        _inputs.emplace("A", TypeDescriptor::Create<float>());
-        _outputs.emplace("X", TypeDescriptor::Create<float>());
+    explicit ErrorIfThreeModel(std::string input = "A", std::string output = "X") : _input(input), _output(output) {
+        _inputs.emplace(_input, TypeDescriptor::Create<float>());
+        _outputs.emplace(_output, TypeDescriptor::Create<float>());
     }
 
     std::unordered_map<std::string, TypeDescriptor> const &Inputs() const override { return _inputs; }
     std::unordered_map<std::string, TypeDescriptor> const &Outputs() const override { return _outputs; }
     std::vector<std::string> GetRequirements(std::string const &outputName) const override {
-        std::vector<std::string> requirements = {"A"};
+        std::vector<std::string> requirements = {_input};
         return requirements;
     }
 
@@ -57,10 +58,10 @@ class ErrorIfThreeModel : public Model {
         std::map<std::string, std::shared_ptr<inference::InputPipe>> const &outputToPipe,
         std::function<void()> outOfBandNotifier) const override {
         outOfBandNotifier(); // No out of band information, so call and ignore henceforth.
-        auto iterHandle = inputToHandle.find("A");
+        auto iterHandle = inputToHandle.find(_input);
         std::shared_ptr<IHandle> handle = iterHandle == inputToHandle.end() ? nullptr : iterHandle->second;
 
-        auto iterPipe = outputToPipe.find("X");
+        auto iterPipe = outputToPipe.find(_output);
         std::shared_ptr<InputPipe> pipe = iterPipe == outputToPipe.end() ? nullptr : iterPipe->second;
 
         auto updater = std::make_shared<ValueUpdaterImpl>(handle, pipe);
@@ -68,6 +69,8 @@ class ErrorIfThreeModel : public Model {
     }
 
    private:
+    const std::string _input;
+    const std::string _output;
     std::unordered_map<std::string, TypeDescriptor> _inputs;
     std::unordered_map<std::string, TypeDescriptor> _outputs;
 };
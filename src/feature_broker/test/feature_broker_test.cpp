@@ -1,17 +1,52 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+#include <atomic>
+#include <chrono>
 #include <inference/feature_broker.hpp>
+#include <inference/model_graph.hpp>
 #include <inference/synchronous_feature_broker.hpp>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "add_five_model.hpp"
 #include "add_model.hpp"
 #include "error_model.hpp"
 #include "gtest/gtest.h"
+#include "release_model.hpp"
+#include "three_output_model.hpp"
+#include "tuple_feature_providers.hpp"
 
 using namespace ::inference;
 
+namespace {
+// Passes everything on to the provider it wraps, but counts how often its outputs are looked up. Binding an output
+// looks them up to check the types of what the provider is bound for, so this tells when a binding plan's topology had
+// to be worked out again rather than reused.
+class LookupCountingProvider final : public FeatureProvider {
+   public:
+    explicit LookupCountingProvider(std::shared_ptr<FeatureProvider> inner) : _inner(std::move(inner)) {}
+
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override {
+        ++_lookups;
+        return _inner->Outputs();
+    }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> valuesChangedNotifier) const override {
+        return _inner->CreateValueUpdater(outputToPipe, std::move(valuesChangedNotifier));
+    }
+
+    int Lookups() const { return _lookups; }
+
+   private:
+    const std::shared_ptr<FeatureProvider> _inner;
+    mutable std::atomic<int> _lookups{0};
+};
+}  // namespace
+
 TEST(InferenceTestSuite, FeatureBrokerCreation) { FeatureBroker fb; }
 
 TEST(InferenceTestSuite, FeatureBrokerSingleInputAndOutput) {
@@ -652,3 +687,335 @@ TEST(InferenceTestSuite, FeatureBrokerInheritanceModelWithMultipleInputs) {
     ASSERT_TRUE(updateExpected && updateExpected.value());
     ASSERT_EQ(3.f, outputVal);
 }
+
+TEST(InferenceTestSuite, FeatureBrokerRepeatedBindAcrossForks) {
+    // Binding the same output of the same model over many forks should reuse the same binding plan, but each output
+    // must still be independently functional.
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto parentFb = std::make_shared<FeatureBroker>();
+    auto inputA = parentFb->BindInput<float>("A").value_or(nullptr);
+    ASSERT_NE(nullptr, inputA);
+    inputA->Feed(1.f);
+
+    std::vector<std::shared_ptr<DirectInputPipe<float>>> inputs;
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    for (int i = 0; i < 10; ++i) {
+        auto fb = parentFb->Fork(model).value_or(nullptr);
+        ASSERT_NE(nullptr, fb);
+        auto inputB = fb->BindInput<float>("B").value_or(nullptr);
+        ASSERT_NE(nullptr, inputB);
+        inputB->Feed(static_cast<float>(i));
+        auto output = fb->BindOutput<float>("X").value_or(nullptr);
+        ASSERT_NE(nullptr, output);
+        inputs.push_back(inputB);
+        outputs.push_back(output);
+    }
+
+    float value;
+    for (int i = 0; i < 10; ++i) {
+        auto updateExpected = outputs[i]->UpdateIfChanged(value);
+        ASSERT_TRUE(updateExpected && updateExpected.value());
+        ASSERT_EQ(1.f + i, value);
+    }
+    inputA->Feed(2.f);
+    for (int i = 0; i < 10; ++i) {
+        auto updateExpected = outputs[i]->UpdateIfChanged(value);
+        ASSERT_TRUE(updateExpected && updateExpected.value());
+        ASSERT_EQ(2.f + i, value);
+    }
+}
+
+TEST(InferenceTestSuite, FeatureBrokerRepeatedBindReusesTopology) {
+    // Forks that each bind an input of their own resolve the plan's inputs to different pipes, but in the same way, so
+    // they all reuse the topology the first of them worked out.
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto parentFb = std::make_shared<FeatureBroker>();
+    auto inner = inference_test::TupleProviderFactory::Create<float>("A");
+    inner->Set<0>(1.f);
+    auto provider = std::make_shared<LookupCountingProvider>(inner);
+    ASSERT_TRUE(parentFb->BindInputs(provider));
+
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    int lookups = 0;
+    for (int i = 0; i < 10; ++i) {
+        auto fb = parentFb->Fork(model).value();
+        fb->BindInput<float>("B").value()->Feed(static_cast<float>(i));
+        auto before = provider->Lookups();
+        outputs.push_back(fb->BindOutput<float>("X").value());
+        if (i == 0)
+            lookups = provider->Lookups() - before;
+        else
+            ASSERT_EQ(before, provider->Lookups()) << "The topology was worked out again for fork " << i;
+    }
+    ASSERT_LT(0, lookups);
+    float value;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(outputs[i]->UpdateIfChanged(value).value());
+        ASSERT_EQ(1.f + i, value);
+    }
+
+    // Binding the input to a provider instead resolves it another way, so the topology is worked out again.
+    auto fb = parentFb->Fork(model).value();
+    ASSERT_TRUE(fb->BindInputs(inference_test::TupleProviderFactory::Create<float>("B")));
+    auto before = provider->Lookups();
+    ASSERT_TRUE(fb->BindOutput<float>("X"));
+    ASSERT_EQ(before + lookups, provider->Lookups());
+}
+
+TEST(InferenceTestSuite, FeatureBrokerRepeatedBindTopologyChanged) {
+    // The first bind caches a plan where "A" is bound to a float pipe. After reparenting, "A" resolves to an int pipe,
+    // and the cached resolution must not be mistaken for the new one.
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb1 = std::make_shared<FeatureBroker>();
+    auto input1 = fb1->BindInput<float>("A").value_or(nullptr);
+    ASSERT_NE(nullptr, input1);
+    auto fb2 = fb1->Fork().value_or(nullptr);
+    ASSERT_NE(nullptr, fb2);
+    auto fb3 = fb2->Fork(model).value_or(nullptr);
+    ASSERT_NE(nullptr, fb3);
+
+    auto output1 = fb3->BindOutput<float>("X").value_or(nullptr);
+    ASSERT_NE(nullptr, output1);
+    auto output2 = fb3->BindOutput<float>("X").value_or(nullptr);
+    ASSERT_NE(nullptr, output2);
+
+    auto fbOther = std::make_shared<FeatureBroker>();
+    auto inputOther = fbOther->BindInput<int>("A").value_or(nullptr);
+    ASSERT_NE(nullptr, inputOther);
+    ASSERT_TRUE((bool)fb2->SetParent(fbOther));
+
+    auto outputExpected = fb3->BindOutput<float>("X");
+    ASSERT_FALSE(outputExpected);
+    ASSERT_EQ(feature_errc::type_mismatch, outputExpected.error());
+
+    // Going back to the original parent should again succeed.
+    ASSERT_TRUE((bool)fb2->SetParent(fb1));
+    auto output3 = fb3->BindOutput<float>("X").value_or(nullptr);
+    ASSERT_NE(nullptr, output3);
+    input1->Feed(1.f);
+    float value;
+    auto updateExpected = output3->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(6.f, value);
+}
+
+TEST(InferenceTestSuite, FeatureBrokerSwapModel) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddFiveModel>());
+    auto fork = fb->Fork().value();
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutput<float>("X").value();
+    auto forkOutput = fork->BindOutput<float>("X").value();
+
+    float value;
+    input->Feed(1);
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(6, value);
+
+    // Swap in a model that adds ten, whose updaters hold off on saying they are ready until released.
+    auto graph = ModelGraph::Create({std::make_shared<inference_test::AddFiveModel>("A", "M"),
+                                     std::make_shared<inference_test::AddFiveModel>("M", "X")})
+                     .value();
+    auto released = std::make_shared<inference_test::ReleaseModel>(graph);
+    ASSERT_TRUE(fb->SwapModel(released));
+
+    // Until then the old model keeps serving.
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected);
+    ASSERT_FALSE(updateExpected.value());
+    input->Feed(2);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(7, value);
+
+    // Once ready, the new model is rerun even though the input has not changed since.
+    released->Release();
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(12, value);
+    updateExpected = forkOutput->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(12, value);
+
+    input->Feed(3);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(13, value);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected);
+    ASSERT_FALSE(updateExpected.value());
+}
+
+TEST(InferenceTestSuite, FeatureBrokerSwapModelIncompatible) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddFiveModel>());
+    auto input = fb->BindInput<float>("A").value();
+
+    auto swapExpected = fb->SwapModel(nullptr);
+    ASSERT_FALSE(swapExpected);
+    ASSERT_EQ(feature_errc::invalid_model, swapExpected.error());
+    // The output is of another type.
+    swapExpected = fb->SwapModel(std::make_shared<inference_test::ThreeOutputModel>());
+    ASSERT_FALSE(swapExpected);
+    ASSERT_EQ(feature_errc::type_mismatch, swapExpected.error());
+    // The output requires more than it did.
+    swapExpected = fb->SwapModel(std::make_shared<inference_test::AddModel>());
+    ASSERT_FALSE(swapExpected);
+    ASSERT_EQ(feature_errc::not_bound, swapExpected.error());
+
+    auto fork = fb->Fork().value();
+    swapExpected = fork->SwapModel(std::make_shared<inference_test::AddFiveModel>());
+    ASSERT_FALSE(swapExpected);
+    ASSERT_EQ(feature_errc::no_model_associated, swapExpected.error());
+}
+
+TEST(InferenceTestSuite, FeatureBrokerBroadcastInput) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto broadcast = fb->BindBroadcastInput<float>("A").value();
+
+    std::vector<std::shared_ptr<DirectInputPipe<float>>> inputs;
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    for (int i = 0; i < 100; ++i) {
+        auto fork = fb->Fork().value();
+        inputs.push_back(fork->BindInput<float>("B").value());
+        outputs.push_back(fork->BindOutput<float>("X").value());
+        inputs.back()->Feed(static_cast<float>(i));
+    }
+
+    // Nothing can be computed until the broadcast input has a value.
+    float value;
+    auto updateExpected = outputs[0]->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected);
+    ASSERT_FALSE(updateExpected.value());
+
+    for (float a : {10.f, 20.f}) {
+        broadcast->Feed(a);
+        for (std::size_t i = 0; i < outputs.size(); ++i) {
+            updateExpected = outputs[i]->UpdateIfChanged(value);
+            ASSERT_TRUE(updateExpected && updateExpected.value());
+            ASSERT_EQ(a + i, value);
+            updateExpected = outputs[i]->UpdateIfChanged(value);
+            ASSERT_TRUE(updateExpected);
+            ASSERT_FALSE(updateExpected.value());
+        }
+    }
+
+    // Either input changing updates the output, with the latest values of both.
+    broadcast->Feed(30);
+    inputs[1]->Feed(2);
+    updateExpected = outputs[1]->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(32, value);
+}
+
+TEST(InferenceTestSuite, FeatureBrokerBroadcastInputWakes) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddModel>());
+    auto broadcast = fb->BindBroadcastInput<float>("A").value();
+    auto fork = fb->Fork().value();
+    fork->BindInput<float>("B").value()->Feed(1);
+    auto x = fork->BindOutput<float>("X").value();
+
+    // A consumer waiting on the output is woken by the broadcast input, both for its first value and those after.
+    float value = 0;
+    for (float a : {10.f, 20.f}) {
+        std::thread feeder([&broadcast, a]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            broadcast->Feed(a);
+        });
+        x->WaitUntilChanged();
+        feeder.join();
+        ASSERT_TRUE(x->UpdateIfChanged(value).value());
+        ASSERT_EQ(a + 1, value);
+    }
+
+    // As is one waiting without blocking, and so is a pipe bound once the input already has a value.
+    bool notified = false;
+    ASSERT_TRUE(x->NotifyWhenChanged([&notified]() { notified = true; }));
+    ASSERT_FALSE(notified);
+    broadcast->Feed(30);
+    ASSERT_TRUE(notified);
+    auto later = fb->Fork().value();
+    later->BindInput<float>("B").value()->Feed(2);
+    auto y = later->BindOutput<float>("X").value();
+    y->WaitUntilChanged();
+    ASSERT_TRUE(y->UpdateIfChanged(value).value());
+    ASSERT_EQ(32, value);
+}
+
+TEST(InferenceTestSuite, FeatureBrokerFreeze) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto a = fb->BindInput<float>("A").value();
+    ASSERT_FALSE(fb->Frozen());
+    fb->Freeze();
+    ASSERT_TRUE(fb->Frozen());
+
+    // Nothing about the frozen broker can change.
+    auto bindExpected = fb->BindInput<float>("B");
+    ASSERT_FALSE(bindExpected);
+    ASSERT_EQ(feature_errc::frozen, bindExpected.error());
+    ASSERT_EQ(feature_errc::frozen, fb->SetParent(std::make_shared<FeatureBroker>()).error());
+    ASSERT_EQ(feature_errc::frozen, fb->SwapModel(std::make_shared<inference_test::AddModel>()).error());
+
+    // Its forks are not frozen, and resolve their inputs through it.
+    auto fork = fb->Fork().value();
+    ASSERT_FALSE(fork->Frozen());
+    ASSERT_EQ(feature_errc::already_bound, fork->BindInput<float>("A").error());
+    auto b = fork->BindInput<float>("B").value();
+    auto x = fork->BindOutput<float>("X").value();
+    a->Feed(1);
+    b->Feed(2);
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(3, value);
+    ASSERT_TRUE(fork->SetParent(nullptr));
+}
+
+TEST(InferenceTestSuite, FeatureBrokerFreezeConcurrentForks) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto a = fb->BindInput<float>("A").value();
+    a->Feed(1);
+    fb->Freeze();
+
+    // Forks binding through the frozen broker share its plans. Each binds an input of its own, so the pipes they
+    // resolve differ from fork to fork, and some have a model of their own besides.
+    std::vector<std::thread> threads;
+    std::atomic<int> failures{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&fb, &failures, t]() {
+            for (int i = 0; i < 50; ++i) {
+                auto fork = fb->Fork(i % 5 ? nullptr : std::make_shared<inference_test::AddModel>()).value();
+                auto b = fork->BindInput<float>("B").value();
+                auto x = fork->BindOutput<float>("X").value();
+                b->Feed(static_cast<float>(t + i));
+                float value;
+                if (!x->UpdateIfChanged(value).value() || value != 1 + t + i) ++failures;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    ASSERT_EQ(0, failures);
+}
+
+TEST(InferenceTestSuite, FeatureBrokerFreezeReusesTopology) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto inner = inference_test::TupleProviderFactory::Create<float>("A");
+    inner->Set<0>(1.f);
+    auto provider = std::make_shared<LookupCountingProvider>(inner);
+    ASSERT_TRUE(fb->BindInputs(provider));
+    fb->Freeze();
+
+    // The frozen plan keeps the first topology set, which every fork binding an input of its own goes on to use.
+    for (int i = 0; i < 10; ++i) {
+        auto fork = fb->Fork().value();
+        fork->BindInput<float>("B").value()->Feed(static_cast<float>(i));
+        auto before = provider->Lookups();
+        auto x = fork->BindOutput<float>("X").value();
+        if (i > 0) ASSERT_EQ(before, provider->Lookups()) << "The topology was worked out again for fork " << i;
+        float value;
+        ASSERT_TRUE(x->UpdateIfChanged(value).value());
+        ASSERT_EQ(1.f + i, value);
+    }
+}
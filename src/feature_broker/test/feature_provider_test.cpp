@@ -8,7 +8,9 @@
 #include <tuple>
 
 #include "add_five_model.hpp"
+#include "add_model.hpp"
 #include "gtest/gtest.h"
+#include "pull_feature_provider.hpp"
 #include "three_output_model.hpp"
 #include "tuple_feature_providers.hpp"
 
@@ -61,6 +63,49 @@ TEST(InferenceTestSuite, ProviderSyncInputAndOutput) {
     ASSERT_EQ(value, 7.0);
 }
 
+TEST(InferenceTestSuite, ProviderSyncFastPath) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<SynchronousFeatureBroker>(model);
+
+    auto fp = inference_test::TupleProviderFactory::Create<float>("A");
+    ASSERT_TRUE((bool)fb->BindInputs(fp));
+    auto input = fb->BindInput<float>("B").value();
+    auto output = fb->BindOutput<float>("X").value();
+    float value = 0;
+
+    // Nothing can wait on a synchronous broker's outputs. Should a caller reach the waiting interface anyway, asking to
+    // wait is an error rather than blocking forever.
+    auto waitable = std::dynamic_pointer_cast<OutputPipeWithInput<float, FeatureBroker::InputsType>>(output);
+    ASSERT_TRUE(waitable);
+    auto waitExpected = waitable->WaitUntilChanged();
+    ASSERT_FALSE(waitExpected);
+    ASSERT_EQ(make_feature_error(feature_errc::invalid_operation), waitExpected.error());
+    auto notifyExpected = waitable->NotifyWhenChanged([]() {});
+    ASSERT_FALSE(notifyExpected);
+    ASSERT_EQ(make_feature_error(feature_errc::invalid_operation), notifyExpected.error());
+
+    // The pipe is not ready until both the provider and the input have values.
+    input->Feed(1.0f);
+    ASSERT_FALSE(output->Changed());
+    ASSERT_FALSE(output->UpdateIfChanged(value).value());
+    fp->Set<0>(2.0f);
+    ASSERT_TRUE(output->Changed());
+    ASSERT_TRUE(output->UpdateIfChanged(value).value());
+    ASSERT_EQ(3.0f, value);
+
+    // Once ready, polls only report changes, from either source.
+    ASSERT_FALSE(output->Changed());
+    ASSERT_FALSE(output->UpdateIfChanged(value).value());
+    input->Feed(4.0f);
+    ASSERT_TRUE(output->UpdateIfChanged(value).value());
+    ASSERT_EQ(6.0f, value);
+    ASSERT_FALSE(output->UpdateIfChanged(value).value());
+    fp->Set<0>(5.0f);
+    ASSERT_TRUE(output->UpdateIfChanged(value).value());
+    ASSERT_EQ(9.0f, value);
+    ASSERT_FALSE(output->UpdateIfChanged(value).value());
+}
+
 TEST(InferenceTestSuite, ProviderMultiInputAndOutput) {
     std::shared_ptr<Model> model(new inference_test::ThreeOutputModel());
     auto fb = std::make_shared<FeatureBroker>(model);
@@ -166,3 +211,81 @@ TEST(InferenceTestSuite, ProviderInheritance) {
     ASSERT_TRUE(updateExpected && updateExpected.value());
     ASSERT_EQ(value, 7);
 }
+
+TEST(InferenceTestSuite, ProviderPullOnlyStale) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+
+    // The provider has "C" as well, which the model has no use for.
+    auto fp = std::make_shared<inference_test::CountingPullProvider>(std::vector<std::string>{"A", "C"});
+    ASSERT_TRUE((bool)fb->BindInputs(fp));
+    auto inputExpected = fb->BindInput<float>("B");
+    ASSERT_TRUE(inputExpected && inputExpected.value());
+    auto inputB = inputExpected.value();
+
+    auto outputExpected = fb->BindOutput<float>("X");
+    ASSERT_TRUE(outputExpected && outputExpected.value());
+    auto output = outputExpected.value();
+
+    float value = 0;
+    fp->Set("A", 2.0f);
+    inputB->Feed(1.0f);
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(3.0f, value);
+    ASSERT_EQ(1, fp->Decodes("A"));
+
+    // Changes to the pipe input alone should not cause the provider to be asked again.
+    for (int i = 0; i < 5; ++i) {
+        inputB->Feed(static_cast<float>(i));
+        updateExpected = output->UpdateIfChanged(value);
+        ASSERT_TRUE(updateExpected && updateExpected.value());
+        ASSERT_EQ(2.0f + i, value);
+    }
+    ASSERT_EQ(1, fp->Decodes("A"));
+
+    // Nor should changes to the output the model does not need.
+    fp->Set("C", 10.0f);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && !updateExpected.value());
+    ASSERT_EQ(0, fp->Decodes("C"));
+
+    fp->Set("A", 5.0f);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(9.0f, value);
+    ASSERT_EQ(2, fp->Decodes("A"));
+}
+
+namespace {
+// Reports all of its outputs stale as soon as it is asked for an updater, as a provider that already has values would.
+class EagerPullProvider final : public inference_test::CountingPullProvider {
+   public:
+    using CountingPullProvider::CountingPullProvider;
+
+    rt::expected<std::shared_ptr<PullValueUpdater>> CreatePullValueUpdater(
+        std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> const& outputToPipe,
+        std::function<void(std::size_t)> staleNotifier) const override {
+        auto updater = CountingPullProvider::CreatePullValueUpdater(outputToPipe, staleNotifier);
+        for (std::size_t i = 0; i < outputToPipe.size(); ++i) staleNotifier(i);
+        return updater;
+    }
+};
+}  // namespace
+
+TEST(InferenceTestSuite, ProviderPullStaleOnCreate) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddModel>());
+    auto fp = std::make_shared<EagerPullProvider>(std::vector<std::string>{"A", "B"});
+    fp->Set("A", 1.0f);
+    fp->Set("B", 2.0f);
+    ASSERT_TRUE((bool)fb->BindInputs(fp));
+    auto output = fb->BindOutput<float>("X").value();
+
+    // Staleness reported while the updater was created is not lost.
+    float value = 0;
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(3.0f, value);
+    ASSERT_EQ(1, fp->Decodes("A"));
+    ASSERT_EQ(1, fp->Decodes("B"));
+}
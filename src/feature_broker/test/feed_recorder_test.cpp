@@ -0,0 +1,155 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <inference/feature_broker.hpp>
+#include <inference/feed_recorder.hpp>
+#include <inference/value_codec.hpp>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+std::string LogPath(char const* name) { return testing::TempDir() + name; }
+}  // namespace
+
+TEST(InferenceTestSuite, FeedRecorderRecordAndReplay) {
+    auto path = LogPath("feed_recorder_test.log");
+    {
+        auto recorder = FeedRecorder::Create(path).value();
+        auto fb = std::make_shared<FeatureBroker>();
+        auto a = recorder->BindInput<float>(*fb, "A").value();
+        auto s = recorder->BindInput<std::string>(*fb, "S").value();
+        auto t = recorder->BindInput<Tensor<int64_t>>(*fb, "T").value();
+
+        // Bound through the recorder, outputs still see what is fed.
+        auto child = fb->Fork(std::make_shared<inference_test::AddFiveModel>()).value();
+        auto x = child->BindOutput<float>("X").value();
+        a->Feed(1);
+        a->Feed(2);
+        float value;
+        ASSERT_TRUE(x->UpdateIfChanged(value).value());
+        ASSERT_EQ(7, value);
+
+        s->Feed("hello");
+        std::shared_ptr<int64_t> data(new int64_t[6]{1, 2, 3, 4, 5, 6}, std::default_delete<int64_t[]>());
+        t->Feed(Tensor<int64_t>(data, {2, 3}));
+        a->Feed(3);
+
+        ASSERT_TRUE(recorder->Close());
+        ASSERT_EQ(0, recorder->Dropped());
+        // Once closed, values still reach the pipe but are not recorded.
+        a->Feed(4);
+        ASSERT_TRUE(x->UpdateIfChanged(value).value());
+        ASSERT_EQ(9, value);
+    }
+
+    auto replayer = FeedReplayer::Open(path).value();
+    auto fb = std::make_shared<FeatureBroker>();
+    auto replayedExpected = replayer->Replay(*fb);
+    ASSERT_TRUE(replayedExpected);
+    ASSERT_EQ(5, replayedExpected.value());
+
+    auto x = fb->Fork(std::make_shared<inference_test::AddFiveModel>()).value()->BindOutput<float>("X").value();
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(8, value);
+
+    auto sModel = std::make_shared<inference_test::PassThroughModel<std::string>>("S", "SO");
+    auto so = fb->Fork(sModel).value()->BindOutput<std::string>("SO").value();
+    std::string stringValue;
+    ASSERT_TRUE(so->UpdateIfChanged(stringValue).value());
+    ASSERT_EQ("hello", stringValue);
+
+    auto tModel = std::make_shared<inference_test::PassThroughModel<Tensor<int64_t>>>("T", "TO");
+    auto to = fb->Fork(tModel).value()->BindOutput<Tensor<int64_t>>("TO").value();
+    Tensor<int64_t> tensor;
+    ASSERT_TRUE(to->UpdateIfChanged(tensor).value());
+    ASSERT_EQ((std::vector<size_t>{2, 3}), tensor.Dimensions());
+    for (int i = 0; i < 6; ++i) ASSERT_EQ(i + 1, tensor.Data()[i]);
+
+    // Replaying binds the inputs, so it cannot be done twice into the same broker.
+    auto againExpected = replayer->Replay(*fb);
+    ASSERT_FALSE(againExpected);
+    ASSERT_EQ(feature_errc::already_bound, againExpected.error());
+
+    // At the original speed values are spaced out as they were fed, which here was all but instantly.
+    auto fb2 = std::make_shared<FeatureBroker>();
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(5, replayer->Replay(*fb2, ReplaySpeed::Original).value());
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    std::remove(path.c_str());
+}
+
+TEST(InferenceTestSuite, FeedRecorderReplayErrors) {
+    auto missingExpected = FeedReplayer::Open(LogPath("feed_recorder_test_missing.log"));
+    ASSERT_FALSE(missingExpected);
+    ASSERT_EQ(std::errc::no_such_file_or_directory, missingExpected.error());
+
+    auto path = LogPath("feed_recorder_test_not_a.log");
+    auto file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(nullptr, file);
+    std::fputs("This is not a log of anything at all.", file);
+    std::fclose(file);
+    auto notLogExpected = FeedReplayer::Open(path);
+    ASSERT_FALSE(notLogExpected);
+    ASSERT_EQ(std::errc::illegal_byte_sequence, notLogExpected.error());
+    std::remove(path.c_str());
+
+    auto recorder = FeedRecorder::Create(LogPath("feed_recorder_test_closed.log")).value();
+    ASSERT_TRUE(recorder->Close());
+    auto fb = std::make_shared<FeatureBroker>();
+    auto recordExpected = recorder->BindInput<float>(*fb, "A");
+    ASSERT_FALSE(recordExpected);
+    ASSERT_EQ(feature_errc::invalid_operation, recordExpected.error());
+    std::remove(LogPath("feed_recorder_test_closed.log").c_str());
+}
+
+TEST(InferenceTestSuite, FeedRecorderReplayCorruptStream) {
+    auto path = LogPath("feed_recorder_test_corrupt.log");
+    {
+        auto recorder = FeedRecorder::Create(path).value();
+        auto fb = std::make_shared<FeatureBroker>();
+        recorder->BindInput<float>(*fb, "A").value()->Feed(1);
+        ASSERT_TRUE(recorder->Close());
+    }
+    // Renumber the stream of the first record, just after the header and the record kind, to something huge.
+    auto file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    std::uint32_t stream = UINT32_MAX - 1;
+    ASSERT_EQ(0, std::fseek(file, 17, SEEK_SET));
+    ASSERT_EQ(1, std::fwrite(&stream, sizeof(stream), 1, file));
+    std::fclose(file);
+
+    auto fb = std::make_shared<FeatureBroker>();
+    auto replayedExpected = FeedReplayer::Open(path).value()->Replay(*fb);
+    ASSERT_FALSE(replayedExpected);
+    ASSERT_EQ(std::errc::illegal_byte_sequence, replayedExpected.error());
+    std::remove(path.c_str());
+}
+
+TEST(InferenceTestSuite, ValueCodecRejectsOverflowingDimensions) {
+    using Codec = detail::ValueCodec<Tensor<float>>;
+    std::string encoded;
+    detail::NumberCodec<std::uint32_t>::Encode(2, encoded);
+    // The product of these wraps around to four, which the four items that follow would have passed for.
+    auto huge = static_cast<std::uint64_t>(std::numeric_limits<std::size_t>::max() / 4 + 2);
+    detail::NumberCodec<std::uint64_t>::Encode(huge, encoded);
+    detail::NumberCodec<std::uint64_t>::Encode(4, encoded);
+    std::vector<float> items = {1, 2, 3, 4};
+    encoded.append(reinterpret_cast<char const*>(items.data()), items.size() * sizeof(float));
+
+    char const* cursor = encoded.data();
+    Tensor<float> value;
+    ASSERT_FALSE(Codec::Decode(cursor, encoded.data() + encoded.size(), value));
+}
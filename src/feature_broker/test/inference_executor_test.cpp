@@ -0,0 +1,165 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <condition_variable>
+#include <inference/feature_error.hpp>
+#include <inference/inference_executor.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace ::inference;
+
+TEST(InferenceTestSuite, InferenceExecutorSharesByWeight) {
+    InferenceExecutor executor(1);
+    auto gate = executor.CreateTenant("gate");
+    auto heavy = executor.CreateTenant("heavy", 2);
+    auto light = executor.CreateTenant("light");
+    ASSERT_EQ(2, heavy->Weight());
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool open = false;
+    std::vector<std::string> order;
+    // Hold the only worker until both tenants have all their work queued.
+    gate->Submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&open]() { return open; });
+    });
+    for (int i = 0; i < 6; ++i) heavy->Submit([&order]() { order.push_back("heavy"); });
+    for (int i = 0; i < 3; ++i) light->Submit([&order]() { order.push_back("light"); });
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open = true;
+    }
+    cv.notify_one();
+    // Work runs in the order it is queued, so once this has run everything before it has.
+    light->Run([]() {});
+
+    std::vector<std::string> expected = {"heavy", "light", "heavy", "heavy", "light",
+                                         "heavy", "heavy", "light", "heavy"};
+    ASSERT_EQ(expected, order);
+    ASSERT_EQ(6, heavy->Completed());
+    ASSERT_EQ(4, light->Completed());
+    ASSERT_EQ(0, executor.Queued());
+}
+
+TEST(InferenceTestSuite, InferenceExecutorRunsByPriority) {
+    InferenceExecutor executor(1);
+    auto gate = executor.CreateTenant("gate");
+    auto bulk = executor.CreateTenant("bulk", 4);
+    auto urgent = executor.CreateTenant("urgent");
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool open = false;
+    std::vector<std::string> order;
+    gate->Submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&open]() { return open; });
+    });
+    {
+        detail::PriorityScope scope(PriorityClass::Background);
+        for (int i = 0; i < 3; ++i) bulk->Submit([&order]() { order.push_back("bulk"); });
+    }
+    {
+        // Though queued last, and by the tenant with the lesser share, these go first.
+        detail::PriorityScope scope(PriorityClass::Interactive);
+        for (int i = 0; i < 2; ++i) urgent->Submit([&order]() { order.push_back("urgent"); });
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open = true;
+    }
+    cv.notify_one();
+    // Background work queued ahead of this still runs ahead of it, since it is the least urgent.
+    detail::PriorityScope scope(PriorityClass::Background);
+    bulk->Run([]() {});
+
+    std::vector<std::string> expected = {"urgent", "urgent", "bulk", "bulk", "bulk"};
+    ASSERT_EQ(expected, order);
+}
+
+TEST(InferenceTestSuite, InferenceExecutorPromotesStarvedWork) {
+    InferenceExecutor executor(1, std::chrono::milliseconds(10));
+    auto gate = executor.CreateTenant("gate");
+    auto bulk = executor.CreateTenant("bulk");
+    auto urgent = executor.CreateTenant("urgent");
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool open = false;
+    std::vector<std::string> order;
+    gate->Submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&open]() { return open; });
+    });
+    {
+        detail::PriorityScope scope(PriorityClass::Background);
+        bulk->Submit([&order]() { order.push_back("bulk"); });
+    }
+    // By the time the worker is free, the background work has waited past the limit, and goes ahead of what is more
+    // urgent but has not.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        detail::PriorityScope scope(PriorityClass::Interactive);
+        for (int i = 0; i < 2; ++i) urgent->Submit([&order]() { order.push_back("urgent"); });
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open = true;
+    }
+    cv.notify_one();
+    detail::PriorityScope scope(PriorityClass::Background);
+    bulk->Run([]() {});
+
+    std::vector<std::string> expected = {"bulk", "urgent", "urgent"};
+    ASSERT_EQ(expected, order);
+}
+
+TEST(InferenceTestSuite, InferenceExecutorRunsOnWorker) {
+    InferenceExecutor executor(1);
+    ASSERT_EQ(1, executor.Workers());
+    auto tenant = executor.CreateTenant("tenant");
+
+    std::thread::id outer, inner;
+    PriorityClass priority = PriorityClass::Normal;
+    {
+        detail::PriorityScope scope(PriorityClass::Interactive);
+        tenant->Run([&]() {
+            outer = std::this_thread::get_id();
+            priority = CurrentPriority();
+            // The only worker is this one, so this must run here rather than wait for a worker.
+            tenant->Run([&inner]() { inner = std::this_thread::get_id(); });
+        });
+    }
+    ASSERT_NE(std::this_thread::get_id(), outer);
+    ASSERT_EQ(outer, inner);
+    ASSERT_EQ(PriorityClass::Interactive, priority);
+    ASSERT_EQ(2, tenant->Completed());
+}
+
+TEST(InferenceTestSuite, InferenceExecutorGlobal) {
+    auto& global = InferenceExecutor::Global();
+    ASSERT_EQ(&global, &InferenceExecutor::Global());
+    ASSERT_LE(1, global.Workers());
+    ASSERT_EQ(make_feature_error(feature_errc::invalid_operation), InferenceExecutor::ConfigureGlobal(2));
+
+    auto tenant = global.CreateTenant("tenant");
+    int value = 0;
+    auto executor = tenant->AsExecutor();
+    std::mutex mutex;
+    std::condition_variable cv;
+    executor([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        value = 1;
+        cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&value]() { return value == 1; });
+}
@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <array>
+#include <cstddef>
+#include <inference/feature_broker.hpp>
+#include <memory>
+#include <memory_resource>
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+
+using namespace ::inference;
+
+namespace {
+// Passes allocations on to the default resource, counting those still outstanding.
+class CountingResource : public std::pmr::memory_resource {
+   public:
+    std::size_t Allocations = 0;
+    std::size_t Outstanding = 0;
+
+   private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++Allocations;
+        ++Outstanding;
+        return std::pmr::get_default_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        --Outstanding;
+        std::pmr::get_default_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+};
+}  // namespace
+
+TEST(InferenceTestSuite, MemoryResourceBindAndFork) {
+    CountingResource resource;
+    {
+        auto fb = std::make_shared<FeatureBroker>(nullptr, &resource);
+        ASSERT_EQ(&resource, fb->MemoryResource());
+        auto a = fb->BindInput<float>("A").value();
+        ASSERT_EQ(1, resource.Allocations);
+
+        // Forks inherit the resource, and are themselves allocated from it.
+        auto fork = fb->Fork(std::make_shared<inference_test::AddFiveModel>()).value();
+        ASSERT_EQ(&resource, fork->MemoryResource());
+        auto afterFork = resource.Allocations;
+        ASSERT_LT(1, afterFork);
+
+        auto x = fork->BindOutput<float>("X").value();
+        ASSERT_LT(afterFork, resource.Allocations);
+        a->Feed(1);
+        float value;
+        ASSERT_TRUE(x->UpdateIfChanged(value).value());
+        ASSERT_EQ(6, value);
+    }
+    ASSERT_EQ(0, resource.Outstanding);
+}
+
+TEST(InferenceTestSuite, MemoryResourceRequestScopedFork) {
+    CountingResource rootResource;
+    auto fb = std::make_shared<FeatureBroker>(nullptr, &rootResource);
+    auto a = fb->BindInput<float>("A").value();
+    a->Feed(1);
+    auto rootAllocations = rootResource.Allocations;
+
+    for (int i = 1; i <= 3; ++i) {
+        std::array<std::byte, 64 * 1024> buffer;
+        CountingResource upstream;
+        {
+            std::pmr::monotonic_buffer_resource request(buffer.data(), buffer.size(), &upstream);
+            auto fork = fb->Fork(std::make_shared<inference_test::AddFiveModel>(), &request).value();
+            ASSERT_EQ(&request, fork->MemoryResource());
+            auto x = fork->BindOutput<float>("X").value();
+            float value;
+            ASSERT_TRUE(x->UpdateIfChanged(value).value());
+            ASSERT_EQ(i + 5, value);
+            a->Feed(static_cast<float>(i + 1));
+            ASSERT_TRUE(x->UpdateIfChanged(value).value());
+            ASSERT_EQ(i + 6, value);
+            // The pipes and the fork go before the buffer they are in.
+        }
+        ASSERT_EQ(0, upstream.Allocations);
+    }
+    // The updaters of the root's input came from the root's resource, since the input may outlive any one request.
+    ASSERT_LT(rootAllocations, rootResource.Allocations);
+}
+
+TEST(InferenceTestSuite, MemoryResourceForkOutlivedByAncestor) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    {
+        auto request = std::make_unique<CountingResource>();
+        {
+            // The fork has no model of its own, so its output is bound against the parent's, and its input is its own.
+            auto fork = fb->Fork(nullptr, request.get()).value();
+            auto a = fork->BindInput<float>("A").value();
+            auto x = fork->BindOutput<float>("X").value();
+            a->Feed(1);
+            float value;
+            ASSERT_TRUE(x->UpdateIfChanged(value).value());
+            ASSERT_EQ(6, value);
+        }
+        // Nothing the parent keeps, not even a weak reference, is left in the fork's resource.
+        ASSERT_EQ(0, request->Outstanding);
+    }
+
+    // With the resource gone, the parent carries on binding and swapping as before.
+    auto fork = fb->Fork().value();
+    auto a = fork->BindInput<float>("A").value();
+    auto x = fork->BindOutput<float>("X").value();
+    a->Feed(2);
+    ASSERT_TRUE((bool)fb->SwapModel(std::make_shared<inference_test::AddFiveModel>()));
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(7, value);
+}
@@ -0,0 +1,215 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <atomic>
+#include <inference/feature_broker.hpp>
+#include <inference/model_graph.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "add_five_model.hpp"
+#include "error_model.hpp"
+#include "gtest/gtest.h"
+#include "sum_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+// Wraps a model, counting how many times it is run.
+class CountingModel : public Model {
+   public:
+    explicit CountingModel(std::shared_ptr<const Model> inner) : _inner(std::move(inner)) {}
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inner->Inputs(); }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _inner->Outputs(); }
+    std::vector<std::string> GetRequirements(std::string const& outputName) const override {
+        return _inner->GetRequirements(outputName);
+    }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        auto innerExpected = _inner->CreateValueUpdater(inputToHandle, outputToPipe, outOfBandNotifier);
+        if (!innerExpected) return innerExpected;
+        return std::static_pointer_cast<ValueUpdater>(std::make_shared<Updater>(innerExpected.value(), _runs));
+    }
+
+    int Runs() const { return *_runs; }
+
+   private:
+    class Updater : public ValueUpdater {
+       public:
+        Updater(std::shared_ptr<ValueUpdater> inner, std::shared_ptr<std::atomic<int>> runs)
+            : _inner(std::move(inner)), _runs(std::move(runs)) {}
+        std::error_code UpdateOutput() override {
+            ++*_runs;
+            return _inner->UpdateOutput();
+        }
+
+       private:
+        std::shared_ptr<ValueUpdater> _inner;
+        std::shared_ptr<std::atomic<int>> _runs;
+    };
+
+    const std::shared_ptr<const Model> _inner;
+    const std::shared_ptr<std::atomic<int>> _runs = std::make_shared<std::atomic<int>>(0);
+};
+
+// Passes its input through, but only has anything to update when the input differs from what it last passed on.
+class DistinctModel : public Model {
+   public:
+    DistinctModel(std::string input, std::string output) : _input(std::move(input)), _output(std::move(output)) {
+        _inputs.emplace(_input, TypeDescriptor::Create<float>());
+        _outputs.emplace(_output, TypeDescriptor::Create<float>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+    std::vector<std::string> GetRequirements(std::string const&) const override { return {_input}; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();
+        return std::static_pointer_cast<ValueUpdater>(
+            std::make_shared<Updater>(inputToHandle.at(_input), outputToPipe.at(_output)));
+    }
+
+   private:
+    class Updater : public ValueUpdater {
+       public:
+        Updater(std::shared_ptr<IHandle> const& handle, std::shared_ptr<InputPipe> const& pipe)
+            : _handle(std::static_pointer_cast<Handle<float>>(handle)),
+              _pipe(std::static_pointer_cast<DirectInputPipe<float>>(pipe)) {}
+
+        bool Changed() override { return !_fed || _handle->Value() != _last; }
+
+        std::error_code UpdateOutput() override {
+            _last = _handle->Value();
+            _fed = true;
+            _pipe->Feed(_last);
+            return err_feature_ok();
+        }
+
+       private:
+        const std::shared_ptr<Handle<float>> _handle;
+        const std::shared_ptr<DirectInputPipe<float>> _pipe;
+        bool _fed{false};
+        float _last{0};
+    };
+
+    const std::string _input;
+    const std::string _output;
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+}  // namespace
+
+TEST(InferenceTestSuite, ModelGraphChain) {
+    auto first = std::make_shared<inference_test::AddFiveModel>("A", "M");
+    auto second = std::make_shared<inference_test::AddFiveModel>("M", "X");
+    auto graphExpected = ModelGraph::Create({first, second});
+    ASSERT_TRUE(graphExpected);
+    auto graph = graphExpected.value();
+    ASSERT_EQ(1, graph->Inputs().size());
+    ASSERT_EQ(std::vector<std::string>{"A"}, graph->GetRequirements("X"));
+
+    auto fb = std::make_shared<FeatureBroker>(graph);
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutputs<float, float>({"M", "X"}).value();
+
+    std::tuple<float, float> values;
+    input->Feed(1);
+    auto updateExpected = output->UpdateIfChanged(values);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(6, std::get<0>(values));
+    ASSERT_EQ(11, std::get<1>(values));
+
+    input->Feed(2);
+    updateExpected = output->UpdateIfChanged(values);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(7, std::get<0>(values));
+    ASSERT_EQ(12, std::get<1>(values));
+}
+
+TEST(InferenceTestSuite, ModelGraphRecomputesOnlyDownstream) {
+    auto left = std::make_shared<CountingModel>(std::make_shared<inference_test::AddFiveModel>("A", "P"));
+    auto right = std::make_shared<CountingModel>(std::make_shared<inference_test::AddFiveModel>("B", "Q"));
+    auto sum = std::make_shared<CountingModel>(
+        std::make_shared<inference_test::SumModel>(std::vector<std::string>{"P", "Q"}));
+
+    std::atomic<int> tasks{0};
+    auto executor = [&tasks](std::function<void()> task) {
+        ++tasks;
+        std::thread(std::move(task)).detach();
+    };
+    auto graph = ModelGraph::Create({sum, left, right}, executor).value();
+
+    auto fb = std::make_shared<FeatureBroker>(graph);
+    auto inputA = fb->BindInput<float>("A").value();
+    auto inputB = fb->BindInput<float>("B").value();
+    auto output = fb->BindOutput<float>("X").value();
+
+    float value;
+    inputA->Feed(1);
+    inputB->Feed(2);
+    auto updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(13, value);
+    // The two independent branches should have been handed to the executor together.
+    ASSERT_EQ(2, tasks);
+
+    inputB->Feed(3);
+    updateExpected = output->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(14, value);
+    ASSERT_EQ(1, left->Runs());
+    ASSERT_EQ(2, right->Runs());
+    ASSERT_EQ(2, sum->Runs());
+}
+
+TEST(InferenceTestSuite, ModelGraphRecoversFromFailure) {
+    // Y fails when B is 3. X is computed through M, whose model only runs when A takes a new value.
+    auto graph = ModelGraph::Create({std::make_shared<DistinctModel>("A", "M"),
+                                     std::make_shared<inference_test::AddFiveModel>("M", "X"),
+                                     std::make_shared<inference_test::ErrorIfThreeModel>("B", "Y")})
+                     .value();
+    auto fb = std::make_shared<FeatureBroker>(graph);
+    auto inputA = fb->BindInput<float>("A").value();
+    auto inputB = fb->BindInput<float>("B").value();
+    auto output = fb->BindOutputs<float, float>({"X", "Y"}).value();
+
+    std::tuple<float, float> values;
+    inputA->Feed(1);
+    inputB->Feed(1);
+    ASSERT_TRUE(output->UpdateIfChanged(values).value());
+    ASSERT_EQ(6, std::get<0>(values));
+    ASSERT_EQ(6, std::get<1>(values));
+
+    // M is computed before Y fails, but X, a level further on, is not.
+    inputA->Feed(2);
+    inputB->Feed(3);
+    ASSERT_FALSE(output->UpdateIfChanged(values));
+
+    // Once Y recovers, X catches up on the new M, though the model computing M has no reason to run again.
+    inputB->Feed(4);
+    ASSERT_TRUE(output->UpdateIfChanged(values).value());
+    ASSERT_EQ(7, std::get<0>(values));
+    ASSERT_EQ(9, std::get<1>(values));
+}
+
+TEST(InferenceTestSuite, ModelGraphInvalid) {
+    auto cycle = ModelGraph::Create({std::make_shared<inference_test::AddFiveModel>("A", "B"),
+                                     std::make_shared<inference_test::AddFiveModel>("B", "A")});
+    ASSERT_FALSE(cycle);
+    ASSERT_EQ(make_feature_error(feature_errc::circular_structure), cycle.error());
+
+    auto duplicate = ModelGraph::Create({std::make_shared<inference_test::AddFiveModel>("A", "X"),
+                                         std::make_shared<inference_test::AddFiveModel>("B", "X")});
+    ASSERT_FALSE(duplicate);
+    ASSERT_EQ(make_feature_error(feature_errc::already_bound), duplicate.error());
+}
@@ -368,6 +368,28 @@ TEST(InferenceTestSuite, MultiThreadFeatureBrokerSetParent) {
     }
 }
 
+TEST(InferenceTestSuite, MultiThreadFeatureBrokerSetParentSharedAncestor) {
+    // Reparenting under the same parent, or in another tree altogether, does not wait on a SetParent in progress.
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto barrier = std::make_shared<Barrier>(2);
+    auto fp = std::make_shared<SetParentTestProvider>(barrier);
+
+    auto session = std::make_shared<FeatureBroker>();
+    ASSERT_TRUE(session->BindInputs(fp));
+    auto request = std::make_shared<FeatureBroker>(model);
+    fp->Activate();
+    rt::expected<void> threadExpected;
+    // This stops in the provider, midway through its checks, until this thread reaches the barrier.
+    std::thread thread([&]() { threadExpected = request->SetParent(session); });
+
+    auto other = std::make_shared<FeatureBroker>();
+    ASSERT_TRUE(other->SetParent(session));
+    ASSERT_TRUE(std::make_shared<FeatureBroker>()->SetParent(std::make_shared<FeatureBroker>()));
+    barrier->SignalAndWait();
+    thread.join();
+    ASSERT_TRUE(threadExpected);
+}
+
 TEST(InferenceTestSuite, MultiThreadFeatureBrokerWaitUntilChanged) {
     auto model = std::make_shared<inference_test::AddFiveModel>();
     auto fb = std::make_shared<FeatureBroker>(model);
@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <functional>
+#include <inference/feature_broker.hpp>
+#include <inference/next_value.hpp>
+#include <memory>
+#include <vector>
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+
+using namespace ::inference;
+
+namespace {
+// A stand-in for an event loop: tasks are queued, and run only when asked.
+class QueueScheduler {
+   public:
+    Scheduler AsScheduler() {
+        return [this](std::function<void()> task) { _tasks.push_back(std::move(task)); };
+    }
+
+    std::size_t RunAll() {
+        std::size_t ran = 0;
+        while (!_tasks.empty()) {
+            auto tasks = std::move(_tasks);
+            _tasks.clear();
+            for (auto& task : tasks) task();
+            ran += tasks.size();
+        }
+        return ran;
+    }
+
+   private:
+    std::vector<std::function<void()>> _tasks;
+};
+
+#ifdef FEATURE_BROKER_HAS_COROUTINES
+// The least coroutine type that can be started and left to run.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+}  // namespace
+
+TEST(InferenceTestSuite, NextValueResumesOnScheduler) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutput<float>("X").value();
+    QueueScheduler scheduler;
+
+    std::vector<float> values;
+    auto continuation = [&values](rt::expected<float> value) {
+        ASSERT_TRUE(value);
+        values.push_back(value.value());
+    };
+    OnNextValue(output, scheduler.AsScheduler(), continuation);
+    ASSERT_TRUE(values.empty());
+    ASSERT_EQ(0, scheduler.RunAll());
+
+    // The change only queues the work, which happens when the scheduler gets around to it.
+    input->Feed(1);
+    ASSERT_TRUE(values.empty());
+    ASSERT_EQ(1, scheduler.RunAll());
+    ASSERT_EQ(std::vector<float>{6}, values);
+
+    // With a value already there, there is no need to wait.
+    input->Feed(2);
+    OnNextValue(output, scheduler.AsScheduler(), continuation);
+    ASSERT_EQ(0, scheduler.RunAll());
+    ASSERT_EQ((std::vector<float>{6, 7}), values);
+}
+
+TEST(InferenceTestSuite, NextValueErrors) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutput<float>("X").value();
+
+    ASSERT_TRUE(output->NotifyWhenChanged([]() {}));
+    auto notifyExpected = output->NotifyWhenChanged([]() {});
+    ASSERT_FALSE(notifyExpected);
+    ASSERT_EQ(feature_errc::multiple_waiting, notifyExpected.error());
+
+    // The continuation hears of the failure to wait, rather than never being called.
+    bool failed = false;
+    OnNextValue(output, [](std::function<void()>) {}, [&failed](rt::expected<float> value) {
+        failed = !value && value.error() == feature_errc::multiple_waiting;
+    });
+    ASSERT_TRUE(failed);
+}
+
+#ifdef FEATURE_BROKER_HAS_COROUTINES
+TEST(InferenceTestSuite, NextValueCoroutine) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutput<float>("X").value();
+    QueueScheduler scheduler;
+
+    std::vector<float> values;
+    auto consume = [&](int count) -> Detached {
+        for (int i = 0; i < count; ++i) {
+            auto value = co_await NextValue(output, scheduler.AsScheduler());
+            if (value) values.push_back(value.value());
+        }
+    };
+    consume(2);
+    ASSERT_TRUE(values.empty());
+    input->Feed(1);
+    scheduler.RunAll();
+    ASSERT_EQ(std::vector<float>{6}, values);
+    input->Feed(2);
+    scheduler.RunAll();
+    ASSERT_EQ((std::vector<float>{6, 7}), values);
+}
+#endif
@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/model.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+using namespace ::inference;
+
+namespace inference_test {
+template <typename T>
+class PassThroughValueUpdater : public inference::ValueUpdater {
+   public:
+    PassThroughValueUpdater(std::shared_ptr<IHandle> const& handle, std::shared_ptr<InputPipe> const& pipe)
+        : _pipe(std::static_pointer_cast<DirectInputPipe<T>>(pipe)),
+          _handle(std::static_pointer_cast<Handle<T>>(handle)) {}
+
+    std::error_code UpdateOutput() override {
+        _pipe->Feed(_handle->Value());
+        return err_feature_ok();
+    }
+
+   private:
+    std::shared_ptr<DirectInputPipe<T>> _pipe;
+    std::shared_ptr<Handle<T>> _handle;
+};
+
+/// <summary>
+/// Given a single input of any type publishes it unchanged as the output, so that tests can observe through an output
+/// pipe what was fed to an input of types no other test model handles.
+/// </summary>
+template <typename T>
+class PassThroughModel : public Model {
+   public:
+    PassThroughModel(std::string input, std::string output) : _input(input), _output(output) {
+        _inputs.emplace(_input, TypeDescriptor::Create<T>());
+        _outputs.emplace(_output, TypeDescriptor::Create<T>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+
+    std::vector<std::string> GetRequirements(std::string const& outputName) const override { return {_input}; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<inference::IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<inference::InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();
+        auto iterPipe = outputToPipe.find(_output);
+        if (iterPipe == outputToPipe.end()) return make_feature_unexpected(feature_errc::name_not_found);
+        auto iterHandle = inputToHandle.find(_input);
+        if (iterHandle == inputToHandle.end()) return make_feature_unexpected(feature_errc::name_not_found);
+        auto updater = std::make_shared<PassThroughValueUpdater<T>>(iterHandle->second, iterPipe->second);
+        return std::static_pointer_cast<ValueUpdater>(updater);
+    }
+
+   private:
+    const std::string _input;
+    const std::string _output;
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+
+}  // namespace inference_test
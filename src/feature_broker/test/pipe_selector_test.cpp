@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <inference/feature_broker.hpp>
+#include <inference/pipe_selector.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+
+using namespace ::inference;
+
+TEST(InferenceTestSuite, PipeSelectorReportsChangedPipes) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+
+    // Brokers with their own inputs, so each output depends on a different input.
+    std::vector<std::shared_ptr<DirectInputPipe<float>>> inputs;
+    std::vector<std::shared_ptr<OutputPipeWithInput<float, FeatureBroker::InputsType>>> outputs;
+    PipeSelector selector;
+    for (int i = 0; i < 3; ++i) {
+        auto fork = std::make_shared<FeatureBroker>(model);
+        inputs.push_back(fork->BindInput<float>("A").value());
+        outputs.push_back(fork->BindOutput<float>("X").value());
+        auto idExpected = selector.Add(outputs.back());
+        ASSERT_TRUE(idExpected);
+        ASSERT_EQ(i, idExpected.value());
+    }
+
+    auto waitExpected = selector.WaitFor(std::chrono::milliseconds(1));
+    ASSERT_TRUE(waitExpected);
+    ASSERT_TRUE(waitExpected.value().empty());
+
+    inputs[1]->Feed(1);
+    waitExpected = selector.WaitFor(std::chrono::seconds(10));
+    ASSERT_TRUE(waitExpected);
+    ASSERT_EQ(std::vector<std::size_t>{1}, waitExpected.value());
+    float value;
+    auto updateExpected = outputs[1]->UpdateIfChanged(value);
+    ASSERT_TRUE(updateExpected && updateExpected.value());
+    ASSERT_EQ(6, value);
+
+    // A change between the report and the next wait is not lost.
+    inputs[1]->Feed(2);
+    waitExpected = selector.WaitUntil(PipeSelector::Clock::now());
+    ASSERT_TRUE(waitExpected);
+    ASSERT_EQ(std::vector<std::size_t>{1}, waitExpected.value());
+
+    // Removed pipes are not reported, and may be waited on by something else.
+    selector.Remove(2);
+    inputs[2]->Feed(3);
+    waitExpected = selector.WaitFor(std::chrono::milliseconds(1));
+    ASSERT_TRUE(waitExpected);
+    ASSERT_TRUE(waitExpected.value().empty());
+    ASSERT_TRUE(outputs[2]->NotifyWhenChanged([]() {}));
+
+    std::thread feeder([&inputs]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        inputs[0]->Feed(4);
+    });
+    waitExpected = selector.Wait();
+    feeder.join();
+    ASSERT_TRUE(waitExpected);
+    ASSERT_EQ(std::vector<std::size_t>{0}, waitExpected.value());
+}
+
+#ifdef __linux__
+TEST(InferenceTestSuite, PipeSelectorEventFd) {
+    auto model = std::make_shared<inference_test::AddFiveModel>();
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto input = fb->BindInput<float>("A").value();
+    auto output = fb->BindOutput<float>("X").value();
+
+    PipeSelector selector;
+    auto id = selector.Add(output).value();
+    auto fdExpected = selector.EventFd();
+    ASSERT_TRUE(fdExpected);
+
+    pollfd pfd{fdExpected.value(), POLLIN, 0};
+    ASSERT_EQ(0, ::poll(&pfd, 1, 0));
+    input->Feed(1);
+    ASSERT_EQ(1, ::poll(&pfd, 1, 10000));
+
+    auto waitExpected = selector.WaitUntil(PipeSelector::Clock::now());
+    ASSERT_TRUE(waitExpected);
+    ASSERT_EQ(std::vector<std::size_t>{id}, waitExpected.value());
+    ASSERT_EQ(0, ::poll(&pfd, 1, 0));
+}
+#endif
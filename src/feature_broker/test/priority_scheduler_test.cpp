@@ -0,0 +1,138 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <inference/feature_broker.hpp>
+#include <inference/priority_scheduler.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace ::inference;
+
+namespace {
+// Waits until the scheduler has the given number of acquisitions waiting, of any class.
+void AwaitWaiting(PriorityScheduler const& scheduler, std::size_t count) {
+    auto waiting = [&scheduler]() {
+        return scheduler.Waiting(PriorityClass::Interactive) + scheduler.Waiting(PriorityClass::Normal) +
+               scheduler.Waiting(PriorityClass::Background);
+    };
+    while (waiting() != count) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// Publishes the priority its inference ran with as its output.
+class PriorityModel final : public Model {
+   public:
+    PriorityModel() {
+        _inputs.emplace("A", TypeDescriptor::Create<float>());
+        _outputs.emplace("P", TypeDescriptor::Create<int>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+    std::vector<std::string> GetRequirements(std::string const&) const override { return {"A"}; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<IHandle>> const&,
+        std::map<std::string, std::shared_ptr<InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();
+        return std::static_pointer_cast<ValueUpdater>(std::make_shared<Updater>(outputToPipe.at("P")));
+    }
+
+   private:
+    class Updater final : public ValueUpdater {
+       public:
+        explicit Updater(std::shared_ptr<InputPipe> pipe)
+            : _pipe(std::static_pointer_cast<DirectInputPipe<int>>(pipe)) {}
+
+        std::error_code UpdateOutput() override {
+            _pipe->Feed(static_cast<int>(CurrentPriority()));
+            return err_feature_ok();
+        }
+
+       private:
+        std::shared_ptr<DirectInputPipe<int>> _pipe;
+    };
+
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+}  // namespace
+
+TEST(InferenceTestSuite, PrioritySchedulerOrdersByClass) {
+    PriorityScheduler scheduler(std::chrono::hours(1));
+    std::mutex orderMutex;
+    std::vector<PriorityClass> order;
+    std::vector<std::thread> threads;
+    {
+        auto lease = scheduler.Acquire(PriorityClass::Normal);
+        for (auto priority : {PriorityClass::Background, PriorityClass::Normal, PriorityClass::Interactive,
+                              PriorityClass::Background}) {
+            threads.emplace_back([&scheduler, &orderMutex, &order, priority]() {
+                auto lease = scheduler.Acquire(priority);
+                std::lock_guard<std::mutex> lock(orderMutex);
+                order.push_back(priority);
+            });
+            // Each class queues in the order it arrived, so wait until each thread is queued before starting the next.
+            AwaitWaiting(scheduler, threads.size());
+        }
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<PriorityClass> expected = {PriorityClass::Interactive, PriorityClass::Normal, PriorityClass::Background,
+                                           PriorityClass::Background};
+    ASSERT_EQ(expected, order);
+    ASSERT_EQ(2, scheduler.Stats(PriorityClass::Normal).Acquired);
+    ASSERT_EQ(2, scheduler.Stats(PriorityClass::Background).Acquired);
+    ASSERT_EQ(0, scheduler.Stats(PriorityClass::Background).Promoted);
+    ASSERT_LT(0, scheduler.Stats(PriorityClass::Background).MaxWait.count());
+}
+
+TEST(InferenceTestSuite, PrioritySchedulerPromotesStarvedWork) {
+    PriorityScheduler scheduler(std::chrono::milliseconds(1));
+    std::vector<PriorityClass> order;
+    std::vector<std::thread> threads;
+    {
+        auto lease = scheduler.Acquire(PriorityClass::Interactive);
+        for (auto priority : {PriorityClass::Background, PriorityClass::Interactive}) {
+            threads.emplace_back([&scheduler, &order, priority]() {
+                auto lease = scheduler.Acquire(priority);
+                // Only one thread at a time holds the lease, so this needs no lock of its own.
+                order.push_back(priority);
+            });
+            AwaitWaiting(scheduler, threads.size());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<PriorityClass> expected = {PriorityClass::Background, PriorityClass::Interactive};
+    ASSERT_EQ(expected, order);
+    ASSERT_EQ(1, scheduler.Stats(PriorityClass::Background).Promoted);
+    ASSERT_LE(std::chrono::milliseconds(5), scheduler.Stats(PriorityClass::Background).TotalWait);
+}
+
+TEST(InferenceTestSuite, OutputPipePriorityReachesModel) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<PriorityModel>());
+    auto a = fb->BindInput<float>("A").value();
+    auto p = fb->BindOutput<int>("P").value();
+    ASSERT_EQ(PriorityClass::Normal, p->Priority());
+    p->SetPriority(PriorityClass::Interactive);
+    ASSERT_EQ(PriorityClass::Interactive, p->Priority());
+
+    a->Feed(1);
+    int value;
+    ASSERT_TRUE(p->UpdateIfChanged(value).value());
+    ASSERT_EQ(static_cast<int>(PriorityClass::Interactive), value);
+    // The priority is the pipe's only while it updates.
+    ASSERT_EQ(PriorityClass::Normal, CurrentPriority());
+
+    p->SetPriority(PriorityClass::Background);
+    a->Feed(2);
+    ASSERT_TRUE(p->UpdateIfChanged(value).value());
+    ASSERT_EQ(static_cast<int>(PriorityClass::Background), value);
+}
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/feature_provider.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace ::inference;
+
+namespace inference_test {
+// A feature provider of float outputs that supports pulling, and counts how many times each output was "decoded," that
+// is, actually published to the broker.
+class CountingPullProvider : public FeatureProvider {
+   public:
+    explicit CountingPullProvider(std::vector<std::string> const &names) {
+        for (auto &name : names) {
+            _outputs.emplace(name, TypeDescriptor::Create<float>());
+            _values.emplace(name, 0.f);
+            _decodes.emplace(name, 0);
+        }
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const &Outputs() const override { return _outputs; }
+
+    void Set(std::string const &name, float value) {
+        std::vector<std::pair<std::shared_ptr<Updater>, std::size_t>> toNotify;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _values[name] = value;
+            for (auto iter = _updaters.begin(); iter != _updaters.end();) {
+                if (auto updater = iter->lock()) {
+                    for (std::size_t i = 0; i < updater->_names.size(); ++i) {
+                        if (updater->_names[i] == name) toNotify.emplace_back(updater, i);
+                    }
+                    ++iter;
+                } else {
+                    iter = _updaters.erase(iter);
+                }
+            }
+        }
+        for (auto &pair : toNotify) pair.first->_staleNotifier(pair.second);
+    }
+
+    int Decodes(std::string const &name) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _decodes.at(name);
+    }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<InputPipe>> const &outputToPipe,
+        std::function<void()> valuesChangedNotifier) const override {
+        // Only pulling is supported.
+        return make_feature_unexpected(feature_errc::invalid_operation);
+    }
+
+    rt::expected<std::shared_ptr<PullValueUpdater>> CreatePullValueUpdater(
+        std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> const &outputToPipe,
+        std::function<void(std::size_t)> staleNotifier) const override {
+        auto updater = std::make_shared<Updater>(
+            std::static_pointer_cast<const CountingPullProvider>(shared_from_this()), outputToPipe, staleNotifier);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _updaters.push_back(updater);
+        return std::static_pointer_cast<PullValueUpdater>(updater);
+    }
+
+   private:
+    class Updater : public PullValueUpdater {
+       public:
+        Updater(std::shared_ptr<const CountingPullProvider> parent,
+                std::vector<std::pair<std::string, std::shared_ptr<InputPipe>>> const &outputToPipe,
+                std::function<void(std::size_t)> staleNotifier)
+            : _parent(std::move(parent)), _staleNotifier(std::move(staleNotifier)) {
+            for (auto &pair : outputToPipe) {
+                _names.push_back(pair.first);
+                _pipes.push_back(std::static_pointer_cast<DirectInputPipe<float>>(pair.second));
+            }
+        }
+
+        std::error_code UpdateOutputs(std::vector<std::size_t> const &staleOutputs) override {
+            for (auto index : staleOutputs) {
+                float value;
+                {
+                    std::lock_guard<std::mutex> lock(_parent->_mutex);
+                    value = _parent->_values.at(_names[index]);
+                    ++_parent->_decodes.at(_names[index]);
+                }
+                _pipes[index]->Feed(value);
+            }
+            return err_feature_ok();
+        }
+
+       private:
+        friend class CountingPullProvider;
+        const std::shared_ptr<const CountingPullProvider> _parent;
+        const std::function<void(std::size_t)> _staleNotifier;
+        std::vector<std::string> _names;
+        std::vector<std::shared_ptr<DirectInputPipe<float>>> _pipes;
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+    std::unordered_map<std::string, float> _values;
+    mutable std::unordered_map<std::string, int> _decodes;
+    mutable std::vector<std::weak_ptr<Updater>> _updaters;
+};
+
+}  // namespace inference_test
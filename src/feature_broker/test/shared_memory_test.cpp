@@ -0,0 +1,148 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef _WIN32
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <inference/feature_broker.hpp>
+#include <inference/shared_memory.hpp>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "add_five_model.hpp"
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+// Tests may run concurrently in several processes, so the regions are named per process.
+std::string RegionName(char const* name) { return std::string(name) + "_" + std::to_string(::getpid()); }
+}  // namespace
+
+TEST(InferenceTestSuite, SharedMemoryPublishAndObserve) {
+    auto name = RegionName("fb_shared_memory_test");
+    SharedMemoryPublisher::Layout layout;
+    layout.Add<float>("A").Add<std::string>("S", 64).Add<Tensor<float>>("T", 4 + 8 + 4 * sizeof(float));
+    auto publisher = SharedMemoryPublisher::Create(name, layout).value();
+    auto a = publisher->BindInput<float>("A").value();
+    auto s = publisher->BindInput<std::string>("S").value();
+    auto t = publisher->BindInput<Tensor<float>>("T").value();
+    // Published before any observer is there, and still seen.
+    a->Feed(1);
+
+    auto provider = SharedMemoryProvider::Open(name).value();
+    ASSERT_EQ(3, provider->Outputs().size());
+    ASSERT_EQ(TypeDescriptor::Create<Tensor<float>>(), provider->Outputs().at("T"));
+    auto fb = std::make_shared<FeatureBroker>();
+    ASSERT_TRUE(fb->BindInputs(provider));
+
+    auto x = fb->Fork(std::make_shared<inference_test::AddFiveModel>()).value()->BindOutput<float>("X").value();
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(6, value);
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+
+    // The provider's watcher is woken by the write, and lets the output know.
+    std::promise<void> changed;
+    ASSERT_TRUE(x->NotifyWhenChanged([&changed]() { changed.set_value(); }));
+    a->Feed(2);
+    ASSERT_EQ(std::future_status::ready, changed.get_future().wait_for(std::chrono::seconds(10)));
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(7, value);
+
+    s->Feed("hello");
+    auto sModel = std::make_shared<inference_test::PassThroughModel<std::string>>("S", "SO");
+    std::string stringValue;
+    ASSERT_TRUE(fb->Fork(sModel).value()->BindOutput<std::string>("SO").value()->UpdateIfChanged(stringValue).value());
+    ASSERT_EQ("hello", stringValue);
+
+    std::shared_ptr<float> data(new float[4]{1, 2, 3, 4}, std::default_delete<float[]>());
+    t->Feed(Tensor<float>(data, {4}));
+    auto tModel = std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("T", "TO");
+    auto to = fb->Fork(tModel).value()->BindOutput<Tensor<float>>("TO").value();
+    Tensor<float> tensor;
+    ASSERT_TRUE(to->UpdateIfChanged(tensor).value());
+    ASSERT_EQ(std::vector<size_t>{4}, tensor.Dimensions());
+    ASSERT_EQ(3, tensor.Data()[2]);
+
+    // Too large for the slot, so not published.
+    std::shared_ptr<float> larger(new float[5]{}, std::default_delete<float[]>());
+    t->Feed(Tensor<float>(larger, {5}));
+    ASSERT_EQ(1, publisher->Oversized());
+    ASSERT_FALSE(to->UpdateIfChanged(tensor).value());
+}
+
+TEST(InferenceTestSuite, SharedMemoryErrors) {
+    auto name = RegionName("fb_shared_memory_test_errors");
+    SharedMemoryPublisher::Layout layout;
+    layout.Add<float>("A").Add<std::string>("S");
+    auto createExpected = SharedMemoryPublisher::Create(name, layout);
+    ASSERT_FALSE(createExpected);
+    ASSERT_EQ(feature_errc::invalid_operation, createExpected.error());
+
+    SharedMemoryPublisher::Layout duplicated;
+    duplicated.Add<float>("A").Add<int32_t>("A");
+    ASSERT_EQ(feature_errc::invalid_operation, SharedMemoryPublisher::Create(name, duplicated).error());
+
+    auto openExpected = SharedMemoryProvider::Open(name);
+    ASSERT_FALSE(openExpected);
+    ASSERT_EQ(std::errc::no_such_file_or_directory, openExpected.error());
+
+    SharedMemoryPublisher::Layout valid;
+    valid.Add<float>("A");
+    auto publisher = SharedMemoryPublisher::Create(name, valid).value();
+    ASSERT_EQ(feature_errc::name_not_found, publisher->BindInput<float>("B").error());
+    ASSERT_EQ(feature_errc::type_mismatch, publisher->BindInput<double>("A").error());
+    ASSERT_TRUE(publisher->BindInput<float>("A"));
+    ASSERT_EQ(feature_errc::already_bound, publisher->BindInput<float>("A").error());
+
+    // The name goes with the publisher.
+    publisher.reset();
+    ASSERT_FALSE(SharedMemoryProvider::Open(name));
+}
+
+TEST(InferenceTestSuite, SharedMemoryReleasedWhileSignalling) {
+    auto name = RegionName("fb_shared_memory_test_released");
+    SharedMemoryPublisher::Layout layout;
+    layout.Add<float>("A");
+    auto publisher = SharedMemoryPublisher::Create(name, layout).value();
+    auto a = publisher->BindInput<float>("A").value();
+    a->Feed(1);
+
+    // Only the broker holds the provider.
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::AddFiveModel>());
+    ASSERT_TRUE(fb->BindInputs(SharedMemoryProvider::Open(name).value()));
+    auto x = fb->BindOutput<float>("X").value();
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    // Take the readiness left from the first value, so that the callback below waits for the next.
+    x->WaitUntilChanged();
+
+    // Hold the watcher in the middle of signalling, while the broker and the output are released from under it.
+    std::promise<void> signalling;
+    std::promise<void> released;
+    auto releasedFuture = released.get_future();
+    ASSERT_TRUE(x->NotifyWhenChanged([&signalling, &releasedFuture]() {
+        signalling.set_value();
+        releasedFuture.wait_for(std::chrono::seconds(10));
+    }));
+    a->Feed(2);
+    ASSERT_EQ(std::future_status::ready, signalling.get_future().wait_for(std::chrono::seconds(10)));
+    // Releasing the provider waits for its watcher, which is waiting on this, so it is let go from elsewhere.
+    std::thread releaser([&released]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        released.set_value();
+    });
+    x.reset();
+    fb.reset();
+    releaser.join();
+}
+
+#endif
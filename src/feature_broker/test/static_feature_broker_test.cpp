@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <inference/static_feature_broker.hpp>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "add_model.hpp"
+#include "gtest/gtest.h"
+#include "three_output_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+struct FloatA : StaticField<float> {
+    static constexpr const char* Name = "A";
+};
+struct FloatB : StaticField<float> {
+    static constexpr const char* Name = "B";
+};
+struct FloatX : StaticField<float> {
+    static constexpr const char* Name = "X";
+};
+struct DoubleX : StaticField<double> {
+    static constexpr const char* Name = "X";
+};
+struct IntA : StaticField<int> {
+    static constexpr const char* Name = "A";
+};
+struct IntX : StaticField<int> {
+    static constexpr const char* Name = "X";
+};
+struct StringZ : StaticField<std::string> {
+    static constexpr const char* Name = "Z";
+};
+
+struct AddSchema {
+    using Inputs = StaticFields<FloatA, FloatB>;
+    using Outputs = StaticFields<FloatX>;
+};
+}  // namespace
+
+TEST(InferenceTestSuite, StaticFeatureBrokerAdd) {
+    auto model = std::make_shared<inference_test::AddModel>();
+    auto brokerExp = StaticFeatureBroker<AddSchema>::Create(model);
+    ASSERT_TRUE(brokerExp);
+    auto broker = brokerExp.value();
+
+    auto update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && !update.value());
+
+    // Until every input has been fed once, there should be no output.
+    broker->Feed<FloatA>(1);
+    update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && !update.value());
+
+    broker->Feed<FloatB>(2);
+    update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && update.value());
+    ASSERT_EQ(3, broker->Value<FloatX>());
+
+    update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && !update.value());
+
+    broker->Feed<FloatB>(5);
+    update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && update.value());
+    ASSERT_EQ(6, broker->Value<FloatX>());
+}
+
+TEST(InferenceTestSuite, StaticFeatureBrokerSubsetOfOutputs) {
+    struct Schema {
+        using Inputs = StaticFields<IntA>;
+        using Outputs = StaticFields<IntX, StringZ>;
+    };
+
+    // Output "Y" also depends on "B", but since it is not in the schema that input is not needed.
+    auto model = std::make_shared<inference_test::ThreeOutputModel>();
+    auto brokerExp = StaticFeatureBroker<Schema>::Create(model);
+    ASSERT_TRUE(brokerExp);
+    auto broker = brokerExp.value();
+
+    broker->Feed<IntA>(2);
+    auto update = broker->UpdateIfChanged();
+    ASSERT_TRUE(update && update.value());
+    ASSERT_TRUE(broker->Changed<IntX>());
+    ASSERT_TRUE(broker->Changed<StringZ>());
+    ASSERT_EQ(7, broker->Value<IntX>());
+    ASSERT_EQ("2", broker->Value<StringZ>());
+}
+
+TEST(InferenceTestSuite, StaticFeatureBrokerSchemaMismatch) {
+    auto model = std::make_shared<inference_test::AddModel>();
+
+    struct WrongType {
+        using Inputs = StaticFields<FloatA, FloatB>;
+        using Outputs = StaticFields<DoubleX>;
+    };
+    auto wrongType = StaticFeatureBroker<WrongType>::Create(model);
+    ASSERT_FALSE(wrongType);
+    ASSERT_EQ(make_feature_error(feature_errc::type_mismatch), wrongType.error());
+
+    struct MissingInput {
+        using Inputs = StaticFields<FloatA>;
+        using Outputs = StaticFields<FloatX>;
+    };
+    auto missingInput = StaticFeatureBroker<MissingInput>::Create(model);
+    ASSERT_FALSE(missingInput);
+    ASSERT_EQ(make_feature_error(feature_errc::not_bound), missingInput.error());
+
+    struct MissingOutput {
+        using Inputs = StaticFields<FloatA, FloatB>;
+        using Outputs = StaticFields<FloatX, StringZ>;
+    };
+    auto missingOutput = StaticFeatureBroker<MissingOutput>::Create(model);
+    ASSERT_FALSE(missingOutput);
+    ASSERT_EQ(make_feature_error(feature_errc::name_not_found), missingOutput.error());
+}
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <future>
+#include <inference/feature_broker.hpp>
+#include <inference/stream_input_pipe.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+#include "sum_events_model.hpp"
+
+using namespace ::inference;
+
+namespace {
+std::vector<float> Events(Tensor<float> const& tensor) {
+    return std::vector<float>(tensor.Data(), tensor.Data() + tensor.Dimensions()[0]);
+}
+}  // namespace
+
+TEST(InferenceTestSuite, StreamInputDeliversEveryEvent) {
+    auto model = std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("E", "O");
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto e = fb->BindStreamInput<float>("E", 4, StreamPolicy::DropNewest).value();
+    ASSERT_EQ(TypeDescriptor::Create<Tensor<float>>(), e->Type());
+    ASSERT_EQ(4, e->Capacity());
+    // Events fed before any output is bound are kept.
+    e->Feed(1);
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+    e->Feed(2);
+    e->Feed(3);
+
+    Tensor<float> batch;
+    ASSERT_TRUE(o->UpdateIfChanged(batch).value());
+    ASSERT_EQ((std::vector<float>{1, 2, 3}), Events(batch));
+    ASSERT_FALSE(o->UpdateIfChanged(batch).value());
+
+    for (int i = 4; i < 10; ++i) e->Feed(static_cast<float>(i));
+    ASSERT_EQ(2, e->Dropped());
+    ASSERT_TRUE(o->UpdateIfChanged(batch).value());
+    ASSERT_EQ((std::vector<float>{4, 5, 6, 7}), Events(batch));
+
+    // The first event of a batch wakes the consumer.
+    std::promise<void> changed;
+    ASSERT_TRUE(o->NotifyWhenChanged([&changed]() { changed.set_value(); }));
+    std::thread producer([&e]() { e->Feed(10); });
+    ASSERT_EQ(std::future_status::ready, changed.get_future().wait_for(std::chrono::seconds(10)));
+    producer.join();
+    ASSERT_TRUE(o->UpdateIfChanged(batch).value());
+    ASSERT_EQ(std::vector<float>{10}, Events(batch));
+
+    ASSERT_EQ(feature_errc::already_bound, fb->BindStreamInput<float>("E").error());
+}
+
+TEST(InferenceTestSuite, StreamInputBatchSeenOnce) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::SumEventsModel>());
+    auto e = fb->BindStreamInput<float>("E", 4, StreamPolicy::DropOldest).value();
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    a->Feed(100);
+    e->Feed(1);
+    e->Feed(2);
+    float value;
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(103, value);
+
+    // The model runs again for the other input, and sees no events rather than the last batch again.
+    a->Feed(200);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(200, value);
+
+    for (int i = 1; i <= 6; ++i) e->Feed(static_cast<float>(i));
+    ASSERT_EQ(2, e->Dropped());
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(200 + 3 + 4 + 5 + 6, value);
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+}
+
+TEST(InferenceTestSuite, StreamInputBlockingProducer) {
+    auto model = std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("E", "O");
+    auto fb = std::make_shared<FeatureBroker>(model);
+    auto e = fb->BindStreamInput<float>("E", 2, StreamPolicy::Block).value();
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+
+    const int count = 1000;
+    std::thread producer([&e, count]() {
+        for (int i = 0; i < count; ++i) e->Feed(static_cast<float>(i));
+    });
+    std::vector<float> received;
+    Tensor<float> batch;
+    while (received.size() < count) {
+        o->WaitUntilChanged();
+        if (!o->UpdateIfChanged(batch).value()) continue;
+        auto events = Events(batch);
+        received.insert(received.end(), events.begin(), events.end());
+    }
+    producer.join();
+    ASSERT_EQ(0, e->Dropped());
+    for (int i = 0; i < count; ++i) ASSERT_EQ(i, received[i]);
+}
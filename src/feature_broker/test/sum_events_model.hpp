@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/model.hpp>
+#include <inference/tensor.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+using namespace ::inference;
+
+namespace inference_test {
+class SumEventsValueUpdater : public inference::ValueUpdater {
+   public:
+    SumEventsValueUpdater(std::shared_ptr<IHandle> const& events, std::shared_ptr<IHandle> const& base,
+                          std::shared_ptr<InputPipe> const& pipe)
+        : _pipe(std::static_pointer_cast<DirectInputPipe<float>>(pipe)),
+          _events(std::static_pointer_cast<Handle<Tensor<float>>>(events)),
+          _base(std::static_pointer_cast<Handle<float>>(base)) {}
+
+    std::error_code UpdateOutput() override {
+        auto events = _events->Value();
+        float value = _base->Value();
+        for (std::size_t i = 0; i < events.Dimensions()[0]; ++i) value += events.Data()[i];
+        _pipe->Feed(value);
+        return err_feature_ok();
+    }
+
+   private:
+    std::shared_ptr<DirectInputPipe<float>> _pipe;
+    std::shared_ptr<Handle<Tensor<float>>> _events;
+    std::shared_ptr<Handle<float>> _base;
+};
+
+/// <summary>
+/// Given a stream of events 'E' and a single input 'A' publishes as 'X' the sum of 'A' and the events in the batch, so
+/// that tests can tell whether a batch is seen more than once.
+/// </summary>
+class SumEventsModel : public Model {
+   public:
+    SumEventsModel() {
+        _inputs.emplace("E", TypeDescriptor::Create<Tensor<float>>());
+        _inputs.emplace("A", TypeDescriptor::Create<float>());
+        _outputs.emplace("X", TypeDescriptor::Create<float>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+
+    std::vector<std::string> GetRequirements(std::string const& outputName) const override { return {"E", "A"}; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<inference::IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<inference::InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();
+        auto iterPipe = outputToPipe.find("X");
+        if (iterPipe == outputToPipe.end()) return make_feature_unexpected(feature_errc::name_not_found);
+        auto iterEvents = inputToHandle.find("E");
+        auto iterBase = inputToHandle.find("A");
+        if (iterEvents == inputToHandle.end() || iterBase == inputToHandle.end())
+            return make_feature_unexpected(feature_errc::name_not_found);
+        auto updater = std::make_shared<SumEventsValueUpdater>(iterEvents->second, iterBase->second, iterPipe->second);
+        return std::static_pointer_cast<ValueUpdater>(updater);
+    }
+
+   private:
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+
+}  // namespace inference_test
@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
+#include <inference/model.hpp>
+#include <inference/type_descriptor.hpp>
+#include <inference/value_updater.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace ::inference;
+
+namespace inference_test {
+/// <summary>
+/// Given any number of float inputs with the names given at construction, publishes their sum as the output 'X'.
+/// </summary>
+class SumModel : public Model {
+   public:
+    explicit SumModel(std::vector<std::string> const& inputNames) : _inputNames(inputNames) {
+        for (auto& name : inputNames) _inputs.emplace(name, TypeDescriptor::Create<float>());
+        _outputs.emplace("X", TypeDescriptor::Create<float>());
+    }
+
+    std::unordered_map<std::string, TypeDescriptor> const& Inputs() const override { return _inputs; }
+    std::unordered_map<std::string, TypeDescriptor> const& Outputs() const override { return _outputs; }
+    std::vector<std::string> GetRequirements(std::string const& outputName) const override { return _inputNames; }
+
+    rt::expected<std::shared_ptr<ValueUpdater>> CreateValueUpdater(
+        std::map<std::string, std::shared_ptr<inference::IHandle>> const& inputToHandle,
+        std::map<std::string, std::shared_ptr<inference::InputPipe>> const& outputToPipe,
+        std::function<void()> outOfBandNotifier) const override {
+        outOfBandNotifier();  // No out of band information, so call and ignore henceforth.
+        auto iterPipe = outputToPipe.find("X");
+        if (iterPipe == outputToPipe.end()) return make_feature_unexpected(feature_errc::name_not_found);
+
+        std::vector<std::shared_ptr<Handle<float>>> handles;
+        for (auto& name : _inputNames) {
+            auto iterHandle = inputToHandle.find(name);
+            if (iterHandle == inputToHandle.end()) return make_feature_unexpected(feature_errc::name_not_found);
+            handles.push_back(std::static_pointer_cast<Handle<float>>(iterHandle->second));
+        }
+        auto pipe = std::static_pointer_cast<DirectInputPipe<float>>(iterPipe->second);
+        return std::static_pointer_cast<ValueUpdater>(std::make_shared<Updater>(std::move(handles), std::move(pipe)));
+    }
+
+   private:
+    class Updater : public ValueUpdater {
+       public:
+        Updater(std::vector<std::shared_ptr<Handle<float>>> handles, std::shared_ptr<DirectInputPipe<float>> pipe)
+            : _handles(std::move(handles)), _pipe(std::move(pipe)) {}
+
+        std::error_code UpdateOutput() override {
+            float sum = 0;
+            for (auto& handle : _handles) sum += handle->Value();
+            _pipe->Feed(sum);
+            return err_feature_ok();
+        }
+
+       private:
+        std::vector<std::shared_ptr<Handle<float>>> _handles;
+        std::shared_ptr<DirectInputPipe<float>> _pipe;
+    };
+
+    std::vector<std::string> _inputNames;
+    std::unordered_map<std::string, TypeDescriptor> _inputs;
+    std::unordered_map<std::string, TypeDescriptor> _outputs;
+};
+
+}  // namespace inference_test
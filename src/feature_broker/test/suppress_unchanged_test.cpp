@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <inference/feature_broker.hpp>
+#include <inference/tensor.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pass_through_model.hpp"
+#include "three_output_model.hpp"
+
+using namespace ::inference;
+
+TEST(InferenceTestSuite, SuppressUnchangedFeeds) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::PassThroughModel<float>>("A", "X"));
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    float value;
+
+    // Off by default, so feeding the same value is a change.
+    a->Feed(1);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    a->Feed(1);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(0, a->Suppressed());
+
+    a->SuppressUnchanged();
+    a->Feed(1);
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+    a->Feed(1);
+    ASSERT_EQ(2, a->Suppressed());
+    a->Feed(2);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(2, value);
+    ASSERT_EQ(2, a->Suppressed());
+
+    a->SuppressUnchanged(false);
+    a->Feed(2);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(2, a->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedBroadcastFeeds) {
+    auto fb = std::make_shared<FeatureBroker>(
+        std::make_shared<inference_test::PassThroughModel<std::string>>("A", "X"));
+    auto a = fb->BindBroadcastInput<std::string>("A").value();
+    auto x = fb->BindOutput<std::string>("X").value();
+    a->SuppressUnchanged();
+    std::string value;
+
+    a->Feed("a");
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    a->Feed("a");
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+    a->Feed("b");
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ("b", value);
+    ASSERT_EQ(1, a->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedConcurrentBroadcastFeeds) {
+    auto fb = std::make_shared<FeatureBroker>(
+        std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("T", "O"));
+    auto t = fb->BindBroadcastInput<Tensor<float>>("T").value();
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+    t->SuppressUnchanged();
+    std::shared_ptr<float> zero(new float[1]{0}, std::default_delete<float[]>());
+    std::shared_ptr<float> one(new float[1]{1}, std::default_delete<float[]>());
+    Tensor<float> value;
+
+    for (int round = 0; round < 20; ++round) {
+        std::vector<std::thread> feeders;
+        for (int i = 0; i < 4; ++i) {
+            feeders.emplace_back([&t, &zero, &one, i]() {
+                for (int j = 0; j < 100; ++j) t->Feed(Tensor<float>((i + j) % 2 ? one : zero, {1}));
+            });
+        }
+        for (auto& feeder : feeders) feeder.join();
+        o->UpdateIfChanged(value).value();
+        // Whichever value was published last, the filter must have seen that one, so the other is a change.
+        auto other = value.Data()[0] == 0 ? one : zero;
+        t->Feed(Tensor<float>(other, {1}));
+        ASSERT_TRUE(o->UpdateIfChanged(value).value());
+        ASSERT_EQ(other.get()[0], value.Data()[0]);
+    }
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedTensorFeeds) {
+    auto fb = std::make_shared<FeatureBroker>(
+        std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("T", "O"));
+    auto t = fb->BindInput<Tensor<float>>("T").value();
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+    t->SuppressUnchanged();
+    std::shared_ptr<float> data(new float[6]{}, std::default_delete<float[]>());
+    Tensor<float> tensor(data, {2, 3});
+    Tensor<float> value;
+
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+    t->Feed(tensor);
+    ASSERT_FALSE(o->UpdateIfChanged(value).value());
+
+    // Refilled in place, the tensor fed shares its data with the last, but is still a change.
+    tensor.Data()[4] = 1;
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+
+    // As is the same content in other dimensions.
+    t->Feed(Tensor<float>(data, {3, 2}));
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+
+    // Or the same content in another buffer, which is not.
+    std::shared_ptr<float> copy(new float[6]{0, 0, 0, 0, 1, 0}, std::default_delete<float[]>());
+    t->Feed(Tensor<float>(copy, {3, 2}));
+    ASSERT_FALSE(o->UpdateIfChanged(value).value());
+    ASSERT_EQ(2, t->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedStringTensorFeeds) {
+    auto fb = std::make_shared<FeatureBroker>(
+        std::make_shared<inference_test::PassThroughModel<Tensor<std::string>>>("T", "O"));
+    auto t = fb->BindInput<Tensor<std::string>>("T").value();
+    auto o = fb->BindOutput<Tensor<std::string>>("O").value();
+    t->SuppressUnchanged();
+    std::shared_ptr<std::string> data(new std::string[2]{std::string(32, 'a'), "b"},
+                                      std::default_delete<std::string[]>());
+    Tensor<std::string> tensor(data, {2});
+    Tensor<std::string> value;
+
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+    t->Feed(tensor);
+    ASSERT_FALSE(o->UpdateIfChanged(value).value());
+
+    // Refilled in place with text of the same length, so that the strings keep their buffers, it is still a change.
+    data.get()[0].assign(32, 'c');
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+    ASSERT_EQ(std::string(32, 'c'), value.Data()[0]);
+    ASSERT_EQ(1, t->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedOutputs) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::PassThroughModel<float>>("A", "X"));
+    auto a = fb->BindInput<float>("A").value();
+    auto x = fb->BindOutput<float>("X").value();
+    x->SuppressUnchanged(true, 0.01);
+    float value = 0;
+
+    a->Feed(1);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(1, value);
+    // The model runs, but its output is within the tolerance of the last reported, so the value is left alone.
+    a->Feed(1.005f);
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(1, value);
+    ASSERT_EQ(1, x->Suppressed());
+    // The input was consumed all the same, so the model does not run again.
+    ASSERT_FALSE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(1, x->Suppressed());
+    // Outputs are compared with the last reported rather than the last computed, so small steps still add up.
+    a->Feed(1.011f);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_FLOAT_EQ(1.011f, value);
+
+    x->SuppressUnchanged(false);
+    a->Feed(1.011f);
+    ASSERT_TRUE(x->UpdateIfChanged(value).value());
+    ASSERT_EQ(1, x->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedTupleOutputs) {
+    auto fb = std::make_shared<FeatureBroker>(std::make_shared<inference_test::ThreeOutputModel>());
+    auto a = fb->BindInput<int>("A").value();
+    auto b = fb->BindInput<float>("B").value();
+    auto xy = fb->BindOutputs<int, float>({"X", "Y"}).value();
+    xy->SuppressUnchanged(true, 0.01);
+    std::tuple<int, float> value;
+
+    a->Feed(1);
+    b->Feed(1);
+    ASSERT_TRUE(xy->UpdateIfChanged(value).value());
+    ASSERT_EQ(std::make_tuple(6, 2.f), value);
+    b->Feed(1.001f);
+    ASSERT_FALSE(xy->UpdateIfChanged(value).value());
+    ASSERT_EQ(std::make_tuple(6, 2.f), value);
+    // Only the integer output changes, but both are reported.
+    a->Feed(2);
+    b->Feed(0.001f);
+    ASSERT_TRUE(xy->UpdateIfChanged(value).value());
+    ASSERT_EQ(7, std::get<0>(value));
+    ASSERT_FLOAT_EQ(2.001f, std::get<1>(value));
+    ASSERT_EQ(1, xy->Suppressed());
+}
+
+TEST(InferenceTestSuite, SuppressUnchangedTensorOutputs) {
+    auto fb = std::make_shared<FeatureBroker>(
+        std::make_shared<inference_test::PassThroughModel<Tensor<float>>>("T", "O"));
+    auto t = fb->BindInput<Tensor<float>>("T").value();
+    auto o = fb->BindOutput<Tensor<float>>("O").value();
+    o->SuppressUnchanged(true, 0.5);
+    std::shared_ptr<float> data(new float[2]{1, 2}, std::default_delete<float[]>());
+    Tensor<float> tensor(data, {2});
+    Tensor<float> value;
+
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+    // Refilled in place, so the data of the output last reported is overwritten too. Only its copy still tells.
+    tensor.Data()[1] = 2.25f;
+    t->Feed(tensor);
+    ASSERT_FALSE(o->UpdateIfChanged(value).value());
+    tensor.Data()[1] = 3;
+    t->Feed(tensor);
+    ASSERT_TRUE(o->UpdateIfChanged(value).value());
+    ASSERT_EQ(3, value.Data()[1]);
+    ASSERT_EQ(1, o->Suppressed());
+}
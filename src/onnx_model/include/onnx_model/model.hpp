@@ -4,7 +4,9 @@
 #pragma once
 
 #include <cstdint>
+#include <inference/inference_executor.hpp>
 #include <inference/model.hpp>
+#include <inference/priority_scheduler.hpp>
 #include <rt/rt_expected.hpp>
 #include <system_error>
 
@@ -19,6 +21,19 @@ class Model final : public inference::Model {
     ONNX_MODEL_EXPORT std::unordered_map<std::string, inference::TypeDescriptor> const& Outputs() const override;
     ONNX_MODEL_EXPORT std::vector<std::string> GetRequirements(std::string const& outputName) const override;
 
+    /**
+     * @brief What runs of the model are serialized through, by the priority of the output pipes updating them. Its
+     * statistics tell how long each class of work waited for the model.
+     */
+    ONNX_MODEL_EXPORT inference::PriorityScheduler const& Scheduler() const;
+
+    /**
+     * @brief The model's tenant of the global inference executor, which its runs are submitted through. Its weight is
+     * the model's share of the executor's workers when they are all busy. It is named after the path the model was
+     * loaded from, along with a number to tell apart models loaded from the same file or from buffers.
+     */
+    ONNX_MODEL_EXPORT inference::InferenceExecutor::Tenant& Tenant() const;
+
     ONNX_MODEL_EXPORT rt::expected<std::shared_ptr<inference::ValueUpdater>> CreateValueUpdater(
         std::map<std::string, std::shared_ptr<inference::IHandle>> const& inputToHandle,
         std::map<std::string, std::shared_ptr<inference::InputPipe>> const& outputToPipe,
@@ -36,7 +51,7 @@ class Model final : public inference::Model {
     std::vector<std::string> m_deps;
 
     // Actual types hidden via type erasure.
-    Model(void* env, void* session, onnx_errc& errc);
+    Model(void* env, void* session, std::string const& source, onnx_errc& errc);
 
     class UpdaterImpl : public inference::ValueUpdater {
        public:
@@ -3,16 +3,24 @@
 
 #include <onnxruntime_c_api.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <inference/deadline.hpp>
 #include <inference/direct_input_pipe.hpp>
+#include <inference/feature_error.hpp>
 #include <inference/handle.hpp>
+#include <inference/inference_executor.hpp>
 #include <inference/input_pipe.hpp>
+#include <inference/priority_scheduler.hpp>
 #include <inference/tensor.hpp>
 #include <mutex>
 #include <onnx_model/model.hpp>
 #include <onnx_model/onnx_error.hpp>
+#include <string>
 
 namespace {
 
@@ -26,38 +34,67 @@ std::wstring Path(std::string const& name) {
 std::string Path(std::string const& name) { return name; }
 #endif
 
+// Names the tenant of a model by what it was loaded from, so that the models sharing the executor can be told apart
+// when monitoring it. The same file may be loaded more than once, so the names are numbered as well.
+std::string TenantName(std::string const& source) {
+    static std::atomic<std::uint64_t> loaded{0};
+    return "onnx_model " + std::to_string(loaded.fetch_add(1, std::memory_order_relaxed) + 1) + " " + source;
+}
+
+/**
+ * @brief The ONNX environment shared by all models, created on first use. Each environment has threads of its own, so
+ * that one per model would have a process with many models running far more threads than it has cores.
+ *
+ * @return The environment, or null if it could not be created.
+ */
+std::shared_ptr<OrtEnv> shared_env() {
+    static std::mutex mutex;
+    static std::shared_ptr<OrtEnv> env;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (env) return env;
+    OrtEnv* created;
+    auto status = OrtCreateEnv(OrtLoggingLevel::ORT_LOGGING_LEVEL_FATAL, "onnx_model", &created);
+    if (status != nullptr) {
+        OrtReleaseStatus(status);
+        return nullptr;
+    }
+    env = std::shared_ptr<OrtEnv>(created, [](OrtEnv* e) { OrtReleaseEnv(e); });
+    return env;
+}
+
 /**
  * @brief Helper function for creating ONNX sessions.
  *
  * @param sessionCreator A function that given an environment sets the session parameter to be a created session, and
  * returns the ONNX runtime status.
- * @param env The ONNX environment, used to create the sessions.
+ * @param env The shared ONNX environment the session was created in.
  * @param session The session that was created, or null if some problem occurred.
  * @return inference::onnx_errc The error code.
  */
 onnx_model::onnx_errc create_session(
-    std::function<OrtStatus*(OrtEnv*, OrtSessionOptions*, OrtSession*& session)> sessionCreator, OrtEnv*& env,
-    OrtSession*& session) {
-    auto status = OrtCreateEnv(OrtLoggingLevel::ORT_LOGGING_LEVEL_FATAL, "onnx_model", &env);
-    if (status != nullptr) {
-        OrtReleaseStatus(status);
-        return onnx_model::onnx_errc::internal_library_error;
-    }
+    std::function<OrtStatus*(OrtEnv*, OrtSessionOptions*, OrtSession*& session)> sessionCreator,
+    std::shared_ptr<OrtEnv>& env, OrtSession*& session) {
+    env = shared_env();
+    if (!env) return onnx_model::onnx_errc::internal_library_error;
     // Create the session
     OrtSessionOptions* sessionOptions;
+    OrtStatus* status;
     if (status = OrtCreateSessionOptions(&sessionOptions)) {
         OrtReleaseStatus(status);
-        OrtReleaseEnv(env);
-        env = nullptr;
+        return onnx_model::onnx_errc::internal_library_error;
+    }
+    // Runs are spread over the workers of the global inference executor instead, which has as many as there are cores,
+    // so a session of its own pool of threads would only oversubscribe them.
+    if (status = OrtSetSessionThreadPoolSize(sessionOptions, 1)) {
+        OrtReleaseStatus(status);
+        OrtReleaseSessionOptions(sessionOptions);
         return onnx_model::onnx_errc::internal_library_error;
     }
     // Create the session.
-    status = sessionCreator(env, sessionOptions, session);
+    status = sessionCreator(env.get(), sessionOptions, session);
     OrtReleaseSessionOptions(sessionOptions);
     if (status != nullptr) {
         OrtReleaseStatus(status);
-        OrtReleaseEnv(env);
-        env = nullptr;
         return onnx_model::onnx_errc::model_load_error;
     }
     return onnx_model::onnx_errc();
@@ -219,11 +256,16 @@ class Model::State final {
     // Unlike, say, TensorFlow, ONNX runtime appears to make no distinction between a graph and a session, and unless
     // the session is allocating fresh memory for all intermediate tensors on every run (which would be grossly
     // inefficient), it is not reasonable to suppose that a session is thread safe. We might inquire after this.
-    std::mutex m_model_lock;
-
-    State(OrtEnv* env, OrtSession* session)
-        : m_env(std::shared_ptr<OrtEnv>(env, [this](OrtEnv* e) { OrtReleaseEnv(e); })),
-          m_session(std::shared_ptr<OrtSession>(session, [this](OrtSession* s) { OrtReleaseSession(s); })) {
+    // Runs are serialized through a scheduler rather than a plain mutex, so that urgent requests go ahead of queued
+    // bulk work.
+    inference::PriorityScheduler m_scheduler;
+    // Runs go to the workers of the global executor through this, so that the models of the process share the cores.
+    const std::shared_ptr<inference::InferenceExecutor::Tenant> m_tenant;
+
+    State(std::shared_ptr<OrtEnv> env, OrtSession* session, std::string const& source)
+        : m_env(std::move(env)),
+          m_session(std::shared_ptr<OrtSession>(session, [this](OrtSession* s) { OrtReleaseSession(s); })),
+          m_tenant(inference::InferenceExecutor::Global().CreateTenant(TenantName(source))) {
         OrtAllocator* alloc = nullptr;
         auto status = OrtCreateDefaultAllocator(&alloc);
         if (status != nullptr) alloc = nullptr;
@@ -248,12 +290,14 @@ class Model::State final {
  *
  * This is a private constructor called from one of the static load methods.
  *
- * @param env The ONNX environment.
+ * @param env The shared ONNX environment, as a std::shared_ptr<OrtEnv>.
  * @param session The session that this ONNX model is wrapping.
+ * @param source What the model was loaded from, which names its tenant of the global executor.
  * @param errc A reference error-code that is set to something non-zero in case anything goes wrong during construction.
  */
-Model::Model(void* env, void* session, onnx_errc& errc)
-    : m_state(std::shared_ptr<State>(new State(static_cast<OrtEnv*>(env), static_cast<OrtSession*>(session)))) {
+Model::Model(void* env, void* session, std::string const& source, onnx_errc& errc)
+    : m_state(std::shared_ptr<State>(
+          new State(*static_cast<std::shared_ptr<OrtEnv>*>(env), static_cast<OrtSession*>(session), source))) {
     // Initialize the map of the inputs.
     if (!m_state->m_allocInfo) {
         errc = onnx_errc::internal_library_error;
@@ -277,7 +321,7 @@ Model::Model(void* env, void* session, onnx_errc& errc)
 }
 
 rt::expected<std::shared_ptr<Model>> Model::Load(std::string const& path) noexcept {
-    OrtEnv* env;
+    std::shared_ptr<OrtEnv> env;
     OrtSession* session;
     onnx_errc errc = ::create_session(
         [&path](OrtEnv* dEnv, OrtSessionOptions* dOpt, OrtSession*& dSess) {
@@ -286,13 +330,13 @@ rt::expected<std::shared_ptr<Model>> Model::Load(std::string const& path) noexce
         },
         env, session);
     if (static_cast<int>(errc) != 0) return onnx_model::make_onnx_unexpected(errc);
-    auto model = std::shared_ptr<Model>(new Model(env, session, errc));
+    auto model = std::shared_ptr<Model>(new Model(&env, session, path, errc));
     if (static_cast<int>(errc) != 0) return onnx_model::make_onnx_unexpected(errc);
     return model;
 }
 
 rt::expected<std::shared_ptr<Model>> Model::LoadFromBuffer(const void* modelData, const size_t modelSize) noexcept {
-    OrtEnv* env;
+    std::shared_ptr<OrtEnv> env;
     OrtSession* session;
     onnx_errc errc = ::create_session(
         [&modelData, &modelSize](OrtEnv* dEnv, OrtSessionOptions* dOpt, OrtSession*& dSess) {
@@ -300,7 +344,7 @@ rt::expected<std::shared_ptr<Model>> Model::LoadFromBuffer(const void* modelData
         },
         env, session);
     if (static_cast<int>(errc) != 0) return onnx_model::make_onnx_unexpected(errc);
-    auto model = std::shared_ptr<Model>(new Model(env, session, errc));
+    auto model = std::shared_ptr<Model>(new Model(&env, session, "(buffer)", errc));
     if (static_cast<int>(errc) != 0) return onnx_model::make_onnx_unexpected(errc);
     return model;
 }
@@ -310,6 +354,10 @@ Model::~Model() = default;
 std::unordered_map<std::string, inference::TypeDescriptor> const& Model::Inputs() const { return m_inputs; }
 std::unordered_map<std::string, inference::TypeDescriptor> const& Model::Outputs() const { return m_outputs; }
 
+inference::PriorityScheduler const& Model::Scheduler() const { return m_state->m_scheduler; }
+
+inference::InferenceExecutor::Tenant& Model::Tenant() const { return *m_state->m_tenant; }
+
 std::vector<std::string> Model::GetRequirements(std::string const& outputName) const {
     // For the sake of this API. The ONNX C graph API does not appear to have any mechanism to traverse
     // the ONNX graph like the Python API does, and so be more specific with dependencies.
@@ -404,6 +452,11 @@ class IPoker {
      */
     onnx_errc Poke(OrtValue* value, const OrtAllocatorInfo* ai);
     static std::unique_ptr<IPoker> CreatePoker(std::shared_ptr<inference::InputPipe> pipe) noexcept;
+
+   private:
+    // Scratch space for the shape, kept from run to run so that poking does not allocate it each time.
+    std::vector<int64_t> m_dimsTemp;
+    std::vector<size_t> m_dims;
 };
 
 onnx_errc IPoker::Poke(OrtValue* value, const OrtAllocatorInfo* ai) {
@@ -436,13 +489,12 @@ onnx_errc IPoker::Poke(OrtValue* value, const OrtAllocatorInfo* ai) {
     }
     if (ExpectedElementType() != elementType) return onnx_errc::type_mismatch;
     // The type checks track. Get the dimensions and data, and wrap them into a tensor.
-    std::vector<size_t> dims;
     size_t dimsLen;
     if (status = OrtGetDimensionsCount(typeShape, &dimsLen)) {
         OrtReleaseStatus(status);
         return onnx_errc::internal_library_error;
     }
-    std::vector<int64_t> dimsTemp;
+    auto& dimsTemp = m_dimsTemp;
     dimsTemp.resize(dimsLen);
     if (status = OrtGetDimensions(typeShape, dimsTemp.data(), dimsLen)) {
         OrtReleaseStatus(status);
@@ -453,7 +505,8 @@ onnx_errc IPoker::Poke(OrtValue* value, const OrtAllocatorInfo* ai) {
         OrtReleaseStatus(status);
         return onnx_errc::internal_library_error;
     }
-    dims.reserve(dimsLen);
+    auto& dims = m_dims;
+    dims.clear();
     for (const auto& d : dimsTemp) dims.push_back(static_cast<size_t>(d));
     // Note that by having a shared pointer with a custom deleter, we avoid doing any copy.
     auto deleter = [value](void* p) { OrtReleaseValue(value); };
@@ -529,6 +582,11 @@ class Model::UpdaterImpl::State {
     std::vector<std::string> m_outputNames;
     std::vector<const char*> m_outputCNames;
     std::vector<std::unique_ptr<IPoker>> m_pokers;
+    // Kept from run to run so that running does not allocate it. Each value is released by the tensor it is poked as.
+    std::vector<OrtValue*> m_outputs;
+    // Lets a run that outlives the deadline of its update be terminated. Null should it fail to be created, in which
+    // case runs are left to complete.
+    OrtRunOptions* m_runOptions{nullptr};
 
     State(onnx_errc& errc, std::shared_ptr<Model::State> modelState,
           std::map<std::string, std::shared_ptr<inference::IHandle>> const& inputToHandle,
@@ -552,12 +610,19 @@ class Model::UpdaterImpl::State {
             m_outputNames.push_back(pair.first);
             m_outputCNames.push_back(m_outputNames.back().c_str());
         }
+        m_outputs.resize(outputToPipe.size());
+
+        if (OrtStatus* status = OrtCreateRunOptions(&m_runOptions)) {
+            OrtReleaseStatus(status);
+            m_runOptions = nullptr;
+        }
     }
 
     ~State() {
         for (OrtValue*& value : m_inputs) {
             if (value != nullptr) OrtReleaseValue(value);
         }
+        if (m_runOptions != nullptr) OrtReleaseRunOptions(m_runOptions);
     }
 };
 
@@ -601,16 +666,52 @@ std::error_code Model::UpdaterImpl::UpdateOutput() {
 
     // As far as I can tell in the current version, OrtRun's outputs is a purely *out* parameter (at least according to
     // the header), so the input pointers would not be reused even if we were to furnish them (in which case I'd expect
-    // this to be an in-out parameter). But I could be misunderstanding the semantics.
-    std::vector<OrtValue*> outputs;
-    outputs.resize(m_state->m_outputCNames.size());
-    OrtStatus* status;
+    // this to be an in-out parameter). But I could be misunderstanding the semantics, so they are cleared regardless.
+    auto& outputs = m_state->m_outputs;
+    std::fill(outputs.begin(), outputs.end(), nullptr);
+    OrtStatus* status = nullptr;
+    bool terminated = false;
     {
-        // Have the call to OrtRun occur inside a critical section.
-        std::unique_lock<std::mutex> lock(m_state->m_modelState->m_model_lock);
-        status = OrtRun(m_parent->m_state->m_session.get(), nullptr, m_state->m_inputCNames.data(),
-                        m_state->m_inputs.data(), m_state->m_inputs.size(), m_state->m_outputCNames.data(),
-                        m_state->m_outputCNames.size(), outputs.data());
+        // Have the call to OrtRun run on a worker of the global executor, in turn with the runs of other models, and
+        // occur inside a critical section, entered by the priority of the output being updated. The section is only
+        // entered once on a worker, so the lease is never held while waiting for one. Were it held while queued, more
+        // urgent runs of this model would wait behind the queue of the executor, and a worker running this model for a
+        // graph would wait on a lease whose holder waits for a worker. Should the update have a deadline, it gives up
+        // on either once the deadline passes, and a run already underway by then is terminated.
+        auto const& modelState = m_state->m_modelState;
+        auto deadline = inference::CurrentDeadline();
+        OrtRunOptions* runOptions = m_state->m_runOptions;
+        bool leased = false;
+        bool ran = modelState->m_tenant->RunUntil(
+            [this, &modelState, runOptions, &outputs, &status, &leased]() {
+                // The task runs with the priority and deadline of the update.
+                auto lease =
+                    modelState->m_scheduler.TryAcquireUntil(inference::CurrentPriority(), inference::CurrentDeadline());
+                if (!lease) return;
+                leased = true;
+                status = OrtRun(m_parent->m_state->m_session.get(), runOptions, m_state->m_inputCNames.data(),
+                                m_state->m_inputs.data(), m_state->m_inputs.size(), m_state->m_outputCNames.data(),
+                                m_state->m_outputCNames.size(), outputs.data());
+            },
+            deadline,
+            [runOptions, &terminated]() {
+                if (runOptions == nullptr) return;
+                if (OrtStatus* terminateStatus = OrtRunOptionsEnableTerminate(runOptions))
+                    OrtReleaseStatus(terminateStatus);
+                else
+                    terminated = true;
+            });
+        if (terminated) {
+            // The options are reused by the next run, which must not start out terminated.
+            if (OrtStatus* terminateStatus = OrtRunOptionsDisableTerminate(runOptions))
+                OrtReleaseStatus(terminateStatus);
+        }
+        if (!ran || !leased) return inference::make_feature_error(inference::feature_errc::deadline_exceeded);
+    }
+    // A run that completed before it could be terminated is as good as any other.
+    if (status && terminated) {
+        OrtReleaseStatus(status);
+        return inference::make_feature_error(inference::feature_errc::deadline_exceeded);
     }
     if (status) {
         OrtReleaseStatus(status);
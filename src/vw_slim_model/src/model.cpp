@@ -97,6 +97,8 @@ class ValueUpdater final : public inference::ValueUpdater {
     const std::shared_ptr<VWExample> m_vw_example;
     const std::vector<std::unique_ptr<IPeeker>> m_peekers;
     std::vector<std::unique_ptr<vw_slim::example_predict_builder>> m_builders;
+    // The namespace of each builder, as the builder adds it to the example.
+    std::vector<namespace_index> m_namespaces;
     const std::unique_ptr<OutputTask::IPoker> m_poker;
 };
 
@@ -219,18 +221,24 @@ ValueUpdater::ValueUpdater(std::shared_ptr<Model::State> state, std::shared_ptr<
     : m_state(std::move(state)),
       m_vw_example(std::move(example)),
       m_peekers(std::move(peekers)),
-      m_builders(m_state->m_builder_idx_to_idx.size()),
-      m_poker(std::move(poker)) {}
-
-std::error_code ValueUpdater::UpdateOutput() {
-    m_vw_example->clear();
-    // Set up the new round of builders. This seems inefficient, but I see no way to reuse builders.
+      m_poker(std::move(poker)) {
+    // The builders are made once. Making one hashes its namespace, which is what is worth not doing on every update.
     const auto& bi2ei = m_state->m_builder_idx_to_idx;
+    m_builders.reserve(bi2ei.size());
+    m_namespaces.reserve(bi2ei.size());
     for (size_t i = 0; i < bi2ei.size(); ++i) {
         const auto& entry = m_state->m_schema[bi2ei[i]];
-        m_builders[i] =
-            std::make_unique<vw_slim::example_predict_builder>(m_vw_example.get(), (char*)entry.Namespace.c_str());
+        m_builders.push_back(
+            std::make_unique<vw_slim::example_predict_builder>(m_vw_example.get(), (char*)entry.Namespace.c_str()));
+        m_namespaces.push_back(static_cast<namespace_index>(entry.Namespace.c_str()[0]));
     }
+}
+
+std::error_code ValueUpdater::UpdateOutput() {
+    // Making a builder also adds its namespace to the example, which clearing the example undoes, so the namespaces are
+    // added back here in place of making the builders anew. The example keeps its memory from update to update.
+    m_vw_example->clear();
+    for (auto ns : m_namespaces) m_vw_example->indices.push_back(ns);
 
     const auto& ei2bi = m_state->m_schema_entry_idx_to_idx;
     for (size_t i = 0; i < ei2bi.size(); ++i) {